@@ -24,14 +24,33 @@ HEADERS += sendervideodialog.h \
     receivervideodialog.h \
     settings.h \
     filewriter.h \
+    filereader.h \
+    varint.h \
     videocompressorthread.h \
+    jpegcompressor.h \
+    pixelformat.h \
+    demosaic.h \
     stoppablethread.h \
     speakerthread.h \
+    alsadevice.h \
+    sampleformat.h \
+    audioformat.h \
+    levelmeter.h \
     nonblockingbuffer.h \
+    audioring.h \
+    jitterbuffer.h \
+    rateestimator.h \
+    sampleclock.h \
+    driftresampler.h \
+    audiocodec.h \
     audiofilewriter.h \
+    audiofilereader.h \
     cycdatabuffer.h \
+    consumerdispatcher.h \
+    datarates.h \
     microphonethread.h \
     videofilewriter.h \
+    videofilereader.h \
     config.h \
     camerathread.h \
     videowidget.h \
@@ -42,14 +61,30 @@ SOURCES += sendervideodialog.cpp \
     receivervideodialog.cpp \
     settings.cpp \
     filewriter.cpp \
+    filereader.cpp \
     videocompressorthread.cpp \
+    jpegcompressor.cpp \
+    pixelformat.cpp \
+    demosaic.cpp \
     stoppablethread.cpp \
     speakerthread.cpp \
+    alsadevice.cpp \
+    audioformat.cpp \
+    levelmeter.cpp \
     nonblockingbuffer.cpp \
+    jitterbuffer.cpp \
+    rateestimator.cpp \
+    sampleclock.cpp \
+    driftresampler.cpp \
+    audiocodec.cpp \
     audiofilewriter.cpp \
+    audiofilereader.cpp \
     cycdatabuffer.cpp \
+    consumerdispatcher.cpp \
+    datarates.cpp \
     microphonethread.cpp \
     videofilewriter.cpp \
+    videofilereader.cpp \
     camerathread.cpp \
     videowidget.cpp \
     main.cpp \
@@ -69,3 +104,9 @@ LIBS += -L/usr/local/lib \
     -ljpeg
 RESOURCES += 
 DEFINES += __STDC_LIMIT_MACROS
+
+# Use the TurboJPEG API of libjpeg-turbo when it is installed
+exists(/usr/include/turbojpeg.h)|exists(/usr/local/include/turbojpeg.h) {
+    DEFINES += HAVE_TURBOJPEG
+    LIBS += -lturbojpeg
+}
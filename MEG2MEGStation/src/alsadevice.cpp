@@ -0,0 +1,461 @@
+/*
+ * alsadevice.cpp
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alsadevice.h"
+
+using namespace std;
+
+AlsaDevice::AlsaDevice(const char* _name, snd_pcm_stream_t _stream, AudioFormat _format, unsigned int _sampRate, snd_pcm_uframes_t _framesPerPeriod, unsigned int _nPeriods, bool _useMmap)
+{
+	int						rc;
+	snd_pcm_hw_params_t*	params;
+	snd_pcm_sw_params_t*	swParams;
+	unsigned int			val;
+
+	framesPerPeriod = _framesPerPeriod;
+	sampRate = _sampRate;
+	frameSize = _format.getFrameSize();
+	stream = _stream;
+	useMmap = _useMmap;
+	framesXfer = 0;
+	isNull = !strcmp(_name, AUDIO_NULL_DEVICE);
+	mmapAreas = NULL;
+	mmapFrames = 0;
+	pendingErr = 0;
+
+	rc = snd_pcm_open(&handle, _name, _stream, 0);
+	if (rc < 0)
+	{
+		cerr << "unable to open pcm device " << _name << ": " << snd_strerror(rc) << endl;
+		abort();
+	}
+
+	snd_pcm_hw_params_alloca(&params);			// Allocate a hardware parameters object
+
+	// Fill it in with default values
+	if (snd_pcm_hw_params_any(handle, params) < 0)
+	{
+		cerr << "Can not configure PCM device: " << _name << endl;
+		abort();
+	}
+
+	// Set the desired hardware parameters
+	if (useMmap && snd_pcm_hw_params_set_access(handle, params, SND_PCM_ACCESS_MMAP_INTERLEAVED) < 0)
+	{
+		cerr << "PCM device " << _name << " does not support mmap access, falling back to read/write access" << endl;
+		useMmap = false;
+	}
+
+	if (!useMmap)
+	{
+		snd_pcm_hw_params_set_access(handle, params, SND_PCM_ACCESS_RW_INTERLEAVED);
+	}
+
+	if (snd_pcm_hw_params_set_format(handle, params, _format.getAlsaFormat()) < 0)
+	{
+		cerr << "PCM device " << _name << " does not support the " << _format.getName() << " sample format" << endl;
+		abort();
+	}
+
+	if (snd_pcm_hw_params_set_channels(handle, params, _format.getChans()) < 0)
+	{
+		cerr << "PCM device " << _name << " does not support " << _format.getChans() << " channels" << endl;
+		abort();
+	}
+
+	// Set sampling rate
+	val = sampRate;
+	snd_pcm_hw_params_set_rate_near(handle, params, &val, NULL);
+
+	// Set period size
+	snd_pcm_hw_params_set_period_size_near(handle, params, &framesPerPeriod, NULL);
+
+	// Set number of periods
+	if (snd_pcm_hw_params_set_periods(handle, params, _nPeriods, 0) < 0)
+	{
+		cerr << "Error setting periods" << endl;
+		abort();
+	}
+
+	// Write the parameters to the driver
+	rc = snd_pcm_hw_params(handle, params);
+	if (rc < 0)
+	{
+		cerr << "unable to set hw parameters: " << snd_strerror(rc) << endl;
+		abort();
+	}
+
+	// Verify the parameters
+	val = 0;
+	snd_pcm_hw_params_get_rate(params, &val, NULL);
+	if (val != sampRate)
+	{
+		cerr << "unable to set sampling rate: requested " << sampRate << ", actual " << val << endl;
+		abort();
+	}
+
+	snd_pcm_hw_params_get_period_size(params, &framesPerPeriod, NULL);
+	if (framesPerPeriod != _framesPerPeriod)
+	{
+		cerr << "unable to set frames per period: requested " << _framesPerPeriod << ", actual " << framesPerPeriod << endl;
+		abort();
+	}
+
+	// Wake up once a whole period can be transferred
+	snd_pcm_sw_params_alloca(&swParams);
+	snd_pcm_sw_params_current(handle, swParams);
+	snd_pcm_sw_params_set_avail_min(handle, swParams, framesPerPeriod);
+
+	// Report the time of the hardware pointer updates, from the same clock
+	// that is used for all the other timestamps
+	snd_pcm_sw_params_set_tstamp_mode(handle, swParams, SND_PCM_TSTAMP_ENABLE);
+	snd_pcm_sw_params_set_tstamp_type(handle, swParams, SND_PCM_TSTAMP_TYPE_GETTIMEOFDAY);
+	rc = snd_pcm_sw_params(handle, swParams);
+	if (rc < 0)
+	{
+		cerr << "unable to set sw parameters: " << snd_strerror(rc) << endl;
+		abort();
+	}
+
+	if (posix_memalign((void**)&bounceBuf, CACHE_LINE_SIZE, framesPerPeriod * frameSize))
+	{
+		cerr << "Cannot allocate memory for audio device buffer" << endl;
+		abort();
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &nextDeadline);
+}
+
+
+AlsaDevice::~AlsaDevice()
+{
+	snd_pcm_drain(handle);
+	snd_pcm_close(handle);
+	free(bounceBuf);
+}
+
+
+unsigned char* AlsaDevice::areaAddr(const snd_pcm_channel_area_t* _areas, snd_pcm_uframes_t _offset)
+{
+	// Interleaved access: all the channels share the first area
+	return((unsigned char*)_areas[0].addr + _areas[0].first / 8 + _offset * _areas[0].step / 8);
+}
+
+
+void AlsaDevice::pace()
+{
+	struct timespec	now;
+
+	if (!isNull)
+	{
+		return;
+	}
+
+	// The null device never blocks; emulate a device running at the
+	// sampling rate
+	nextDeadline.tv_nsec += long(framesPerPeriod * 1000000000ULL / sampRate);
+	while (nextDeadline.tv_nsec >= 1000000000)
+	{
+		nextDeadline.tv_nsec -= 1000000000;
+		nextDeadline.tv_sec++;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (now.tv_sec > nextDeadline.tv_sec + 1)
+	{
+		// Too far behind, don't try to catch up
+		nextDeadline = now;
+	}
+
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &nextDeadline, NULL);
+}
+
+
+int AlsaDevice::waitForPeriod(snd_pcm_uframes_t _frames)
+{
+	snd_pcm_sframes_t	avail;
+	int					rc;
+
+	while (true)
+	{
+		avail = snd_pcm_avail_update(handle);
+		if (avail < 0)
+		{
+			return(avail);
+		}
+
+		if (snd_pcm_uframes_t(avail) >= _frames)
+		{
+			return(0);
+		}
+
+		// A playback stream which has not been started yet will never
+		// become ready on its own
+		if (snd_pcm_state(handle) == SND_PCM_STATE_PREPARED)
+		{
+			rc = snd_pcm_start(handle);
+			if (rc < 0)
+			{
+				return(rc);
+			}
+		}
+
+		rc = snd_pcm_wait(handle, AUDIO_WAIT_TIMEOUT);
+		if (rc < 0)
+		{
+			return(rc);
+		}
+		else if (rc == 0)
+		{
+			return(-EIO);
+		}
+	}
+}
+
+
+snd_pcm_sframes_t AlsaDevice::readPeriod(void* _data)
+{
+	const snd_pcm_channel_area_t*	areas;
+	snd_pcm_uframes_t	offset;
+	snd_pcm_uframes_t	frames;
+	snd_pcm_uframes_t	done;
+	snd_pcm_sframes_t	rc;
+
+	if (!useMmap)
+	{
+		rc = snd_pcm_readi(handle, _data, framesPerPeriod);
+		framesXfer += (rc > 0) ? rc : 0;
+		pace();
+		return(rc);
+	}
+
+	// Copy the period straight from the DMA area; it may wrap around the
+	// end of the area
+	done = 0;
+	while (done < framesPerPeriod)
+	{
+		rc = waitForPeriod(framesPerPeriod - done);
+		if (rc < 0)
+		{
+			return(rc);
+		}
+
+		frames = framesPerPeriod - done;
+		rc = snd_pcm_mmap_begin(handle, &areas, &offset, &frames);
+		if (rc < 0)
+		{
+			return(rc);
+		}
+
+		memcpy((unsigned char*)_data + done * frameSize, areaAddr(areas, offset), frames * frameSize);
+
+		rc = snd_pcm_mmap_commit(handle, offset, frames);
+		if (rc < 0 || snd_pcm_uframes_t(rc) != frames)
+		{
+			return((rc < 0) ? rc : -EPIPE);
+		}
+
+		done += frames;
+		framesXfer += frames;
+	}
+
+	pace();
+	return(done);
+}
+
+
+void* AlsaDevice::beginWrite()
+{
+	snd_pcm_uframes_t	frames;
+	int					rc;
+
+	mmapFrames = 0;
+
+	if (!useMmap)
+	{
+		return(bounceBuf);
+	}
+
+	rc = waitForPeriod(framesPerPeriod);
+	if (rc == 0)
+	{
+		frames = framesPerPeriod;
+		rc = snd_pcm_mmap_begin(handle, &mmapAreas, &mmapOffset, &frames);
+		mmapFrames = frames;
+	}
+
+	if (rc < 0)
+	{
+		pendingErr = rc;
+		mmapFrames = 0;
+		return(bounceBuf);
+	}
+
+	// Write directly into the DMA area if the whole period is contiguous
+	if (mmapFrames == framesPerPeriod)
+	{
+		return(areaAddr(mmapAreas, mmapOffset));
+	}
+	else
+	{
+		return(bounceBuf);
+	}
+}
+
+
+snd_pcm_sframes_t AlsaDevice::commitWrite()
+{
+	const snd_pcm_channel_area_t*	areas;
+	snd_pcm_uframes_t	offset;
+	snd_pcm_uframes_t	frames;
+	snd_pcm_sframes_t	rc;
+
+	if (!useMmap)
+	{
+		rc = snd_pcm_writei(handle, bounceBuf, framesPerPeriod);
+		framesXfer += (rc > 0) ? rc : 0;
+		pace();
+		return(rc);
+	}
+
+	if (pendingErr)
+	{
+		rc = pendingErr;
+		pendingErr = 0;
+		return(rc);
+	}
+
+	if (mmapFrames < framesPerPeriod)
+	{
+		// The period wraps around the end of the DMA area: copy it from the
+		// intermediate buffer in two parts
+		memcpy(areaAddr(mmapAreas, mmapOffset), bounceBuf, mmapFrames * frameSize);
+		rc = snd_pcm_mmap_commit(handle, mmapOffset, mmapFrames);
+		if (rc < 0 || snd_pcm_uframes_t(rc) != mmapFrames)
+		{
+			return((rc < 0) ? rc : -EPIPE);
+		}
+
+		frames = framesPerPeriod - mmapFrames;
+		rc = snd_pcm_mmap_begin(handle, &areas, &offset, &frames);
+		if (rc < 0)
+		{
+			return(rc);
+		}
+		memcpy(areaAddr(areas, offset), bounceBuf + mmapFrames * frameSize, frames * frameSize);
+		rc = snd_pcm_mmap_commit(handle, offset, frames);
+		if (rc < 0 || snd_pcm_uframes_t(rc) != frames)
+		{
+			return((rc < 0) ? rc : -EPIPE);
+		}
+	}
+	else
+	{
+		rc = snd_pcm_mmap_commit(handle, mmapOffset, mmapFrames);
+		if (rc < 0 || snd_pcm_uframes_t(rc) != mmapFrames)
+		{
+			return((rc < 0) ? rc : -EPIPE);
+		}
+	}
+
+	framesXfer += framesPerPeriod;
+	pace();
+	return(framesPerPeriod);
+}
+
+
+void AlsaDevice::recover(int _err)
+{
+	// The stream is restarted from scratch
+	framesXfer = 0;
+
+	if (snd_pcm_recover(handle, _err, 1) < 0)
+	{
+		snd_pcm_prepare(handle);
+	}
+}
+
+
+// Convert a timestamp to microseconds
+static uint64_t toMicroseconds(const snd_htimestamp_t* _ts)
+{
+	return(uint64_t(_ts->tv_sec) * 1000000 + _ts->tv_nsec / 1000);
+}
+
+
+bool AlsaDevice::getPosition(uint64_t* _frames, uint64_t* _time)
+{
+	snd_pcm_status_t*	status;
+	snd_htimestamp_t	tstamp;
+	snd_pcm_sframes_t	delay;
+
+	snd_pcm_status_alloca(&status);
+	if (snd_pcm_status(handle, status) < 0 || snd_pcm_status_get_state(status) != SND_PCM_STATE_RUNNING)
+	{
+		return(false);
+	}
+
+	snd_pcm_status_get_htstamp(status, &tstamp);
+	if (!tstamp.tv_sec && !tstamp.tv_nsec)
+	{
+		return(false);
+	}
+
+	// The delay is the number of frames captured but not read yet, or
+	// written but not played yet
+	delay = snd_pcm_status_get_delay(status);
+	if (stream == SND_PCM_STREAM_CAPTURE)
+	{
+		*_frames = framesXfer + delay;
+	}
+	else
+	{
+		*_frames = framesXfer - delay;
+	}
+	*_time = toMicroseconds(&tstamp);
+
+	return(true);
+}
+
+
+bool AlsaDevice::getTriggerTime(uint64_t* _time)
+{
+	snd_pcm_status_t*	status;
+	snd_htimestamp_t	tstamp;
+
+	snd_pcm_status_alloca(&status);
+	if (snd_pcm_status(handle, status) < 0 || snd_pcm_status_get_state(status) != SND_PCM_STATE_RUNNING)
+	{
+		return(false);
+	}
+
+	snd_pcm_status_get_trigger_htstamp(status, &tstamp);
+	if (!tstamp.tv_sec && !tstamp.tv_nsec)
+	{
+		return(false);
+	}
+
+	*_time = toMicroseconds(&tstamp);
+	return(true);
+}
@@ -0,0 +1,126 @@
+/*
+ * alsadevice.h
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ALSADEVICE_H_
+#define ALSADEVICE_H_
+
+// Use the newer ALSA API
+#define ALSA_PCM_NEW_HW_PARAMS_API
+
+#include <time.h>
+#include <alsa/asoundlib.h>
+
+#include "config.h"
+#include "audioformat.h"
+
+//! ALSA PCM device transferring whole periods of interleaved audio.
+/*!
+ * The device is opened and configured in the constructor; any failure to
+ * get the requested parameters is fatal.
+ *
+ * If _useMmap is true, the data is transferred directly from/to the
+ * device's DMA area (SND_PCM_ACCESS_MMAP_INTERLEAVED) and the thread waits
+ * for the device with poll() (through snd_pcm_wait()). If the device does
+ * not support mmap access, the object falls back to the read/write access.
+ *
+ * The device keeps count of the frames transferred since the stream was
+ * (re)started, so that the hardware timestamps reported by ALSA can be
+ * related to the frames. The timestamps are taken from the system real-time
+ * clock.
+ *
+ * For testing without sound hardware, use the AUDIO_NULL_DEVICE device,
+ * which is paced to the sampling rate by a timer, or a snd-aloop loopback
+ * device (e.g. "hw:Loopback,0,0").
+ */
+class AlsaDevice
+{
+public:
+	AlsaDevice(const char* _name, snd_pcm_stream_t _stream, AudioFormat _format, unsigned int _sampRate, snd_pcm_uframes_t _framesPerPeriod, unsigned int _nPeriods, bool _useMmap);
+	virtual ~AlsaDevice();
+
+	/*!
+	 * Capture one period into _data. Return the number of frames captured or
+	 * a negative error code, like snd_pcm_readi().
+	 */
+	snd_pcm_sframes_t readPeriod(void* _data);
+
+	/*!
+	 * Return the memory where the next period for playback should be
+	 * written: the DMA area itself if possible, otherwise an intermediate
+	 * buffer. Must be followed by commitWrite().
+	 */
+	void* beginWrite();
+
+	/*!
+	 * Play the period written after beginWrite(). Return the number of
+	 * frames written or a negative error code, like snd_pcm_writei().
+	 */
+	snd_pcm_sframes_t commitWrite();
+
+	//! Recover from an error returned by readPeriod() or commitWrite().
+	void recover(int _err);
+
+	/*!
+	 * Number of frames that the sound card has captured (or played) since
+	 * the stream was started, and the time (in microseconds) when that
+	 * number was reached. Return false if the device does not report
+	 * hardware timestamps.
+	 */
+	bool getPosition(uint64_t* _frames, uint64_t* _time);
+
+	/*!
+	 * Time (in microseconds) when the stream was started, i.e. when frame 0
+	 * was captured (or played). Return false if not known.
+	 */
+	bool getTriggerTime(uint64_t* _time);
+
+	//! Frames read or written since the stream was started.
+	uint64_t getFramesTransferred() { return(framesXfer); }
+
+	bool isMmap() { return(useMmap); }
+
+	snd_pcm_uframes_t getFramesPerPeriod() { return(framesPerPeriod); }
+
+private:
+	unsigned char* areaAddr(const snd_pcm_channel_area_t* _areas, snd_pcm_uframes_t _offset);
+	int waitForPeriod(snd_pcm_uframes_t _frames);
+	void pace();
+
+	snd_pcm_t*			handle;
+	snd_pcm_stream_t	stream;
+	snd_pcm_uframes_t	framesPerPeriod;
+	int					frameSize;			// in bytes
+	unsigned int		sampRate;
+	bool				useMmap;
+	bool				isNull;
+	uint64_t			framesXfer;			// since the last start of the stream
+
+	// Playback
+	unsigned char*		bounceBuf;			// used when the DMA area can't be written directly
+	const snd_pcm_channel_area_t*	mmapAreas;
+	snd_pcm_uframes_t	mmapOffset;
+	snd_pcm_uframes_t	mmapFrames;			// frames mapped by beginWrite()
+	int					pendingErr;			// error from beginWrite(), reported by commitWrite()
+
+	// Pacing of the null device
+	struct timespec		nextDeadline;
+};
+
+#endif /* ALSADEVICE_H_ */
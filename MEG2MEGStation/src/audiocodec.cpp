@@ -0,0 +1,593 @@
+/*
+ * audiocodec.cpp
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "audiocodec.h"
+
+using namespace std;
+
+
+//---------------------------------------------------------------------
+// Bit streams, most significant bit first
+//
+
+class BitWriter
+{
+public:
+	BitWriter(unsigned char* _dst) { dst = _dst; acc = 0; nBits = 0; }
+
+	// Append the _n (at most 32) lowest bits of _val
+	void put(uint32_t _val, int _n)
+	{
+		acc = (acc << _n) | (_val & ((uint64_t(1) << _n) - 1));
+		nBits += _n;
+		while (nBits >= 8)
+		{
+			nBits -= 8;
+			*dst++ = (unsigned char)(acc >> nBits);
+		}
+	}
+
+	void putZeros(uint32_t _n)
+	{
+		for (; _n > 32; _n -= 32)
+		{
+			put(0, 32);
+		}
+		put(0, _n);
+	}
+
+	// Pad the stream to whole bytes and return its end
+	unsigned char* finish()
+	{
+		if (nBits)
+		{
+			put(0, 8 - nBits);
+		}
+		return(dst);
+	}
+
+private:
+	unsigned char*	dst;
+	uint64_t		acc;
+	int				nBits;		// not yet written to dst
+};
+
+
+class BitReader
+{
+public:
+	BitReader(const unsigned char* _src, int _len) { src = _src; end = _src + _len; acc = 0; nBits = 0; }
+
+	// Read _n (at most 32) bits; return false at the end of the stream
+	bool get(int _n, uint32_t* _val)
+	{
+		while (nBits < _n)
+		{
+			if (src == end)
+			{
+				return(false);
+			}
+			acc = (acc << 8) | *src++;
+			nBits += 8;
+		}
+
+		nBits -= _n;
+		*_val = uint32_t((acc >> nBits) & ((uint64_t(1) << _n) - 1));
+		return(true);
+	}
+
+	// Read the number of zeros before the next one, and the one
+	bool getUnary(uint32_t* _val)
+	{
+		uint32_t	n = 0;
+
+		while (true)
+		{
+			if (!(acc & ((uint64_t(1) << nBits) - 1)))
+			{
+				// All the remaining bits are zeros
+				n += nBits;
+				if (src == end)
+				{
+					return(false);
+				}
+				acc = *src++;
+				nBits = 8;
+				continue;
+			}
+
+			nBits--;
+			if ((acc >> nBits) & 1)
+			{
+				*_val = n;
+				return(true);
+			}
+			n++;
+		}
+	}
+
+private:
+	const unsigned char*	src;
+	const unsigned char*	end;
+	uint64_t				acc;
+	int						nBits;		// not yet read from acc
+};
+
+
+//---------------------------------------------------------------------
+// Prediction. The samples before _s[0] are the preceding ones, starting
+// with the history.
+//
+
+template<int ORDER>
+static inline int64_t predict(const int32_t* _s)
+{
+	switch (ORDER)
+	{
+	case 1:
+		return(_s[-1]);
+
+	case 2:
+		return(2 * int64_t(_s[-1]) - _s[-2]);
+
+	case 3:
+		return(3 * (int64_t(_s[-1]) - _s[-2]) + _s[-3]);
+
+	case 4:
+		return(4 * (int64_t(_s[-1]) + _s[-3]) - 6 * int64_t(_s[-2]) - _s[-4]);
+
+	default:
+		return(0);
+	}
+}
+
+
+// Residuals of the predictor of order ORDER, zigzag mapped to unsigned
+template<int ORDER>
+static void computeResiduals(const int32_t* _s, int _n, uint32_t* _res)
+{
+	int		i;
+	int32_t	e;
+
+	for (i=0; i<_n; i++)
+	{
+		e = int32_t(_s[i] - predict<ORDER>(_s + i));
+		_res[i] = (uint32_t(e) << 1) ^ uint32_t(e >> 31);
+	}
+}
+
+
+// Inverse of computeResiduals()
+template<int ORDER>
+static void restoreSamples(int32_t* _s, int _n, const uint32_t* _res)
+{
+	int		i;
+	int32_t	e;
+
+	for (i=0; i<_n; i++)
+	{
+		e = int32_t(_res[i] >> 1) ^ -int32_t(_res[i] & 1);
+		_s[i] = int32_t(e + predict<ORDER>(_s + i));
+	}
+}
+
+
+/*
+ * Sums of the absolute residuals of all the predictors, for choosing the
+ * order. The residual of order k is the k-th difference of the samples;
+ * the differences are computed from each other.
+ */
+static void sumResiduals(const int32_t* _s, int _n, uint64_t* _sums)
+{
+	int		i = 0;
+	int		k;
+	int32_t	e[CODEC_MAX_ORDER + 1];
+	int32_t	d1, d2, d3, f2, f3;
+
+	for (k=0; k<=CODEC_MAX_ORDER; k++)
+	{
+		_sums[k] = 0;
+	}
+
+#ifdef __SSE2__
+	__m128i	zero = _mm_setzero_si128();
+	__m128i	acc[CODEC_MAX_ORDER + 1];
+	__m128i	ev[CODEC_MAX_ORDER + 1];
+	uint64_t	laneSums[2];
+
+	for (k=0; k<=CODEC_MAX_ORDER; k++)
+	{
+		acc[k] = zero;
+	}
+
+	for (; i+4<=_n; i+=4)
+	{
+		__m128i	s0 = _mm_loadu_si128((const __m128i*)(_s + i));
+		__m128i	s1 = _mm_loadu_si128((const __m128i*)(_s + i - 1));
+		__m128i	s2 = _mm_loadu_si128((const __m128i*)(_s + i - 2));
+		__m128i	s3 = _mm_loadu_si128((const __m128i*)(_s + i - 3));
+		__m128i	s4 = _mm_loadu_si128((const __m128i*)(_s + i - 4));
+		__m128i	vd1 = _mm_sub_epi32(s1, s2);
+		__m128i	vd2 = _mm_sub_epi32(s2, s3);
+		__m128i	vf2 = _mm_sub_epi32(vd1, vd2);
+		__m128i	vf3 = _mm_sub_epi32(vf2, _mm_sub_epi32(vd2, _mm_sub_epi32(s3, s4)));
+
+		ev[0] = s0;
+		ev[1] = _mm_sub_epi32(s0, s1);
+		ev[2] = _mm_sub_epi32(ev[1], vd1);
+		ev[3] = _mm_sub_epi32(ev[2], vf2);
+		ev[4] = _mm_sub_epi32(ev[3], vf3);
+
+		// Absolute values, summed in 64 bits
+		for (k=0; k<=CODEC_MAX_ORDER; k++)
+		{
+			__m128i	sign = _mm_srai_epi32(ev[k], 31);
+			__m128i	a = _mm_sub_epi32(_mm_xor_si128(ev[k], sign), sign);
+
+			acc[k] = _mm_add_epi64(acc[k], _mm_unpacklo_epi32(a, zero));
+			acc[k] = _mm_add_epi64(acc[k], _mm_unpackhi_epi32(a, zero));
+		}
+	}
+
+	for (k=0; k<=CODEC_MAX_ORDER; k++)
+	{
+		_mm_storeu_si128((__m128i*)laneSums, acc[k]);
+		_sums[k] = laneSums[0] + laneSums[1];
+	}
+#endif
+
+	for (; i<_n; i++)
+	{
+		d1 = _s[i-1] - _s[i-2];
+		d2 = _s[i-2] - _s[i-3];
+		d3 = _s[i-3] - _s[i-4];
+		f2 = d1 - d2;
+		f3 = f2 - (d2 - d3);
+
+		e[0] = _s[i];
+		e[1] = _s[i] - _s[i-1];
+		e[2] = e[1] - d1;
+		e[3] = e[2] - f2;
+		e[4] = e[3] - f3;
+
+		for (k=0; k<=CODEC_MAX_ORDER; k++)
+		{
+			_sums[k] += (e[k] >= 0) ? e[k] : -e[k];
+		}
+	}
+}
+
+
+// Number of bits taken by the Rice codes of _n residuals with parameter _k
+static uint64_t riceBits(const uint32_t* _res, int _n, int _k)
+{
+	uint64_t	bits = uint64_t(_n) * (_k + 1);
+	int			i;
+
+	for (i=0; i<_n; i++)
+	{
+		bits += _res[i] >> _k;
+	}
+
+	return(bits);
+}
+
+
+//---------------------------------------------------------------------
+// AudioCodec
+//
+
+AudioCodec::AudioCodec(SampleFormat _format, int _nChans)
+{
+	if (!canCode(_format))
+	{
+		cerr << "Audio sample format " << _format << " can't be coded" << endl;
+		abort();
+	}
+
+	if (_nChans < 1 || _nChans > AUDIO_MAX_CHANS)
+	{
+		cerr << "Invalid number of audio channels: " << _nChans << ", should be between 1 and " << AUDIO_MAX_CHANS << endl;
+		abort();
+	}
+
+	format = _format;
+	nChans = _nChans;
+	sampleBits = (format == SAMPLE_S16) ? 16 : 24;
+
+	samples = NULL;
+	residuals = NULL;
+	scratchLen = 0;
+
+	reset();
+}
+
+
+AudioCodec::~AudioCodec()
+{
+	free(samples);
+	free(residuals);
+}
+
+
+bool AudioCodec::canCode(SampleFormat _format)
+{
+	return(_format == SAMPLE_S16 || _format == SAMPLE_S24);
+}
+
+
+void AudioCodec::reset()
+{
+	memset(history, 0, sizeof(history));
+}
+
+
+int AudioCodec::maxCodedSize(int _nFrames)
+{
+	// The size of the frame count plus verbatim channels
+	return(sizeof(uint16_t) + nChans * (1 + (_nFrames * sampleBits + 7) / 8));
+}
+
+
+void AudioCodec::reserve(int _nFrames)
+{
+	if (_nFrames <= scratchLen)
+	{
+		return;
+	}
+
+	samples = (int32_t*)realloc(samples, (_nFrames + CODEC_MAX_ORDER) * sizeof(int32_t));
+	residuals = (uint32_t*)realloc(residuals, _nFrames * sizeof(uint32_t));
+	if (!samples || !residuals)
+	{
+		cerr << "Error allocating memory!" << endl;
+		abort();
+	}
+
+	scratchLen = _nFrames;
+}
+
+
+int AudioCodec::encode(const void* _data, int _nFrames, unsigned char* _dst)
+{
+	BitWriter	bits(_dst + sizeof(uint16_t));
+	uint16_t	nFrames = _nFrames;
+	uint64_t	sums[CODEC_MAX_ORDER + 1];
+	uint64_t	cost;
+	uint64_t	bestCost;
+	int32_t*	s;
+	uint32_t	q;
+	int			ch;
+	int			i;
+	int			k;
+	int			bestK;
+	int			order;
+
+	if (_nFrames > 0xFFFF)
+	{
+		cerr << "Too many frames in an audio period: " << _nFrames << endl;
+		abort();
+	}
+
+	reserve(_nFrames);
+	s = samples + CODEC_MAX_ORDER;
+	memcpy(_dst, &nFrames, sizeof(uint16_t));
+
+	for (ch=0; ch<nChans; ch++)
+	{
+		memcpy(samples, history[ch], sizeof(history[ch]));
+		for (i=0; i<_nFrames; i++)
+		{
+			s[i] = (format == SAMPLE_S16) ? ((const int16_t*)_data)[i*nChans + ch] : ((const int32_t*)_data)[i*nChans + ch];
+		}
+
+		// Use the predictor with the smallest residuals
+		sumResiduals(s, _nFrames, sums);
+		order = 0;
+		for (k=1; k<=CODEC_MAX_ORDER; k++)
+		{
+			order = (sums[k] < sums[order]) ? k : order;
+		}
+
+		switch (order)
+		{
+		case 0:
+			computeResiduals<0>(s, _nFrames, residuals);
+			break;
+
+		case 1:
+			computeResiduals<1>(s, _nFrames, residuals);
+			break;
+
+		case 2:
+			computeResiduals<2>(s, _nFrames, residuals);
+			break;
+
+		case 3:
+			computeResiduals<3>(s, _nFrames, residuals);
+			break;
+
+		default:
+			computeResiduals<4>(s, _nFrames, residuals);
+		}
+
+		// The Rice parameter is about the log2 of the mean residual (which
+		// is doubled by the zigzag mapping); its neighbours are tried too
+		k = 0;
+		while (k < CODEC_MAX_RICE && (uint64_t(_nFrames) << (k + 1)) <= 2 * sums[order])
+		{
+			k++;
+		}
+
+		bestK = k;
+		bestCost = riceBits(residuals, _nFrames, k);
+		for (k=bestK-1; k<=bestK+1; k+=2)
+		{
+			if (k >= 0 && k <= CODEC_MAX_RICE && (cost = riceBits(residuals, _nFrames, k)) < bestCost)
+			{
+				bestCost = cost;
+				bestK = k;
+			}
+		}
+
+		if (bestCost >= uint64_t(_nFrames) * sampleBits)
+		{
+			bits.put(CODEC_VERBATIM, 3);
+			bits.put(0, 5);
+			for (i=0; i<_nFrames; i++)
+			{
+				bits.put(uint32_t(s[i]), sampleBits);
+			}
+		}
+		else
+		{
+			bits.put(order, 3);
+			bits.put(bestK, 5);
+			for (i=0; i<_nFrames; i++)
+			{
+				q = residuals[i] >> bestK;
+				if (q < 32)
+				{
+					bits.put(1, q + 1);
+				}
+				else
+				{
+					bits.putZeros(q);
+					bits.put(1, 1);
+				}
+				bits.put(residuals[i], bestK);
+			}
+		}
+
+		// The prediction of the next period starts from the end of this one
+		memcpy(history[ch], s + _nFrames - CODEC_MAX_ORDER, sizeof(history[ch]));
+	}
+
+	return(bits.finish() - _dst);
+}
+
+
+int AudioCodec::decode(const unsigned char* _src, int _len, void* _dst, int _maxFrames)
+{
+	BitReader	bits(_src + sizeof(uint16_t), _len - sizeof(uint16_t));
+	uint16_t	nFrames;
+	uint32_t	order;
+	uint32_t	k;
+	uint32_t	q;
+	uint32_t	r;
+	int32_t*	s;
+	int			ch;
+	int			i;
+
+	if (_len < int(sizeof(uint16_t)))
+	{
+		return(-1);
+	}
+
+	memcpy(&nFrames, _src, sizeof(uint16_t));
+	if (nFrames > _maxFrames)
+	{
+		return(-1);
+	}
+
+	reserve(nFrames);
+	s = samples + CODEC_MAX_ORDER;
+
+	for (ch=0; ch<nChans; ch++)
+	{
+		memcpy(samples, history[ch], sizeof(history[ch]));
+		if (!bits.get(3, &order) || !bits.get(5, &k))
+		{
+			return(-1);
+		}
+
+		if (order == CODEC_VERBATIM)
+		{
+			for (i=0; i<nFrames; i++)
+			{
+				if (!bits.get(sampleBits, &r))
+				{
+					return(-1);
+				}
+				s[i] = int32_t(r << (32 - sampleBits)) >> (32 - sampleBits);
+			}
+		}
+		else if (order <= CODEC_MAX_ORDER)
+		{
+			for (i=0; i<nFrames; i++)
+			{
+				if (!bits.getUnary(&q) || !bits.get(k, &r) || uint64_t(q) << k > 0xFFFFFFFF)
+				{
+					return(-1);
+				}
+				residuals[i] = (q << k) | r;
+			}
+
+			switch (order)
+			{
+			case 0:
+				restoreSamples<0>(s, nFrames, residuals);
+				break;
+
+			case 1:
+				restoreSamples<1>(s, nFrames, residuals);
+				break;
+
+			case 2:
+				restoreSamples<2>(s, nFrames, residuals);
+				break;
+
+			case 3:
+				restoreSamples<3>(s, nFrames, residuals);
+				break;
+
+			default:
+				restoreSamples<4>(s, nFrames, residuals);
+			}
+		}
+		else
+		{
+			return(-1);
+		}
+
+		for (i=0; i<nFrames; i++)
+		{
+			if (format == SAMPLE_S16)
+			{
+				((int16_t*)_dst)[i*nChans + ch] = int16_t(s[i]);
+			}
+			else
+			{
+				((int32_t*)_dst)[i*nChans + ch] = s[i];
+			}
+		}
+
+		memcpy(history[ch], s + nFrames - CODEC_MAX_ORDER, sizeof(history[ch]));
+	}
+
+	return(nFrames);
+}
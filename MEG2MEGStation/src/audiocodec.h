@@ -0,0 +1,99 @@
+/*
+ * audiocodec.h
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIOCODEC_H_
+#define AUDIOCODEC_H_
+
+#include <stdint.h>
+
+#include "config.h"
+#include "sampleformat.h"
+
+#define CODEC_MAX_ORDER		4		// Highest order of the predictors
+#define CODEC_VERBATIM		7		// Order code of the verbatim channels
+#define CODEC_MAX_RICE		30		// Highest Rice parameter
+
+//! Lossless coder of the periods of an interleaved audio stream.
+/*!
+ * Every channel of a period is predicted with the best of the fixed
+ * polynomial predictors of order 0 to CODEC_MAX_ORDER (as in FLAC), and the
+ * residuals are Rice coded with a parameter chosen for that channel and
+ * period. A channel whose residuals would take more space than its samples
+ * is stored verbatim instead.
+ *
+ * The prediction continues from the end of the previous period, so that
+ * short periods don't need warm-up samples. The coder and the decoder thus
+ * have to see the same sequence of periods, e.g. all the periods of a file
+ * in the order they are stored; reset() starts a new sequence.
+ *
+ * A coded period starts with its number of frames (uint16), followed by a
+ * bitstream for each channel: the predictor order (3 bits, CODEC_VERBATIM
+ * for verbatim samples), the Rice parameter (5 bits) and the residuals
+ * (zigzag mapped, unary quotient terminated by a one, then the remainder).
+ * Verbatim samples are stored with as many bits as the format has. The
+ * bitstream is padded to whole bytes.
+ *
+ * Only integer formats of at most 24 bits can be coded (see canCode()). The
+ * class does not depend on the rest of the application, so that it can be
+ * used for reading the files elsewhere.
+ */
+class AudioCodec
+{
+public:
+	AudioCodec(SampleFormat _format, int _nChans);
+	~AudioCodec();
+
+	//! Return true if the samples of format _format can be coded.
+	static bool canCode(SampleFormat _format);
+
+	//! Forget the previous periods, e.g. at the beginning of a file.
+	void reset();
+
+	//! Upper bound of the size of a coded period of _nFrames frames.
+	int maxCodedSize(int _nFrames);
+
+	//! Code _nFrames frames of _data to _dst and return the size of the result.
+	int encode(const void* _data, int _nFrames, unsigned char* _dst);
+
+	/*!
+	 * Decode a period of _len bytes from _src to _dst, which has room for
+	 * _maxFrames frames. Return the number of frames, or -1 if the data is
+	 * corrupt.
+	 */
+	int decode(const unsigned char* _src, int _len, void* _dst, int _maxFrames);
+
+private:
+	void reserve(int _nFrames);
+
+	SampleFormat	format;
+	int				nChans;
+	int				sampleBits;
+
+	// Last samples of the previous period, most recent last
+	int32_t			history[AUDIO_MAX_CHANS][CODEC_MAX_ORDER];
+
+	// Scratch space for one channel of a period: the history followed by
+	// the samples, and the residuals
+	int32_t*		samples;
+	uint32_t*		residuals;
+	int				scratchLen;		// in frames
+};
+
+#endif /* AUDIOCODEC_H_ */
@@ -0,0 +1,161 @@
+/*
+ * audiofilereader.cpp
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "audiofilereader.h"
+
+AudioFileReader::AudioFileReader()
+{
+	codec = NULL;
+	sampleBuf = NULL;
+	sampleBufLen = 0;
+}
+
+
+AudioFileReader::~AudioFileReader()
+{
+	close();
+	free(sampleBuf);
+}
+
+
+void AudioFileReader::close()
+{
+	FileReader::close();
+
+	delete codec;
+	codec = NULL;
+}
+
+
+bool AudioFileReader::open(const char* _fileName)
+{
+	uint32_t	chans;
+	uint32_t	sampFormat;
+	uint32_t	coding = AUDIO_CODING_RAW;
+	uint32_t	version;
+
+	close();
+
+	if(!openFile(_fileName, MAGIC_AUDIO_STR))
+	{
+		return(false);
+	}
+
+	version = getVersion();
+	if(version < 6 || version > AUDIO_FILE_VERSION)
+	{
+		snprintf(error, sizeof(error), "Unsupported audio file version %u", version);
+		close();
+		return(false);
+	}
+
+	if(!readHeader(&sampRate, sizeof(uint32_t)) || !readHeader(&chans, sizeof(uint32_t))
+	   || !readHeader(&sampFormat, sizeof(uint32_t)) || (version >= 7 && !readHeader(&coding, sizeof(uint32_t))))
+	{
+		snprintf(error, sizeof(error), "Truncated header in %s", _fileName);
+		close();
+		return(false);
+	}
+
+	if(chans < 1 || chans > AUDIO_MAX_CHANS || sampFormat > SAMPLE_FLOAT || coding > AUDIO_CODING_LOSSLESS
+	   || (coding == AUDIO_CODING_LOSSLESS && !AudioCodec::canCode(SampleFormat(sampFormat))))
+	{
+		snprintf(error, sizeof(error), "Invalid header in %s", _fileName);
+		close();
+		return(false);
+	}
+
+	nChans = chans;
+	format = SampleFormat(sampFormat);
+	frameSize = sampleFormatSize(format) * nChans;
+
+	if(coding == AUDIO_CODING_LOSSLESS)
+	{
+		codec = new AudioCodec(format, nChans);
+	}
+
+	// Each chunk carries the raw and the fitted capture time
+	setLayout(version >= 8, 2);
+	return(true);
+}
+
+
+FileRecordType AudioFileReader::readRecord(AudioRecord* _rec)
+{
+	FileRecord		fileRec;
+	FileRecordType	type;
+	uint16_t		nFrames;
+	int				rc;
+
+	type = FileReader::readRecord(&fileRec);
+	if(type == FILE_RECORD_END || type == FILE_RECORD_ERROR)
+	{
+		return(type);
+	}
+
+	_rec->timestamp = fileRec.timestamp;
+	_rec->id = fileRec.id;
+
+	if(type == FILE_RECORD_GAP)
+	{
+		_rec->policy = fileRec.policy;
+		_rec->droppedChunks = fileRec.droppedChunks;
+		_rec->droppedBytes = fileRec.droppedBytes;
+		return(FILE_RECORD_GAP);
+	}
+
+	_rec->rawTstamp = fileRec.fields[0];
+	_rec->fitTstamp = fileRec.fields[1];
+
+	if(!codec)
+	{
+		_rec->nFrames = fileRec.size / frameSize;
+		_rec->data = fileRec.data;
+		return(FILE_RECORD_CHUNK);
+	}
+
+	// The coded data starts with the number of frames
+	if(fileRec.size < sizeof(uint16_t))
+	{
+		snprintf(error, sizeof(error), "Corrupt compressed chunk");
+		return(FILE_RECORD_ERROR);
+	}
+
+	memcpy(&nFrames, fileRec.data, sizeof(uint16_t));
+	if(!reserveBuf(&sampleBuf, &sampleBufLen, size_t(nFrames) * frameSize))
+	{
+		snprintf(error, sizeof(error), "Cannot allocate memory");
+		return(FILE_RECORD_ERROR);
+	}
+
+	rc = codec->decode((const unsigned char*)fileRec.data, fileRec.size, sampleBuf, nFrames);
+	if(rc < 0)
+	{
+		snprintf(error, sizeof(error), "Corrupt compressed chunk");
+		return(FILE_RECORD_ERROR);
+	}
+
+	_rec->nFrames = rc;
+	_rec->data = sampleBuf;
+	return(FILE_RECORD_CHUNK);
+}
@@ -0,0 +1,90 @@
+/*
+ * audiofilereader.h
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIOFILEREADER_H_
+#define AUDIOFILEREADER_H_
+
+#include <stdint.h>
+
+#include "config.h"
+#include "sampleformat.h"
+#include "audiocodec.h"
+#include "filereader.h"
+
+//! A record of an audio file, see AudioFileWriter and FileWriter.
+struct AudioRecord
+{
+	uint64_t	timestamp;		// in milliseconds
+	uint64_t	id;
+
+	// Chunks only
+	uint32_t	nFrames;
+	uint64_t	rawTstamp;		// in microseconds
+	uint64_t	fitTstamp;		// in microseconds
+	const void*	data;			// interleaved samples, valid until the next call
+
+	// Gaps only
+	uint32_t	policy;
+	uint64_t	droppedChunks;
+	uint64_t	droppedBytes;
+};
+
+//! Streaming reader of the audio files written by AudioFileWriter.
+/*!
+ * The records are read one at a time, so files of any length can be
+ * processed in constant memory. Compressed data is decoded to the samples
+ * as captured, and the chunk attributes are returned exactly as stored.
+ * Files of version 6 (never compressed), 7 and 8 (in blocks) are supported.
+ *
+ * The reader does not depend on Qt or ALSA, so that it can also be built
+ * into the MATLAB tools (see matlab/read_aud.cpp).
+ */
+class AudioFileReader : public FileReader
+{
+public:
+	AudioFileReader();
+	virtual ~AudioFileReader();
+
+	//! Open the file and read its header. Return false on error, see getError().
+	bool open(const char* _fileName);
+	virtual void close();
+
+	uint32_t getSampRate() { return(sampRate); }
+	int getChans() { return(nChans); }
+	SampleFormat getFormat() { return(format); }
+	bool isCompressed() { return(codec != NULL); }
+
+	//! Read the next record to _rec.
+	FileRecordType readRecord(AudioRecord* _rec);
+
+private:
+	uint32_t		sampRate;
+	int				nChans;
+	SampleFormat	format;
+	int				frameSize;		// in bytes
+
+	AudioCodec*		codec;			// NULL if the data is stored as captured
+
+	// The samples of the current chunk if compressed
+	unsigned char*	sampleBuf;
+	size_t			sampleBufLen;
+};
+
+#endif /* AUDIOFILEREADER_H_ */
@@ -27,16 +27,30 @@
 
 using namespace std;
 
-AudioFileWriter::AudioFileWriter(CycDataBuffer* _cycBuf, const char* _path, int _siteId, bool _isSender, int _nchans, QLineEdit* _suffix)
+AudioFileWriter::AudioFileWriter(CycDataBuffer* _cycBuf, const char* _path, int _siteId, bool _isSender, AudioFormat _format, QLineEdit* _suffix)
 	:	FileWriter(_cycBuf, _path, "aud", _siteId, _isSender, _suffix)
 {
 	Settings	settings;
-	uint32_t	nchans = _nchans;
+	uint32_t	nchans = _format.getChans();
+	uint32_t	sampFormat = _format.getFormat();
 	uint32_t	srate = settings.sampRate;
 	uint32_t	ver = AUDIO_FILE_VERSION;
+	uint32_t	coding;
+
+	frameSize = _format.getFrameSize();
+	if(settings.compressAudioFiles && AudioCodec::canCode(_format.getFormat()))
+	{
+		codec = new AudioCodec(_format.getFormat(), _format.getChans());
+		coding = AUDIO_CODING_LOSSLESS;
+	}
+	else
+	{
+		codec = NULL;
+		coding = AUDIO_CODING_RAW;
+	}
 
 	// Create header
-	bufLen = strlen(MAGIC_AUDIO_STR) + 3 * sizeof(uint32_t) + 2;
+	bufLen = strlen(MAGIC_AUDIO_STR) + 5 * sizeof(uint32_t) + 2;
 	buf = (unsigned char*)malloc(bufLen);
 
 	if(!buf)
@@ -51,12 +65,15 @@ AudioFileWriter::AudioFileWriter(CycDataBuffer* _cycBuf, const char* _path, int
 	memset(buf + strlen(MAGIC_AUDIO_STR) + sizeof(uint32_t) + 1, (_isSender? 1 : 0), 1);	// sender / receiver flag
 	memcpy(buf + strlen(MAGIC_AUDIO_STR) + sizeof(uint32_t) + 2, &srate, sizeof(uint32_t));		// sampling rate
 	memcpy(buf + strlen(MAGIC_AUDIO_STR) + 2*sizeof(uint32_t) + 2, &nchans, sizeof(uint32_t));	// number of channels
+	memcpy(buf + strlen(MAGIC_AUDIO_STR) + 3*sizeof(uint32_t) + 2, &sampFormat, sizeof(uint32_t));	// sample format
+	memcpy(buf + strlen(MAGIC_AUDIO_STR) + 4*sizeof(uint32_t) + 2, &coding, sizeof(uint32_t));		// coding of the data
 }
 
 
 AudioFileWriter::~AudioFileWriter()
 {
 	free(buf);
+	delete codec;
 }
 
 
@@ -65,3 +82,34 @@ unsigned char* AudioFileWriter::getHeader(int* _len)
 	*_len = bufLen;
 	return(buf);
 }
+
+
+int AudioFileWriter::getRecordFields(const ChunkAttrib* _attrib, uint64_t* _fields)
+{
+	// Capture time of the first frame in microseconds: as observed and as
+	// fitted to the sample clock
+	_fields[0] = _attrib->rawTstamp;
+	_fields[1] = _attrib->fitTstamp;
+	return(2);
+}
+
+
+void AudioFileWriter::startFile()
+{
+	if(codec)
+	{
+		codec->reset();
+	}
+}
+
+
+int AudioFileWriter::maxEncodedSize(const ChunkAttrib* _attrib)
+{
+	return(codec ? codec->maxCodedSize(_attrib->chunkSize / frameSize) : 0);
+}
+
+
+int AudioFileWriter::encodeChunk(const unsigned char* _data, const ChunkAttrib* _attrib, unsigned char* _dst)
+{
+	return(codec->encode(_data, _attrib->chunkSize / frameSize, _dst));
+}
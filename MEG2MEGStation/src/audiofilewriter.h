@@ -22,19 +22,40 @@
 #define AUDIOFILEWRITER_H_
 
 #include "filewriter.h"
+#include "audioformat.h"
+#include "audiocodec.h"
 
+//! Writer of audio files.
+/*!
+ * The header stores the sampling rate, the number of channels, the sample
+ * format (SampleFormat) and the coding of the data (uint32). The data is
+ * stored either as captured (AUDIO_CODING_RAW) or losslessly compressed
+ * with AudioCodec (AUDIO_CODING_LOSSLESS), continuing the prediction
+ * through all the periods of the file; AudioFileReader decodes both. In
+ * addition to the common fields, the record of each period contains the
+ * capture time of its first frame in microseconds (uint64), as observed and
+ * as fitted to the sound card's clock (uint64). On the receiver side these
+ * are the times measured at the sending site.
+ */
 class AudioFileWriter : public FileWriter
 {
 public:
-	AudioFileWriter(CycDataBuffer* _cycBuf, const char* _path, int _siteId, bool _isSender, int _nchans, QLineEdit* _suffix);
+	AudioFileWriter(CycDataBuffer* _cycBuf, const char* _path, int _siteId, bool _isSender, AudioFormat _format, QLineEdit* _suffix);
 	virtual ~AudioFileWriter();
 
 protected:
 	virtual unsigned char* getHeader(int* _len);
+	virtual int getRecordFields(const ChunkAttrib* _attrib, uint64_t* _fields);
+	virtual void startFile();
+	virtual int maxEncodedSize(const ChunkAttrib* _attrib);
+	virtual int encodeChunk(const unsigned char* _data, const ChunkAttrib* _attrib, unsigned char* _dst);
 
 private:
 	int				bufLen;
 	unsigned char*	buf;
+
+	int				frameSize;		// in bytes
+	AudioCodec*		codec;			// NULL if the data is stored as captured
 };
 
 #endif /* AUDIOFILEWRITER_H_ */
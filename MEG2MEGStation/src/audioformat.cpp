@@ -0,0 +1,448 @@
+/*
+ * audioformat.cpp
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "audioformat.h"
+
+using namespace std;
+
+
+//---------------------------------------------------------------------
+// Conversions of single samples. The network format is 16-bit, so the
+// conversions to and from it are scaled accordingly; toFloat() scales the
+// same way, without rounding.
+//
+
+template<SampleFormat F> struct SampleTraits;
+
+template<> struct SampleTraits<SAMPLE_S16>
+{
+	typedef int16_t	Type;
+
+	static float level(Type _x) { return(fabsf(_x) * (1.0f / 32768)); }
+	static NET_AUDIO_TYPE toNet(Type _x) { return(_x); }
+	static float toFloat(Type _x) { return(_x); }
+	static Type fromNet(float _x)
+	{
+		_x = (_x < 32767.0f) ? _x : 32767.0f;
+		_x = (_x > -32768.0f) ? _x : -32768.0f;
+		return(Type(lrintf(_x)));
+	}
+};
+
+template<> struct SampleTraits<SAMPLE_S24>
+{
+	typedef int32_t	Type;
+
+	static float level(Type _x) { return(fabsf(float(_x)) * (1.0f / 8388608)); }
+	static NET_AUDIO_TYPE toNet(Type _x) { return(NET_AUDIO_TYPE(_x >> 8)); }
+	static float toFloat(Type _x) { return(_x * (1.0f / 256)); }
+	static Type fromNet(float _x)
+	{
+		_x *= 256.0f;
+		_x = (_x < 8388607.0f) ? _x : 8388607.0f;
+		_x = (_x > -8388608.0f) ? _x : -8388608.0f;
+		return(Type(lrintf(_x)));
+	}
+};
+
+template<> struct SampleTraits<SAMPLE_S32>
+{
+	typedef int32_t	Type;
+
+	static float level(Type _x) { return(fabsf(float(_x)) * (1.0f / 2147483648.0f)); }
+	static NET_AUDIO_TYPE toNet(Type _x) { return(NET_AUDIO_TYPE(_x >> 16)); }
+	static float toFloat(Type _x) { return(_x * (1.0f / 65536)); }
+	static Type fromNet(float _x)
+	{
+		// Floats can't represent the largest 32-bit values exactly
+		double	x = double(_x) * 65536.0;
+
+		x = (x < 2147483647.0) ? x : 2147483647.0;
+		x = (x > -2147483648.0) ? x : -2147483648.0;
+		return(Type(lrint(x)));
+	}
+};
+
+template<> struct SampleTraits<SAMPLE_FLOAT>
+{
+	typedef float	Type;
+
+	static float level(Type _x) { return(fabsf(_x)); }
+	static NET_AUDIO_TYPE toNet(Type _x)
+	{
+		_x *= 32768.0f;
+		_x = (_x < 32767.0f) ? _x : 32767.0f;
+		_x = (_x > -32768.0f) ? _x : -32768.0f;
+		return(NET_AUDIO_TYPE(lrintf(_x)));
+	}
+	static float toFloat(Type _x) { return(_x * 32768.0f); }
+	static Type fromNet(float _x)
+	{
+		_x *= (1.0f / 32768);
+		_x = (_x < 1.0f) ? _x : 1.0f;
+		return((_x > -1.0f) ? _x : -1.0f);
+	}
+};
+
+
+//---------------------------------------------------------------------
+// Processing of whole periods. CHANS is the number of channels, or 0 if it
+// is only known at run time.
+//
+
+template<SampleFormat F>
+static void prepareCaptureKernel(void*, int, int)
+{
+	// Nothing to do for most formats
+}
+
+
+template<>
+void prepareCaptureKernel<SAMPLE_S24>(void* _data, int _nFrames, int _nChans)
+{
+	int32_t*	x = (int32_t*)_data;
+	int			i;
+
+	// The most significant byte is not guaranteed to be the sign extension
+	// of the sample
+	for (i=0; i<_nFrames*_nChans; i++)
+	{
+		x[i] = int32_t(uint32_t(x[i]) << 8) >> 8;
+	}
+}
+
+
+template<SampleFormat F, int CHANS>
+static void measureLevelsKernel(const void* _data, int _nFrames, int _nChans, float* _peaks, float* _sumSquares)
+{
+	typedef typename SampleTraits<F>::Type	T;
+
+	const T*	x = (const T*)_data;
+	const int	nChans = CHANS ? CHANS : _nChans;
+	int			i;
+	int			ch;
+	float		v;
+
+	for (i=0; i<_nFrames; i++, x+=nChans)
+	{
+		for (ch=0; ch<nChans; ch++)
+		{
+			v = SampleTraits<F>::level(x[ch]);
+			_peaks[ch] = (_peaks[ch] >= v) ? _peaks[ch] : v;
+			_sumSquares[ch] += v * v;
+		}
+	}
+}
+
+
+template<SampleFormat F, int CHANS>
+static void extractChannelKernel(const void* _data, int _nFrames, int _nChans, int _chan, NET_AUDIO_TYPE* _dst)
+{
+	typedef typename SampleTraits<F>::Type	T;
+
+	const T*	x = (const T*)_data + _chan;
+	const int	nChans = CHANS ? CHANS : _nChans;
+	int			i;
+
+	for (i=0; i<_nFrames; i++)
+	{
+		_dst[i] = SampleTraits<F>::toNet(x[i * nChans]);
+	}
+}
+
+
+template<SampleFormat F, int CHANS>
+static void mixDownKernel(const void* _data, int _nFrames, int _nChans, const float* _gains, NET_AUDIO_TYPE* _dst)
+{
+	typedef typename SampleTraits<F>::Type	T;
+
+	const T*	x = (const T*)_data;
+	const int	nChans = CHANS ? CHANS : _nChans;
+	int			i;
+	int			ch;
+	float		sum;
+
+	for (i=0; i<_nFrames; i++, x+=nChans)
+	{
+		sum = 0;
+		for (ch=0; ch<nChans; ch++)
+		{
+			sum += _gains[ch] * SampleTraits<F>::toFloat(x[ch]);
+		}
+		_dst[i] = SampleTraits<SAMPLE_S16>::fromNet(sum);
+	}
+}
+
+
+template<SampleFormat F, int CHANS>
+static void storePlaybackKernel(const float* _src, int _nFrames, void* _dst, int _nChans)
+{
+	typedef typename SampleTraits<F>::Type	T;
+
+	T*			y = (T*)_dst;
+	const int	nChans = CHANS ? CHANS : _nChans;
+	int			i;
+	int			ch;
+
+	for (i=0; i<_nFrames; i++, y+=nChans)
+	{
+		for (ch=0; ch<nChans; ch++)
+		{
+			y[ch] = SampleTraits<F>::fromNet(_src[(ch % N_CHANS_NET) * _nFrames + i]);
+		}
+	}
+}
+
+
+#ifdef __SSE2__
+// The usual case for the microphones: a stereo 16-bit sound card
+template<>
+void extractChannelKernel<SAMPLE_S16, 2>(const void* _data, int _nFrames, int, int _chan, NET_AUDIO_TYPE* _dst)
+{
+	const int16_t*	x = (const int16_t*)_data;
+	__m128i			shift = _mm_cvtsi32_si128(16 * (1 - _chan));
+	int				i = 0;
+
+	// Eight frames at a time. Each frame is read as a 32-bit word; the
+	// channel is moved to the upper half and sign-extended back down.
+	for (; i+8<=_nFrames; i+=8)
+	{
+		__m128i	a = _mm_loadu_si128((const __m128i*)(x + 2*i));
+		__m128i	b = _mm_loadu_si128((const __m128i*)(x + 2*i + 8));
+
+		a = _mm_srai_epi32(_mm_sll_epi32(a, shift), 16);
+		b = _mm_srai_epi32(_mm_sll_epi32(b, shift), 16);
+		_mm_storeu_si128((__m128i*)(_dst + i), _mm_packs_epi32(a, b));
+	}
+
+	for (; i<_nFrames; i++)
+	{
+		_dst[i] = x[2*i + _chan];
+	}
+}
+
+
+template<>
+void mixDownKernel<SAMPLE_S16, 2>(const void* _data, int _nFrames, int, const float* _gains, NET_AUDIO_TYPE* _dst)
+{
+	const int16_t*	x = (const int16_t*)_data;
+	__m128			gains = _mm_setr_ps(_gains[0], _gains[1], _gains[0], _gains[1]);
+	__m128			maxVal = _mm_set1_ps(32767.0f);
+	__m128			minVal = _mm_set1_ps(-32768.0f);
+	int				i = 0;
+
+	// Four frames per vector of samples; the products of each frame are
+	// then summed across the vectors of two frames
+	for (; i+8<=_nFrames; i+=8)
+	{
+		__m128i	a = _mm_loadu_si128((const __m128i*)(x + 2*i));
+		__m128i	b = _mm_loadu_si128((const __m128i*)(x + 2*i + 8));
+		__m128	a0 = _mm_mul_ps(gains, _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(a, a), 16)));
+		__m128	a1 = _mm_mul_ps(gains, _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(a, a), 16)));
+		__m128	b0 = _mm_mul_ps(gains, _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(b, b), 16)));
+		__m128	b1 = _mm_mul_ps(gains, _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(b, b), 16)));
+		__m128	lo = _mm_add_ps(_mm_shuffle_ps(a0, a1, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(3, 1, 3, 1)));
+		__m128	hi = _mm_add_ps(_mm_shuffle_ps(b0, b1, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(b0, b1, _MM_SHUFFLE(3, 1, 3, 1)));
+
+		// Clamp before converting, large gains could overflow 32 bits
+		lo = _mm_max_ps(_mm_min_ps(lo, maxVal), minVal);
+		hi = _mm_max_ps(_mm_min_ps(hi, maxVal), minVal);
+		_mm_storeu_si128((__m128i*)(_dst + i), _mm_packs_epi32(_mm_cvtps_epi32(lo), _mm_cvtps_epi32(hi)));
+	}
+
+	for (; i<_nFrames; i++)
+	{
+		_dst[i] = SampleTraits<SAMPLE_S16>::fromNet(_gains[0] * x[2*i] + _gains[1] * x[2*i + 1]);
+	}
+}
+
+
+// The usual case for the speakers: a mono 16-bit sound card
+template<>
+void storePlaybackKernel<SAMPLE_S16, 1>(const float* _src, int _nFrames, void* _dst, int)
+{
+	int16_t*	y = (int16_t*)_dst;
+	int			i = 0;
+
+	// Round and saturate eight frames at a time
+	for (; i+8<=_nFrames; i+=8)
+	{
+		__m128i	lo = _mm_cvtps_epi32(_mm_loadu_ps(_src + i));
+		__m128i	hi = _mm_cvtps_epi32(_mm_loadu_ps(_src + i + 4));
+
+		_mm_storeu_si128((__m128i*)(y + i), _mm_packs_epi32(lo, hi));
+	}
+
+	for (; i<_nFrames; i++)
+	{
+		y[i] = SampleTraits<SAMPLE_S16>::fromNet(_src[i]);
+	}
+}
+#endif
+
+
+//---------------------------------------------------------------------
+// AudioFormat
+//
+
+AudioFormat::AudioFormat()
+{
+	init(SAMPLE_S16, N_CHANS_NET);
+}
+
+
+AudioFormat::AudioFormat(SampleFormat _format, int _nChans)
+{
+	init(_format, _nChans);
+}
+
+
+// Pick the instantiations for format F and the number of channels
+template<SampleFormat F>
+void AudioFormat::selectKernels()
+{
+	sampleSize = sizeof(typename SampleTraits<F>::Type);
+	prepareCaptureFn = prepareCaptureKernel<F>;
+
+	switch (nChans)
+	{
+	case 1:
+		measureLevelsFn = measureLevelsKernel<F, 1>;
+		extractChannelFn = extractChannelKernel<F, 1>;
+		mixDownFn = mixDownKernel<F, 1>;
+		storePlaybackFn = storePlaybackKernel<F, 1>;
+		break;
+
+	case 2:
+		measureLevelsFn = measureLevelsKernel<F, 2>;
+		extractChannelFn = extractChannelKernel<F, 2>;
+		mixDownFn = mixDownKernel<F, 2>;
+		storePlaybackFn = storePlaybackKernel<F, 2>;
+		break;
+
+	default:
+		measureLevelsFn = measureLevelsKernel<F, 0>;
+		extractChannelFn = extractChannelKernel<F, 0>;
+		mixDownFn = mixDownKernel<F, 0>;
+		storePlaybackFn = storePlaybackKernel<F, 0>;
+	}
+}
+
+
+void AudioFormat::init(SampleFormat _format, int _nChans)
+{
+	if (_nChans < 1 || _nChans > AUDIO_MAX_CHANS)
+	{
+		cerr << "Invalid number of audio channels: " << _nChans << ", should be between 1 and " << AUDIO_MAX_CHANS << endl;
+		abort();
+	}
+
+	format = _format;
+	nChans = _nChans;
+
+	switch (format)
+	{
+	case SAMPLE_S16:
+		selectKernels<SAMPLE_S16>();
+		break;
+
+	case SAMPLE_S24:
+		selectKernels<SAMPLE_S24>();
+		break;
+
+	case SAMPLE_S32:
+		selectKernels<SAMPLE_S32>();
+		break;
+
+	case SAMPLE_FLOAT:
+		selectKernels<SAMPLE_FLOAT>();
+		break;
+	}
+}
+
+
+SampleFormat AudioFormat::parseSampleFormat(const char* _name)
+{
+	if (!strcmp(_name, "S16"))
+	{
+		return(SAMPLE_S16);
+	}
+	else if (!strcmp(_name, "S24"))
+	{
+		return(SAMPLE_S24);
+	}
+	else if (!strcmp(_name, "S32"))
+	{
+		return(SAMPLE_S32);
+	}
+	else if (!strcmp(_name, "FLOAT"))
+	{
+		return(SAMPLE_FLOAT);
+	}
+
+	cerr << "Unknown sample format " << _name << ", using S16" << endl;
+	return(SAMPLE_S16);
+}
+
+
+snd_pcm_format_t AudioFormat::getAlsaFormat()
+{
+	switch (format)
+	{
+	case SAMPLE_S24:
+		return(SND_PCM_FORMAT_S24_LE);
+
+	case SAMPLE_S32:
+		return(SND_PCM_FORMAT_S32_LE);
+
+	case SAMPLE_FLOAT:
+		return(SND_PCM_FORMAT_FLOAT_LE);
+
+	default:
+		return(SND_PCM_FORMAT_S16_LE);
+	}
+}
+
+
+const char* AudioFormat::getName()
+{
+	switch (format)
+	{
+	case SAMPLE_S24:
+		return("S24");
+
+	case SAMPLE_S32:
+		return("S32");
+
+	case SAMPLE_FLOAT:
+		return("FLOAT");
+
+	default:
+		return("S16");
+	}
+}
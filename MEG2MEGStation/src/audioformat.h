@@ -0,0 +1,99 @@
+/*
+ * audioformat.h
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIOFORMAT_H_
+#define AUDIOFORMAT_H_
+
+#include <stdint.h>
+#include <alsa/asoundlib.h>
+
+#include "config.h"
+#include "sampleformat.h"
+
+//! Sample format and number of channels of an interleaved audio stream.
+/*!
+ * Besides describing the stream, the object provides the processing that
+ * depends on the format. Each processing function is instantiated from a
+ * template for every sample format, and for one, two and any other number
+ * of channels, so that the common cases run loops with a fixed stride. The
+ * right instantiation is chosen once, in the constructor.
+ *
+ * The audio sent over the network always has N_CHANS_NET channels of
+ * NET_AUDIO_TYPE samples, whatever the sound cards use. The default
+ * constructor describes that format.
+ */
+class AudioFormat
+{
+public:
+	AudioFormat();
+	AudioFormat(SampleFormat _format, int _nChans);
+
+	//! Return the format called _name (S16, S24, S32 or FLOAT).
+	static SampleFormat parseSampleFormat(const char* _name);
+
+	SampleFormat getFormat() { return(format); }
+	int getChans() { return(nChans); }
+	int getSampleSize() { return(sampleSize); }
+	int getFrameSize() { return(sampleSize * nChans); }
+	snd_pcm_format_t getAlsaFormat();
+	const char* getName();
+
+	//! Fix up _nFrames frames just read from the sound card, in place.
+	void prepareCapture(void* _data, int _nFrames) { prepareCaptureFn(_data, _nFrames, nChans); }
+
+	/*!
+	 * Raise _peaks[ch] to the peak absolute value of channel ch in _nFrames
+	 * frames of _data and add the sum of its squares to _sumSquares[ch],
+	 * all relative to the full scale.
+	 */
+	void measureLevels(const void* _data, int _nFrames, float* _peaks, float* _sumSquares) { measureLevelsFn(_data, _nFrames, nChans, _peaks, _sumSquares); }
+
+	//! Write channel _chan of _nFrames frames of _data to _dst in the network format.
+	void extractChannel(const void* _data, int _nFrames, int _chan, NET_AUDIO_TYPE* _dst) { extractChannelFn(_data, _nFrames, nChans, _chan, _dst); }
+
+	/*!
+	 * Write the mix of all the channels of _nFrames frames of _data to _dst
+	 * in the network format. Channel ch is scaled by _gains[ch].
+	 */
+	void mixDown(const void* _data, int _nFrames, const float* _gains, NET_AUDIO_TYPE* _dst) { mixDownFn(_data, _nFrames, nChans, _gains, _dst); }
+
+	/*!
+	 * Write _nFrames frames to _dst. _src holds N_CHANS_NET planar channels
+	 * of _nFrames floats each, scaled like the network format; channel ch of
+	 * the output gets channel ch % N_CHANS_NET of the input.
+	 */
+	void storePlayback(const float* _src, int _nFrames, void* _dst) { storePlaybackFn(_src, _nFrames, _dst, nChans); }
+
+private:
+	void init(SampleFormat _format, int _nChans);
+	template<SampleFormat F> void selectKernels();
+
+	SampleFormat	format;
+	int				nChans;
+	int				sampleSize;			// in bytes
+
+	void	(*prepareCaptureFn)(void* _data, int _nFrames, int _nChans);
+	void	(*measureLevelsFn)(const void* _data, int _nFrames, int _nChans, float* _peaks, float* _sumSquares);
+	void	(*extractChannelFn)(const void* _data, int _nFrames, int _nChans, int _chan, NET_AUDIO_TYPE* _dst);
+	void	(*mixDownFn)(const void* _data, int _nFrames, int _nChans, const float* _gains, NET_AUDIO_TYPE* _dst);
+	void	(*storePlaybackFn)(const float* _src, int _nFrames, void* _dst, int _nChans);
+};
+
+#endif /* AUDIOFORMAT_H_ */
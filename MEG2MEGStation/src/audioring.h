@@ -0,0 +1,159 @@
+/*
+ * audioring.h
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIORING_H_
+#define AUDIORING_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <QAtomicInteger>
+
+#include "config.h"
+
+//! Ring of fixed-size audio periods.
+/*!
+ * Every slot holds one period of _framesPerPeriod frames, each consisting of
+ * CHANS interleaved samples of type T. The slots are aligned to
+ * CACHE_LINE_SIZE, so that the periods never share a cache line and can be
+ * processed with aligned SIMD loads. The number of slots is rounded up to a
+ * power of two and the positions are free-running counters, so finding a
+ * slot is a single mask operation. Chunk ids and timestamps are stored in
+ * separate arrays next to the sample data.
+ *
+ * The producer fills the slot returned by back() and publishes it with
+ * push(); the consumer reads the slot returned by front() and releases it
+ * with pop(). One producer thread and one consumer thread can use the ring
+ * concurrently without any locking: each side only writes its own position
+ * and reads the other one with acquire semantics. The two positions live in
+ * separate cache lines.
+ */
+template <typename T, int CHANS>
+class AudioRing
+{
+public:
+	//! Create a ring holding up to _nSlots periods.
+	AudioRing(int _nSlots, int _framesPerPeriod);
+	~AudioRing();
+
+	//! Size of the sample data of a period, in bytes.
+	int getPeriodSize() const { return(periodSize); }
+
+	int getFramesPerPeriod() const { return(framesPerPeriod); }
+
+	//! Number of periods in the ring. Exact when called by the consumer.
+	int getCount() const { return(int(tail.loadAcquire() - head.load())); }
+
+	//! Called by the consumer.
+	bool isEmpty() const { return(tail.loadAcquire() == head.load()); }
+
+	//! Called by the producer.
+	bool isFull() const { return(tail.load() - head.loadAcquire() == capacity); }
+
+	//! Slot for the next period. Only valid if the ring is not full.
+	T* back() { return(data + (tail.load() & mask) * slotStride); }
+
+	//! Publish the period written into back().
+	void push(uint64_t _id, uint64_t _timestamp)
+	{
+		uint64_t	pos = tail.load();
+
+		ids[pos & mask] = _id;
+		timestamps[pos & mask] = _timestamp;
+		tail.storeRelease(pos + 1);
+	}
+
+	//! Oldest period in the ring. Only valid if the ring is not empty.
+	T* front() { return(data + (head.load() & mask) * slotStride); }
+	uint64_t frontId() const { return(ids[head.load() & mask]); }
+	uint64_t frontTimestamp() const { return(timestamps[head.load() & mask]); }
+
+	//! Release the oldest period.
+	void pop() { head.storeRelease(head.load() + 1); }
+
+private:
+	T*			data;
+	uint64_t*	ids;
+	uint64_t*	timestamps;
+	uint64_t	capacity;		// in periods
+	uint64_t	mask;			// number of slots minus one
+	size_t		slotStride;		// in samples
+	int			periodSize;		// in bytes
+	int			framesPerPeriod;
+
+	char		pad1[CACHE_LINE_SIZE];
+	QAtomicInteger<quint64>	head;	// position of the oldest period, written by the consumer
+	char		pad2[CACHE_LINE_SIZE];
+	QAtomicInteger<quint64>	tail;	// position of the next period, written by the producer
+	char		pad3[CACHE_LINE_SIZE];
+};
+
+
+template <typename T, int CHANS>
+AudioRing<T, CHANS>::AudioRing(int _nSlots, int _framesPerPeriod)
+{
+	uint64_t	nSlots;
+	size_t		slotBytes;
+
+	if(_nSlots < 1 || _framesPerPeriod < 1)
+	{
+		std::cerr << "Invalid audio ring size: " << _nSlots << " periods of " << _framesPerPeriod << " frames" << std::endl;
+		abort();
+	}
+
+	framesPerPeriod = _framesPerPeriod;
+	periodSize = framesPerPeriod * CHANS * sizeof(T);
+	capacity = _nSlots;
+
+	nSlots = 1;
+	while(nSlots < capacity)
+	{
+		nSlots <<= 1;
+	}
+	mask = nSlots - 1;
+
+	slotBytes = ((periodSize + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE) * CACHE_LINE_SIZE;
+	slotStride = slotBytes / sizeof(T);
+
+	if(posix_memalign((void**)&data, CACHE_LINE_SIZE, nSlots * slotBytes))
+	{
+		std::cerr << "Cannot allocate memory for audio ring" << std::endl;
+		abort();
+	}
+	memset(data, 0, nSlots * slotBytes);
+
+	ids = new uint64_t[nSlots];
+	timestamps = new uint64_t[nSlots];
+
+	head.store(0);
+	tail.store(0);
+}
+
+
+template <typename T, int CHANS>
+AudioRing<T, CHANS>::~AudioRing()
+{
+	delete [] timestamps;
+	delete [] ids;
+	free(data);
+}
+
+#endif /* AUDIORING_H_ */
@@ -30,13 +30,55 @@
 using namespace std;
 
 
-CameraThread::CameraThread(dc1394camera_t* _camera, CycDataBuffer* _cycBuf, bool _color, bool _highFps)
+// Frame rate of the standard modes for _fps. Return false if there is none.
+static bool standardFramerate(int _fps, dc1394framerate_t* _framerate)
 {
-    dc1394error_t 	err;
-	struct timespec	timestamp;
+    switch (_fps)
+    {
+    case 15:
+        *_framerate = DC1394_FRAMERATE_15;
+        return(true);
+
+    case 30:
+        *_framerate = DC1394_FRAMERATE_30;
+        return(true);
+
+    case 60:
+        *_framerate = DC1394_FRAMERATE_60;
+        return(true);
+
+    case 120:
+        *_framerate = DC1394_FRAMERATE_120;
+        return(true);
+
+    case 240:
+        *_framerate = DC1394_FRAMERATE_240;
+        return(true);
+
+    default:
+        return(false);
+    }
+}
+
+
+CameraThread::CameraThread(dc1394camera_t* _camera, CycDataBuffer* _cycBuf, PixelFormat _format, VideoFormat _videoFormat, int _roiLeft, int _roiTop)
+{
+    dc1394error_t 		err;
+	struct timespec		timestamp;
+	dc1394video_mode_t	mode;
+	dc1394framerate_t	framerate;
+
+    checkVideoFormat(_format, _videoFormat);
+    if (isBayer(_format) && (_roiLeft % 2 || _roiTop % 2))
+    {
+        cerr << "Invalid region of interest offset: " << _roiLeft << ", " << _roiTop << ", should be even for Bayer frames" << endl;
+        abort();
+    }
 
     cycBuf = _cycBuf;
-    color = _color;
+    format = _format;
+    videoFormat = _videoFormat;
+    frameSize = pixelFormatFrameSize(format, videoFormat.width, videoFormat.height);
     shouldStop = false;
 
     camera = _camera;
@@ -47,13 +89,6 @@ CameraThread::CameraThread(dc1394camera_t* _camera, CycDataBuffer* _cycBuf, bool
 	curChunkId = timestamp.tv_nsec / 1000000;
 	curChunkId += timestamp.tv_sec * 1000;
 
-	preProcBuf = (unsigned char*)malloc(VIDEO_HEIGHT * VIDEO_WIDTH * (color ? 3 : 1));
-	if (!preProcBuf)
-	{
-        cerr << "Could not allocate memory" << endl;
-        abort();
-	}
-
     /*-----------------------------------------------------------------------
      *  setup capture
      *-----------------------------------------------------------------------*/
@@ -71,31 +106,133 @@ CameraThread::CameraThread(dc1394camera_t* _camera, CycDataBuffer* _cycBuf, bool
         abort();
     }
 
-    err = dc1394_video_set_mode(camera, (color ? DC1394_VIDEO_MODE_640x480_RGB8 : DC1394_VIDEO_MODE_640x480_MONO8));
+    // Use a standard mode if there is one for the format, size and rate,
+    // otherwise Format7 with the frame as the region of interest
+    if (!isBayer(format) && videoFormat.width == 640 && videoFormat.height == 480 && !_roiLeft && !_roiTop
+        && standardFramerate(videoFormat.fps, &framerate))
+    {
+        switch (format)
+        {
+        case PIXEL_RGB8:
+            mode = DC1394_VIDEO_MODE_640x480_RGB8;
+            break;
+
+        case PIXEL_YUV422:
+            mode = DC1394_VIDEO_MODE_640x480_YUV422;
+            break;
+
+        case PIXEL_YUV411:
+            mode = DC1394_VIDEO_MODE_640x480_YUV411;
+            break;
+
+        default:
+            mode = DC1394_VIDEO_MODE_640x480_MONO8;
+        }
+
+        err = dc1394_video_set_mode(camera, mode);
+        if (err != DC1394_SUCCESS)
+        {
+            cerr << "Could not set video mode" << endl;
+            abort();
+        }
+
+        err = dc1394_video_set_framerate(camera, framerate);
+        if (err != DC1394_SUCCESS)
+        {
+            cerr << "Could not set framerate" << endl;
+            abort();
+        }
+    }
+    else
+    {
+        setupFormat7(_roiLeft, _roiTop);
+    }
+
+    err = dc1394_capture_setup(camera, N_CAMERA_BUFFERS, DC1394_CAPTURE_FLAGS_DEFAULT);
     if (err != DC1394_SUCCESS)
     {
-        cerr << "Could not set video mode" << endl;
+        cerr << "Could not setup camera-" << endl \
+             << "make sure that the video mode and framerate are" << endl \
+             << "supported by your camera" << endl;
         abort();
     }
+}
+
+
+void CameraThread::setupFormat7(int _roiLeft, int _roiTop)
+{
+    dc1394error_t 			err;
+    dc1394color_coding_t	coding;
+    uint32_t				packetUnit;
+    uint32_t				maxPacket;
+    uint32_t				packetSize;
+
+    switch (format)
+    {
+    case PIXEL_RGB8:
+        coding = DC1394_COLOR_CODING_RGB8;
+        break;
+
+    case PIXEL_YUV422:
+        coding = DC1394_COLOR_CODING_YUV422;
+        break;
+
+    case PIXEL_YUV411:
+        coding = DC1394_COLOR_CODING_YUV411;
+        break;
+
+    case PIXEL_MONO8:
+        coding = DC1394_COLOR_CODING_MONO8;
+        break;
+
+    default:
+        coding = DC1394_COLOR_CODING_RAW8;
+    }
 
-    err = dc1394_video_set_framerate(camera, (_highFps ? DC1394_FRAMERATE_60 : DC1394_FRAMERATE_30));
+    err = dc1394_video_set_mode(camera, DC1394_VIDEO_MODE_FORMAT7_0);
     if (err != DC1394_SUCCESS)
     {
-        cerr << "Could not set framerate" << endl;
+        cerr << "Could not set Format7 mode" << endl;
         abort();
     }
 
-    err = dc1394_capture_setup(camera, N_CAMERA_BUFFERS, DC1394_CAPTURE_FLAGS_DEFAULT);
+    // Format7 has no frame rate setting. One packet is sent every 125 us,
+    // so the frame rate follows from the packet size, which must be a
+    // multiple of the unit reported by the camera.
+    err = dc1394_format7_get_packet_parameters(camera, DC1394_VIDEO_MODE_FORMAT7_0, &packetUnit, &maxPacket);
+    if (err != DC1394_SUCCESS || !packetUnit)
+    {
+        cerr << "Could not get Format7 packet parameters" << endl;
+        abort();
+    }
+
+    packetSize = (uint64_t(frameSize) * videoFormat.fps + 7999) / 8000;
+    packetSize = (packetSize + packetUnit - 1) / packetUnit * packetUnit;
+    if (packetSize > maxPacket)
+    {
+        // The rest of the pipeline gets the rate the camera actually
+        // delivers, see getVideoFormat()
+        packetSize = maxPacket;
+        videoFormat.fps = uint32_t(uint64_t(maxPacket) * 8000 / frameSize);
+        videoFormat.fps = (videoFormat.fps ? videoFormat.fps : 1);
+        cerr << "The frame rate is limited to " << videoFormat.fps << " FPS by the bus bandwidth" << endl;
+    }
+
+    err = dc1394_format7_set_roi(camera, DC1394_VIDEO_MODE_FORMAT7_0, coding, packetSize, _roiLeft, _roiTop, videoFormat.width, videoFormat.height);
     if (err != DC1394_SUCCESS)
     {
-        cerr << "Could not setup camera-" << endl \
-             << "make sure that the video mode and framerate are" << endl \
-             << "supported by your camera" << endl;
+        cerr << "Could not set Format7 region " << videoFormat.width << "x" << videoFormat.height << " at " << _roiLeft << ", " << _roiTop << endl;
         abort();
     }
 }
 
 
+VideoFormat CameraThread::getVideoFormat()
+{
+	return(videoFormat);
+}
+
+
 CameraThread::~CameraThread()
 {
 	dc1394error_t err;
@@ -106,8 +243,6 @@ CameraThread::~CameraThread()
         cerr << "Could not stop video capture" << endl;
         abort();
     }
-
-    free(preProcBuf);
 }
 
 
@@ -119,6 +254,7 @@ void CameraThread::stoppableRun()
 	struct timespec			timestamp;
 	uint64_t				msec;
 	ChunkAttrib				chunkAttrib;
+	unsigned char*			data;
 
     /*-----------------------------------------------------------------------
      *  have the camera start sending us data
@@ -152,11 +288,15 @@ void CameraThread::stoppableRun()
 		msec = timestamp.tv_nsec / 1000000;
 		msec += timestamp.tv_sec * 1000;
 
-		chunkAttrib.chunkSize = VIDEO_HEIGHT * VIDEO_WIDTH * (color ? 3 : 1);
+		chunkAttrib.chunkSize = frameSize;
 		chunkAttrib.timestamp = msec;
 		chunkAttrib.id = curChunkId++;
+		chunkAttrib.rawTstamp = 0;
+		chunkAttrib.fitTstamp = 0;
 
-		memcpy(preProcBuf, frame->image, VIDEO_HEIGHT * VIDEO_WIDTH * (color ? 3 : 1));
+		// Copy the frame from the DMA buffer directly to the circular buffer
+		data = cycBuf->reserveChunk(chunkAttrib.chunkSize);
+		memcpy(data, frame->image, chunkAttrib.chunkSize);
 
 		// draw the last 6 bits of the frame id onto the image as black and white squares
 		//for (int j=0; j<6; j++)
@@ -165,11 +305,11 @@ void CameraThread::stoppableRun()
 		//
 		//	for (int i=0; i<16; i++)
 		//	{
-		//		memset(preProcBuf+lu_corner+VIDEO_WIDTH*i*(color ? 3 : 1), ((chunkAttrib.id >> j) & 1)*255, 16*(color ? 3 : 1));
+		//		memset(data+lu_corner+VIDEO_WIDTH*i*(color ? 3 : 1), ((chunkAttrib.id >> j) & 1)*255, 16*(color ? 3 : 1));
 		//	}
 		//}
 
-		cycBuf->insertChunk(preProcBuf, chunkAttrib);
+		cycBuf->commitChunk(chunkAttrib);
 
         err = dc1394_capture_enqueue(camera, frame);
         if (err != DC1394_SUCCESS)
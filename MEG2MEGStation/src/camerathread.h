@@ -25,14 +25,28 @@
 
 #include "stoppablethread.h"
 #include "cycdatabuffer.h"
+#include "pixelformat.h"
 
 //! This thread acquires and timestamps frames for a single libdc1394 video camera.
+/*!
+ * 640x480 frames at 15, 30, 60, 120 or 240 FPS are captured in the
+ * standard modes, all the other sizes and rates, regions of interest at
+ * _roiLeft, _roiTop and Bayer frames in Format7 mode 0. For Bayer frames
+ * the region should start at even coordinates, so that the mosaic keeps
+ * the pattern of _format.
+ */
 class CameraThread : public StoppableThread
 {
 public:
-	CameraThread(dc1394camera_t* _camera, CycDataBuffer* _cycBuf, bool _color, bool _highFps);
+	CameraThread(dc1394camera_t* _camera, CycDataBuffer* _cycBuf, PixelFormat _format, VideoFormat _videoFormat, int _roiLeft, int _roiTop);
 	virtual ~CameraThread();
 
+	/*!
+	 * Format of the captured frames. In Format7 the bus bandwidth might
+	 * limit the frame rate below the requested one.
+	 */
+	VideoFormat getVideoFormat();
+
 protected:
 	virtual void stoppableRun();
 
@@ -40,8 +54,11 @@ private:
     dc1394camera_t*	camera;
     CycDataBuffer*	cycBuf;
 	uint64_t		curChunkId;
-    bool			color;
-    unsigned char*	preProcBuf;
+    PixelFormat		format;
+    VideoFormat		videoFormat;
+    int				frameSize;		// in bytes
+
+    void setupFormat7(int _roiLeft, int _roiTop);
 };
 
 #endif /* CAMERATHREAD_H_ */
@@ -23,8 +23,11 @@
 // Camera configuration
 #define VIDEO_DEV_PATH   	"/dev/video0"
 #define N_CAMERA_BUFFERS 	1
-#define VIDEO_HEIGHT     	480
-#define VIDEO_WIDTH      	640
+#define VIDEO_MAX_WIDTH		2560		// Largest frame size accepted from the
+#define VIDEO_MAX_HEIGHT	2048		// settings or from the remote station
+#define VIDEO_MAX_FPS		1000
+#define VIDEO_MAX_PIXEL_RATE	100000000	// in pixels per second. Largest remote stream,
+											// what IEEE 1394b carries at 8 bits per pixel
 
 #define SHUTTER_ADDR		0xf0081c
 #define SHUTTER_MIN_VAL		1
@@ -45,39 +48,134 @@
 #define UV_REG_SHIFT		0x1000
 
 // Audio configuration
-#define N_CHANS_SENDER		2			// stereo
-#define N_CHANS_RECEIVER	1			// mono
+#define AUDIO_MAX_CHANS		8			// Maximum number of sound card channels
+#define N_CHANS_NET			1			// The audio sent over the network is mono
+#define NET_AUDIO_TYPE		int16_t		// ...16-bit (see AudioFormat)
+#define LEVEL_BAR_MAX		1000		// Full scale of the audio level bars
 #define	N_BUF_4_VOL_IND		10			// number of buffers used by volume indicator
-#define AUDIO_FORMAT		SND_PCM_FORMAT_S16_LE	// from <alsa/asoundlib.h>
-#define	AUDIO_DATA_TYPE		int16_t					// should match AUDIO_FORMAT
-#define	MAX_AUDIO_VAL		INT16_MAX				// should match AUDIO_FORMAT
-
-#define AUDIO_FILE_VERSION	3
-#define VIDEO_FILE_VERSION	3
+#define METER_UPDATE_INTERVAL	33		// in milliseconds. How often the level bars are refreshed.
+#define GUI_UPDATE_INTERVAL	50			// in milliseconds. How often the FPS label is refreshed.
+#define PLAYBACK_STATS_INTERVAL	10000	// in milliseconds. How often the speaker
+										// buffer and microphone clock statistics
+										// are logged.
+
+// Jitter buffer for the received audio
+#define JITTER_BUF_SLOTS	64			// Maximum number of periods in the buffer
+#define JITTER_MARGIN		3.0			// Target depth as a multiple of the jitter
+#define JITTER_HYSTERESIS	2			// in periods. Extra depth tolerated before
+										// the latency is reduced.
+#define JITTER_CONCEAL_DECAY	0.5		// Attenuation of each repeated period
+#define JITTER_MAX_CONCEAL	6			// Number of repeated periods before silence
+
+// Clock drift compensation for the received audio
+#define DRIFT_CHECKPOINT_INTERVAL	1000	// in milliseconds
+#define DRIFT_WINDOW		60			// in checkpoints. Period over which the
+										// stream rates are measured.
+#define DRIFT_CORRECTION_TIME	10.0	// in seconds. Time for bringing the jitter
+										// buffer depth back to the target.
+#define DRIFT_MAX_RATIO		0.002		// Maximum deviation of the resampling
+										// ratio from one
+
+// Regression of the capture time against the sample index
+#define CLOCK_FIT_WINDOW	1024		// in periods. Number of the most recent
+										// periods used for the fit.
+#define CLOCK_MIN_POINTS	50			// The nominal sampling rate is used until
+										// the fit has this many periods.
+#define CLOCK_OUTLIER_THRESH	2000	// in microseconds. Capture times farther
+										// than this from the fit are ignored...
+#define CLOCK_MAX_OUTLIERS	100			// ...unless this many of them arrive in a
+										// row; then the fit is restarted.
+#define AUDIO_NULL_DEVICE	"null"		// ALSA device for testing without sound
+										// hardware
+#define AUDIO_WAIT_TIMEOUT	1000		// in milliseconds. How long to wait for
+										// the sound card in the mmap mode.
+
+#define AUDIO_FILE_VERSION	8
+#define VIDEO_FILE_VERSION	6
+
+#define GAP_RECORD_MARKER	0xFFFFFFFF	// chunk size value marking a gap record
+										// (files without blocks)
+
+#define AUDIO_CODING_RAW		0		// Audio file data stored as captured...
+#define AUDIO_CODING_LOSSLESS	1		// ...or coded with AudioCodec
 
 #define MAGIC_VIDEO_STR		"ELEKTA_VIDEO_FILE"
 #define MAGIC_AUDIO_STR		"ELEKTA_AUDIO_FILE"
 
 #define UDP_AUDIO_PACKET	1
 #define UDP_VIDEO_PACKET	2
+#define UDP_AUDIO_BATCH_PACKET	3	// several audio periods, see SendingSocket
+#define UDP_VIDEO_FORMAT_PACKET	4	// size and rate of the video frames
+#define UDP_VIDEO_FRAGMENT_PACKET	5	// part of a frame too large for one datagram
+
+#define UDP_VIDEO_FRAGMENT_SIZE	60000	// in bytes. Video data in one datagram, leaving
+										// room for the headers within the UDP limit
+
+#define AUDIO_MAX_PACKET_PERIODS	16	// most audio periods in one datagram, well
+										// within JITTER_BUF_SLOTS
 
 // Buffer parameters
-#define CIRC_BUF_MARG		0.2			// When less than this fraction of the buffer
-										// is left free, overflow error is generated.
-										// Used as a safety measure against race
-										// condition between consumer and producer
-										// threads when the circular buffer is close
-										// to full.
-
-#define MAX_CHUNK_SIZE		(CIRC_BUF_MARG/10)
-										// Maximum chunk size as a fraction of the
-										// circular buffer size. Should be at least
-										// several times smaller than CIRC_BUF_MARG
-										// for the buffer to work properly.
-
-// Buffer sizes
-#define CIRC_VIDEO_BUFF_SZ	100000000	// in bytes
-#define CIRC_AUDIO_BUFF_SZ	100000000	// in bytes
+#define MAX_CHUNK_SIZE		0.02		// Maximum chunk size as a fraction of the
+										// circular buffer size
+
+#define HUGE_PAGE_SIZE		(2*1024*1024)	// in bytes. Circular buffers backed by
+										// huge pages are rounded up to this size.
+
+#define CACHE_LINE_SIZE		64			// in bytes. Slots of the audio rings are
+										// aligned to this size.
+
+#define CIRC_BUF_MAX_CONSUMERS	8		// Maximum number of consumers that can be
+										// registered with a single circular buffer
+
+#define CIRC_BUF_POLL_INTERVAL	500		// in microseconds. How often a consumer
+										// waiting for data re-checks the buffer.
+
+#define CIRC_BUF_SPILL_MARG	0.05		// With the OVERFLOW_SPILL policy, payloads
+										// go to the overflow area when less than
+										// this fraction of the buffer is free. The
+										// remaining space is used for the headers
+										// of the spilled chunks.
+
+#define SPILL_INDEX_SIZE	16384		// Maximum number of chunks that can be in
+										// the overflow area at the same time
+
+#define CIRC_BUF_REWIND_TIMEOUT	1000	// in milliseconds. How long a consumer
+										// waits for the producer to rewind its
+										// cursor.
+
+#define CIRC_BUF_RATE_MARG	1.5			// Circular buffers are resized between
+										// recordings to hold this much more data
+										// than observed during the recording
+
+// Consumer dispatch
+#define DISPATCH_MAX_BATCH		64		// Maximum number of chunks passed to a
+										// consumer in a single call
+#define DISPATCH_POLL_REALTIME		500		// in microseconds. How often dispatchers
+#define DISPATCH_POLL_INTERACTIVE	5000	// of the corresponding latency class
+#define DISPATCH_POLL_BACKGROUND	50000	// check their buffers for new data.
+
+#define VIDEO_MAX_COMPRESSORS	16		// Maximum number of threads compressing the video
+
+// Upper bound for the size of a compressed _width x _height frame. Same as
+// the bound used by libjpeg-turbo's tjBufSize() for the worst case.
+#define JPEG_BUF_SIZE(_width, _height)	((_width) * (_height) * 3 + 2048)
+
+#define JPEG_PEAK_RATIO		3			// Largest compressed frame the buffers are sized
+										// for, relative to the expected average size.
+										// Larger frames are dropped.
+
+#define MAX_DATAGRAM_SIZE	65536		// in bytes
+
+// File writing
+#define FILE_WRITER_BATCH		256			// Maximum number of chunks written with a
+											// single system call
+#define FILE_WRITER_BATCH_BYTES	16000000	// in bytes. Maximum amount of data written
+											// with a single system call
+#define FILE_BLOCK_HEADER		28			// in bytes
+#define FILE_MAX_RECORD_FIELDS	4			// Maximum number of stream-specific fields
+											// in the metadata of a chunk
+#define FILE_CHUNK_MAX_META		100			// in bytes. Upper bound of the metadata
+											// of a chunk, with a gap and all the fields.
 
 // Thread priorities
 #define CAM_THREAD_PRIORITY	10
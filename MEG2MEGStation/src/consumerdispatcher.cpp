@@ -0,0 +1,122 @@
+/*
+ * consumerdispatcher.cpp
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+
+#include "consumerdispatcher.h"
+
+using namespace std;
+
+ConsumerDispatcher::ConsumerDispatcher(CycDataBuffer* _cycBuf, ChunkConsumer* _consumer, LatencyClass _latency, DispatchMode _mode, int _maxBatch)
+{
+	cycBuf = _cycBuf;
+	consumer = _consumer;
+	latency = _latency;
+	mode = _mode;
+	maxBatch = _maxBatch;
+
+	switch(latency)
+	{
+	case LATENCY_REALTIME:
+		pollInterval = DISPATCH_POLL_REALTIME;
+		break;
+	case LATENCY_INTERACTIVE:
+		pollInterval = DISPATCH_POLL_INTERACTIVE;
+		break;
+	case LATENCY_BACKGROUND:
+		pollInterval = DISPATCH_POLL_BACKGROUND;
+		break;
+	default:
+		cerr << "Unknown latency class " << latency << endl;
+		abort();
+	}
+
+	if(maxBatch < 1)
+	{
+		cerr << "Dispatcher batch size should be positive" << endl;
+		abort();
+	}
+
+	chunks = new ChunkRef[maxBatch];
+
+	// Register in the constructor, so that the consumer gets all the chunks
+	// inserted after the dispatcher was created
+	consumerId = cycBuf->registerConsumer();
+}
+
+
+ConsumerDispatcher::~ConsumerDispatcher()
+{
+	cycBuf->unregisterConsumer(consumerId);
+	delete [] chunks;
+}
+
+
+void ConsumerDispatcher::stoppableRun()
+{
+	int	nChunks;
+
+	switch(latency)
+	{
+	case LATENCY_REALTIME:
+		setPriority(QThread::HighestPriority);
+		break;
+	case LATENCY_INTERACTIVE:
+		setPriority(QThread::NormalPriority);
+		break;
+	case LATENCY_BACKGROUND:
+		setPriority(QThread::LowPriority);
+		break;
+	}
+
+	while(!shouldStop)
+	{
+		nChunks = cycBuf->tryGetChunks(consumerId, chunks, maxBatch);
+
+		if(nChunks == 0)
+		{
+			usleep(pollInterval);
+			continue;
+		}
+
+		if(mode == DISPATCH_LATEST)
+		{
+			// Skip to the newest chunk. Once the cursor moves on, the
+			// previously returned chunks are no longer valid, so only the
+			// last one is kept.
+			while(nChunks == maxBatch)
+			{
+				nChunks = cycBuf->tryGetChunks(consumerId, chunks, maxBatch);
+				if(nChunks == 0)
+				{
+					// Nothing new - the last chunk of the previous batch
+					// is still held by the cursor
+					nChunks = maxBatch;
+					break;
+				}
+			}
+			consumer->consumeChunks(cycBuf, &(chunks[nChunks-1]), 1);
+		}
+		else
+		{
+			consumer->consumeChunks(cycBuf, chunks, nChunks);
+		}
+	}
+}
@@ -0,0 +1,96 @@
+/*
+ * consumerdispatcher.h
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CONSUMERDISPATCHER_H_
+#define CONSUMERDISPATCHER_H_
+
+#include "config.h"
+#include "stoppablethread.h"
+#include "cycdatabuffer.h"
+
+//! How quickly a consumer should see the new data.
+enum LatencyClass
+{
+	LATENCY_REALTIME = 1,		// audio, network sending
+	LATENCY_INTERACTIVE = 2,	// display, indicators
+	LATENCY_BACKGROUND = 3		// statistics
+};
+
+
+//! Which chunks a consumer gets.
+enum DispatchMode
+{
+	DISPATCH_ALL = 1,			// every chunk, in order
+	DISPATCH_LATEST = 2			// only the newest of the available chunks
+};
+
+
+//! Interface of the objects receiving data from a ConsumerDispatcher.
+class ChunkConsumer
+{
+public:
+	virtual ~ChunkConsumer() {}
+
+	/*!
+	 * Called from the dispatcher's thread with a batch of chunks from
+	 * _cycBuf. The chunks stay valid only until the call returns.
+	 */
+	virtual void consumeChunks(CycDataBuffer* _cycBuf, ChunkRef* _chunks, int _nChunks) = 0;
+};
+
+
+//! Thread delivering the chunks of a CycDataBuffer to a single consumer.
+/*!
+ * The dispatcher registers its own cursor with the buffer and polls it at
+ * the interval given by the latency class. The available chunks are passed
+ * to the consumer in batches of at most _maxBatch chunks. With
+ * DISPATCH_LATEST the dispatcher drains everything that is available and
+ * passes only the newest chunk, so a slow consumer (e.g. a display) never
+ * falls behind the stream. With DISPATCH_ALL a consumer that cannot keep up
+ * is handled by the buffer's overflow policy like any other consumer.
+ *
+ * The producer side is not involved at all: the dispatcher only reads the
+ * buffer through its cursor, so inserting a chunk costs the producer nothing
+ * regardless of the number of dispatchers.
+ *
+ * Call stop() before destroying the object. The consumer must outlive the
+ * dispatcher.
+ */
+class ConsumerDispatcher : public StoppableThread
+{
+public:
+	ConsumerDispatcher(CycDataBuffer* _cycBuf, ChunkConsumer* _consumer, LatencyClass _latency, DispatchMode _mode, int _maxBatch=DISPATCH_MAX_BATCH);
+	virtual ~ConsumerDispatcher();
+
+protected:
+	virtual void stoppableRun();
+
+private:
+	CycDataBuffer*	cycBuf;
+	ChunkConsumer*	consumer;
+	LatencyClass	latency;
+	DispatchMode	mode;
+	int				maxBatch;
+	int				consumerId;
+	unsigned long	pollInterval;	// in microseconds
+	ChunkRef*		chunks;
+};
+
+#endif /* CONSUMERDISPATCHER_H_ */
@@ -19,67 +19,956 @@
  */
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <iostream>
 #include <time.h>
+#include <QThread>
 
 #include "config.h"
 #include "cycdatabuffer.h"
 
 using namespace std;
 
+// Chunks are padded to a multiple of CHUNK_ALIGN bytes, so that the
+// ChunkHeader structures stored in the buffer are properly aligned.
+#define CHUNK_ALIGN		8
+#define ALIGN_UP(x)		(((x) + CHUNK_ALIGN - 1) & ~((uint64_t)CHUNK_ALIGN - 1))
 
-CycDataBuffer::CycDataBuffer(int _bufSize, bool _ignoreIsRec, FixedStimuli* _fixedStimuli)
+
+// Map _size bytes of the file _fd twice, back-to-back, so that a region
+// starting anywhere in the first copy can be accessed contiguously. _size and
+// _align should be multiples of the page size. Return NULL on failure.
+static unsigned char* mapDoubleRing(int _fd, uint64_t _size, uint64_t _align)
+{
+	unsigned char*	area;
+	unsigned char*	ring;
+
+	// Reserve the address space (plus some slack for the alignment)
+	area = (unsigned char*)mmap(NULL, 2*_size + _align, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (area == MAP_FAILED)
+	{
+		return(NULL);
+	}
+
+	ring = (unsigned char*)(((uintptr_t)area + _align - 1) & ~((uintptr_t)_align - 1));
+
+	if ((mmap(ring, _size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, _fd, 0) == MAP_FAILED) ||
+		(mmap(ring + _size, _size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, _fd, 0) == MAP_FAILED))
+	{
+		munmap(area, 2*_size + _align);
+		return(NULL);
+	}
+
+	// Release the slack
+	if (ring > area)
+	{
+		munmap(area, ring - area);
+	}
+	if (area + _align > ring)
+	{
+		munmap(ring + 2*_size, area + _align - ring);
+	}
+
+	return(ring);
+}
+
+
+// Round _x up to a multiple of _unit
+static uint64_t roundUp(uint64_t _x, uint64_t _unit)
 {
-	insertPtr = 0;
-	getPtr = 0;
+	return(((_x + _unit - 1) / _unit) * _unit);
+}
+
+
+CycDataBuffer::CycDataBuffer(uint64_t _bufSize, bool _ignoreIsRec, FixedStimuli* _fixedStimuli, HugePages _hugePages, bool _lockMemory)
+{
+	int i;
+
 	isRec = false;
-	bufSize = _bufSize;
-    buffSemaphore = new QSemaphore();
+	startRecTstamp = 0;
     ignoreIsRec = _ignoreIsRec;
     fixedStimuli = _fixedStimuli;
+    writePos.store(0);
+    minReadPos = 0;
+
+    for (i=0; i<CIRC_BUF_MAX_CONSUMERS; i++)
+    {
+    	consumers[i].readPos.store(0);
+    	consumers[i].skipPos.store(0);
+    	consumers[i].active.store(0);
+    	consumers[i].rewindState.store(REWIND_NONE);
+    	consumers[i].heldEnd.store(0);
+    	consumers[i].hasPrev = false;
+    }
+
+    reserveMode = RESERVE_RING;
+    reservedData = NULL;
+    reservedSize = 0;
+    oversizeBuf = NULL;
+    oversizeSize = 0;
+
+    policy = OVERFLOW_DROP_NEWEST;
+    blockTimeout = 0;
+    seq = 0;
+    bytesCommitted = 0;
+    droppedChunks.store(0);
+    droppedBytes.store(0);
+    spilledChunks.store(0);
+
+    spillBuf = NULL;
+    spillSize = 0;
+    spillWritePos = 0;
+    spillTailPos = 0;
+    spillReclaimedPos = 0;
+
+    rewindRequests.store(0);
+    lastChunkLen = 0;
+    spillIndexHead = 0;
+    spillIndexTail = 0;
+
+    hugePages = _hugePages;
+    lockMemory = _lockMemory;
+    curRing = allocRing(_bufSize, hugePages, lockMemory);
+    pendingRing.store(NULL);
+    retiredRing.store(NULL);
+    ringStartPos = 0;
+    minHeldPos = 0;
+    useRing(curRing);
+
+    clock_gettime(CLOCK_MONOTONIC, &rateStartTime);
+    rateStartBytes = 0;
+}
+
+
+CycDataBuffer::~CycDataBuffer()
+{
+	if (spillBuf)
+	{
+		munmap(spillBuf, 2*spillSize);
+	}
+
+	freeRing(pendingRing.load());
+	freeRing(retiredRing.load());
+	freeRing(curRing);
+	free(oversizeBuf);
+}
+
+
+CycDataBuffer::RingMapping* CycDataBuffer::allocRing(uint64_t _bufSize, HugePages _hugePages, bool _lockMemory)
+{
+	RingMapping*	ring = new RingMapping;
+	int				fd;
+	uint64_t		pageSize = sysconf(_SC_PAGESIZE);
+
+    // The memory comes from an anonymous file that is mapped twice, so that
+    // the chunks wrap around the end of the buffer transparently.
+    ring->data = NULL;
+    if (_hugePages == HUGE_PAGES_HUGETLB)
+    {
+    	ring->size = roundUp(_bufSize, HUGE_PAGE_SIZE);
+    	fd = memfd_create("cycdatabuffer", MFD_HUGETLB);
+    	if (fd >= 0)
+    	{
+    		if (ftruncate(fd, ring->size) == 0)
+    		{
+    			ring->data = mapDoubleRing(fd, ring->size, HUGE_PAGE_SIZE);
+    		}
+    		close(fd);
+    	}
+
+    	if (!ring->data)
+    	{
+    		cerr << "Cannot allocate huge pages for circular buffer, using normal pages" << endl;
+    	}
+    }
+
+    if (!ring->data)
+    {
+    	ring->size = roundUp(_bufSize, pageSize);
+    	fd = memfd_create("cycdatabuffer", 0);
+    	if (fd < 0 || ftruncate(fd, ring->size) != 0 || !(ring->data = mapDoubleRing(fd, ring->size, pageSize)))
+    	{
+    		cerr << "Cannot allocate memory for circular buffer" << endl;
+    		abort();
+    	}
+    	close(fd);
+
+    	if (_hugePages == HUGE_PAGES_TRANSPARENT)
+    	{
+    		madvise(ring->data, 2*ring->size, MADV_HUGEPAGE);
+    	}
+    }
+
+    // Lock both copies, so that real-time threads never page-fault on the
+    // buffer
+    if (_lockMemory && mlock(ring->data, 2*ring->size))
+    {
+    	cerr << "Cannot lock circular buffer in memory. Continuing nevertheless, but the real-time threads might page-fault on it." << endl;
+    }
 
-    // Allocate the buffer. Reserve some extra space necessary to handle
-    // chunks of varying size.
-    dataBuf = (unsigned char*)malloc(bufSize + 2 * (int(bufSize*MAX_CHUNK_SIZE) + sizeof(ChunkAttrib)));
-    if (!dataBuf)
+    // The largest chunk is limited so that a dropped chunk always fits into
+    // the scratch area
+    ring->maxChunkSize = int(((ring->size*MAX_CHUNK_SIZE) < INT32_MAX) ? (ring->size*MAX_CHUNK_SIZE) : INT32_MAX);
+    ring->discard = (unsigned char*)malloc(ring->maxChunkSize);
+    if (!ring->discard)
     {
     	cerr << "Cannot allocate memory for circular buffer" << endl;
     	abort();
     }
+
+    ring->endPos = 0;
+    return(ring);
 }
 
 
-CycDataBuffer::~CycDataBuffer()
+void CycDataBuffer::freeRing(RingMapping* _ring)
+{
+	if (_ring)
+	{
+		munmap(_ring->data, 2*_ring->size);
+		free(_ring->discard);
+		delete _ring;
+	}
+}
+
+
+void CycDataBuffer::useRing(RingMapping* _ring)
+{
+	dataBuf = _ring->data;
+	discardBuf = _ring->discard;
+	bufSize = _ring->size;
+	maxChunkSize = _ring->maxChunkSize;
+	spillHeadroom = uint64_t(bufSize * CIRC_BUF_SPILL_MARG);
+}
+
+
+uint64_t CycDataBuffer::sizeForRate(StreamRate _rate)
+{
+	double	size;
+	double	minSize;
+
+	// Every chunk also takes a header and some padding
+	size = (_rate.bytesPerSec + _rate.chunksPerSec * ALIGN_UP(sizeof(ChunkHeader) + CHUNK_ALIGN)) * _rate.history;
+
+	// The largest chunk should not exceed MAX_CHUNK_SIZE of the buffer
+	minSize = (ALIGN_UP(sizeof(ChunkHeader) + _rate.largestChunk) + CHUNK_ALIGN) / MAX_CHUNK_SIZE;
+
+	return(uint64_t((size > minSize) ? size : minSize));
+}
+
+
+void CycDataBuffer::resize(uint64_t _bufSize)
+{
+	RingMapping*	ring;
+
+	releaseRetiredRing();
+
+	// Replace the previous request if the producer has not picked it up yet
+	ring = pendingRing.fetchAndStoreOrdered(allocRing(_bufSize, hugePages, lockMemory));
+	freeRing(ring);
+}
+
+
+void CycDataBuffer::resizeForRate(StreamRate _rate)
+{
+	double measuredRate = measureDataRate();
+
+	// Prefer the rate actually observed since the previous resize, but only
+	// if there was any data at all (the remote station might have been
+	// disconnected). The measured rate already includes the headers.
+	if (measuredRate > 0)
+	{
+		_rate.bytesPerSec = measuredRate * CIRC_BUF_RATE_MARG;
+		_rate.chunksPerSec = 0;
+	}
+
+	resize(sizeForRate(_rate));
+}
+
+
+double CycDataBuffer::measureDataRate()
+{
+	struct timespec	curTime;
+	uint64_t		curBytes;
+	double			elapsed;
+	double			res;
+
+	// Count everything the producer tried to put into the ring, including
+	// the dropped chunks
+	curBytes = writePos.loadAcquire() + droppedBytes.load() + droppedChunks.load() * ALIGN_UP(sizeof(ChunkHeader) + CHUNK_ALIGN);
+
+	clock_gettime(CLOCK_MONOTONIC, &curTime);
+	elapsed = (curTime.tv_sec - rateStartTime.tv_sec) + (curTime.tv_nsec - rateStartTime.tv_nsec) / 1e9;
+	res = (elapsed > 0) ? (curBytes - rateStartBytes) / elapsed : 0;
+
+	rateStartTime = curTime;
+	rateStartBytes = curBytes;
+	return(res);
+}
+
+
+void CycDataBuffer::releaseRetiredRing()
+{
+	RingMapping*	ring = retiredRing.loadAcquire();
+	int				i;
+
+	if (!ring)
+	{
+		return;
+	}
+
+	// Some consumer might still hold its last chunk from the old memory
+	for (i=0; i<CIRC_BUF_MAX_CONSUMERS; i++)
+	{
+		if (consumers[i].active.loadAcquire() && consumers[i].readPos.loadAcquire() < ring->endPos)
+		{
+			return;
+		}
+	}
+
+	freeRing(ring);
+	retiredRing.storeRelease(NULL);
+}
+
+
+bool CycDataBuffer::consumersCaughtUp(uint64_t _pos)
+{
+	int	i;
+
+	for (i=0; i<CIRC_BUF_MAX_CONSUMERS; i++)
+	{
+		if (consumers[i].active.loadAcquire() && consumers[i].heldEnd.loadAcquire() != _pos)
+		{
+			return(false);
+		}
+	}
+
+	return(true);
+}
+
+
+void CycDataBuffer::checkResize()
+{
+	// Only the producer modifies writePos, no need for synchronization here
+	uint64_t		pos = writePos.load();
+	RingMapping*	ring;
+
+	// Switch to the resized memory as soon as there is no unread data left.
+	// The previous memory should be released first.
+	if (!pendingRing.loadAcquire() || retiredRing.loadAcquire() || !consumersCaughtUp(pos))
+	{
+		return;
+	}
+
+	ring = pendingRing.fetchAndStoreAcquire(NULL);
+	if (!ring)
+	{
+		return;
+	}
+
+	// The old memory is released by the control thread once all the
+	// consumers have moved past pos
+	curRing->endPos = pos;
+	retiredRing.storeRelease(curRing);
+
+	curRing = ring;
+	useRing(curRing);
+	ringStartPos = pos;
+	minReadPos = pos;
+	minHeldPos = pos;
+	lastChunkLen = 0;
+}
+
+
+void CycDataBuffer::checkRewind()
+{
+	// Only the producer modifies writePos, no need for synchronization here
+	uint64_t		pos = writePos.load();
+	uint64_t		lowerBound;
+	uint64_t		target;
+	uint64_t		len;
+	ChunkHeader*	header;
+	ConsumerCursor*	cursor;
+	int				i;
+
+	if (!rewindRequests.loadAcquire())
+	{
+		return;
+	}
+
+	// Chunks before lowerBound might be already overwritten
+	lowerBound = (pos > bufSize) ? pos - bufSize : 0;
+	lowerBound = (ringStartPos > lowerBound) ? ringStartPos : lowerBound;
+	lowerBound = (spillReclaimedPos > lowerBound) ? spillReclaimedPos : lowerBound;
+
+	for (i=0; i<CIRC_BUF_MAX_CONSUMERS; i++)
+	{
+		cursor = &(consumers[i]);
+		if (!cursor->rewindState.testAndSetAcquire(REWIND_REQUESTED, REWIND_SERVING))
+		{
+			continue;
+		}
+
+		// Walk the chunks back from the newest one
+		target = pos;
+		len = lastChunkLen;
+		while (len && target - len >= lowerBound)
+		{
+			header = (ChunkHeader*)(dataBuf + ((target - len) % bufSize));
+			if (header->attrib.timestamp < cursor->rewindTstamp)
+			{
+				break;
+			}
+			target -= len;
+			len = header->prevLen;
+		}
+
+		// The consumer is waiting in rewind(), it is safe to move its cursor.
+		// Compare against the end of the held batch: the chunk the consumer
+		// asks about is in that batch, so a target at its start must still
+		// count as a move (the batch is simply delivered again).
+		if (target < cursor->heldEnd.load())
+		{
+			cursor->heldEnd.storeRelease(target);
+			cursor->readPos.storeRelease(target);
+			cursor->skipPos.storeRelease(0);
+			minReadPos = (target < minReadPos) ? target : minReadPos;
+			minHeldPos = (target < minHeldPos) ? target : minHeldPos;
+			cursor->rewindState.storeRelease(REWIND_MOVED);
+		}
+		else
+		{
+			cursor->rewindState.storeRelease(REWIND_NOT_MOVED);
+		}
+
+		rewindRequests.fetchAndAddOrdered(-1);
+	}
+}
+
+
+void CycDataBuffer::setOverflowPolicy(OverflowPolicy _policy, int _blockTimeout, const char* _spillDir, uint64_t _spillSize)
+{
+	char			spillName[600];
+	int				fd;
+	uint64_t		pageSize = sysconf(_SC_PAGESIZE);
+
+	policy = _policy;
+	blockTimeout = _blockTimeout;
+
+	if (policy != OVERFLOW_SPILL || spillBuf)
+	{
+		return;
+	}
+
+	// Create the overflow area. The file is unlinked right away, so that it
+	// disappears automatically when the program exits.
+	spillSize = roundUp(_spillSize, pageSize);
+	spillHeadroom = uint64_t(bufSize * CIRC_BUF_SPILL_MARG);
+	snprintf(spillName, sizeof(spillName), "%s/.cycbuf_spill_XXXXXX", (_spillDir ? _spillDir : "/tmp"));
+
+	fd = mkstemp(spillName);
+	if (fd < 0)
+	{
+		cerr << "Cannot create the overflow file " << spillName << ", dropping the newest chunks on overflow" << endl;
+		policy = OVERFLOW_DROP_NEWEST;
+		return;
+	}
+	unlink(spillName);
+
+	// Like the main buffer, the overflow area is mapped twice
+	if (ftruncate(fd, spillSize) == 0)
+	{
+		spillBuf = mapDoubleRing(fd, spillSize, pageSize);
+	}
+	close(fd);
+
+	if (!spillBuf)
+	{
+		cerr << "Cannot map the overflow file, dropping the newest chunks on overflow" << endl;
+		policy = OVERFLOW_DROP_NEWEST;
+	}
+}
+
+
+OverflowPolicy CycDataBuffer::getOverflowPolicy()
+{
+	return(policy);
+}
+
+
+OverflowPolicy CycDataBuffer::parseOverflowPolicy(const char* _name, bool _realtime)
+{
+	if (!strcmp(_name, "block"))
+	{
+		if (_realtime)
+		{
+			cerr << "The block overflow policy would stall a realtime producer, using drop_newest" << endl;
+			return(OVERFLOW_DROP_NEWEST);
+		}
+		return(OVERFLOW_BLOCK);
+	}
+	else if (!strcmp(_name, "drop_newest"))
+	{
+		return(OVERFLOW_DROP_NEWEST);
+	}
+	else if (!strcmp(_name, "drop_oldest"))
+	{
+		return(OVERFLOW_DROP_OLDEST);
+	}
+	else if (!strcmp(_name, "spill"))
+	{
+		return(OVERFLOW_SPILL);
+	}
+
+	cerr << "Unknown overflow policy " << _name << ", using drop_newest" << endl;
+	return(OVERFLOW_DROP_NEWEST);
+}
+
+
+HugePages CycDataBuffer::parseHugePages(const char* _name)
+{
+	if (!strcmp(_name, "none"))
+	{
+		return(HUGE_PAGES_NONE);
+	}
+	else if (!strcmp(_name, "transparent"))
+	{
+		return(HUGE_PAGES_TRANSPARENT);
+	}
+	else if (!strcmp(_name, "hugetlb"))
+	{
+		return(HUGE_PAGES_HUGETLB);
+	}
+
+	cerr << "Unknown kind of huge pages " << _name << ", using normal pages" << endl;
+	return(HUGE_PAGES_NONE);
+}
+
+
+int CycDataBuffer::getMaxChunkSize()
+{
+	return(maxChunkSize - sizeof(ChunkHeader));
+}
+
+
+int CycDataBuffer::getReservableSize()
+{
+	checkResize();
+	return(getMaxChunkSize());
+}
+
+
+uint64_t CycDataBuffer::getDroppedChunks()
+{
+	return(droppedChunks.load());
+}
+
+
+uint64_t CycDataBuffer::getDroppedBytes()
+{
+	return(droppedBytes.load());
+}
+
+
+uint64_t CycDataBuffer::getSpilledChunks()
 {
-    free(dataBuf);
-    delete(buffSemaphore);
+	return(spilledChunks.load());
+}
+
+
+uint64_t CycDataBuffer::chunkLen(uint64_t _pos)
+{
+	ChunkHeader* header = (ChunkHeader*)(dataBuf + (_pos % bufSize));
+
+	if (header->padLen)
+	{
+		return(header->padLen);
+	}
+	else if (header->isSpilled)
+	{
+		return(ALIGN_UP(sizeof(ChunkHeader)));
+	}
+	else
+	{
+		return(ALIGN_UP(sizeof(ChunkHeader) + header->attrib.chunkSize));
+	}
+}
+
+
+void CycDataBuffer::updateMinReadPos(uint64_t _pos)
+{
+	int			i;
+	uint64_t	curReadPos;
+	uint64_t	curHeldEnd;
+	uint64_t	curSkipPos;
+	uint64_t	minPos;
+
+	minHeldPos = _pos;
+	minPos = _pos;
+	for (i=0; i<CIRC_BUF_MAX_CONSUMERS; i++)
+	{
+		if (consumers[i].active.loadAcquire())
+		{
+			curReadPos = consumers[i].readPos.loadAcquire();
+			curHeldEnd = consumers[i].heldEnd.loadAcquire();
+			curSkipPos = consumers[i].skipPos.loadAcquire();
+			minHeldPos = (curReadPos < minHeldPos) ? curReadPos : minHeldPos;
+
+			// The chunks a consumer was told to skip are free as soon as it
+			// holds nothing, even if it never fetches again
+			if (curReadPos == curHeldEnd && curSkipPos > curReadPos)
+			{
+				curReadPos = curSkipPos;
+			}
+			minPos = (curReadPos < minPos) ? curReadPos : minPos;
+		}
+	}
+
+	// Chunks held in the memory used before the last resize do not take any
+	// space in the current one
+	minReadPos = (minPos > ringStartPos) ? minPos : ringStartPos;
+}
+
+
+bool CycDataBuffer::hasSpace(uint64_t _pos, uint64_t _len)
+{
+	// Fast path - the cached position of the slowest consumer is far enough.
+	// Consumers only move forward, so the cached value is always safe.
+	if (_pos + _len - minReadPos <= bufSize)
+	{
+		return(true);
+	}
+
+	updateMinReadPos(_pos);
+	return(_pos + _len - minReadPos <= bufSize);
+}
+
+
+uint64_t CycDataBuffer::headroom()
+{
+	// With the OVERFLOW_SPILL policy some space is kept free for the headers
+	// of the spilled chunks. With OVERFLOW_DROP_OLDEST there is always space
+	// for a padding record in front of the chunks a consumer might hold, see
+	// reserveOldest().
+	switch (policy)
+	{
+	case OVERFLOW_SPILL:
+		return(spillHeadroom);
+
+	case OVERFLOW_DROP_OLDEST:
+		return(ALIGN_UP(sizeof(ChunkHeader)));
+
+	default:
+		return(0);
+	}
+}
+
+
+uint64_t CycDataBuffer::heldOverlap(uint64_t _pos, uint64_t _len)
+{
+	int			i;
+	uint64_t	curReadPos;
+	uint64_t	curHeldEnd;
+	uint64_t	lapEnd;
+	uint64_t	res = 0;
+
+	for (i=0; i<CIRC_BUF_MAX_CONSUMERS; i++)
+	{
+		if (!consumers[i].active.loadAcquire())
+		{
+			continue;
+		}
+
+		// The consumer publishes heldEnd before readPos, so reading them in
+		// the opposite order never makes the held range look smaller
+		curReadPos = consumers[i].readPos.loadAcquire();
+		curHeldEnd = consumers[i].heldEnd.loadAcquire();
+		curReadPos = (curReadPos > ringStartPos) ? curReadPos : ringStartPos;
+		if (curHeldEnd <= curReadPos)
+		{
+			continue;
+		}
+
+		// The held chunks occupy the same memory once every bufSize bytes;
+		// find the first copy that ends after _pos
+		lapEnd = curHeldEnd + ((_pos - curHeldEnd) / bufSize + 1) * bufSize;
+		if (_pos + _len > lapEnd - (curHeldEnd - curReadPos) && lapEnd > res)
+		{
+			res = lapEnd;
+		}
+	}
+
+	return(res);
+}
+
+
+void CycDataBuffer::skipOldest(uint64_t _end)
+{
+	// Only the producer modifies writePos, no need for synchronization here
+	uint64_t	pos = writePos.load();
+	uint64_t	newPos;
+	uint64_t	curSkipPos;
+	int			i;
+
+	for (i=0; i<CIRC_BUF_MAX_CONSUMERS; i++)
+	{
+		if (!consumers[i].active.loadAcquire())
+		{
+			continue;
+		}
+
+		// The chunks held by the consumer are taken care of by the caller.
+		// Skip as many chunks after them as needed to free the memory up to
+		// _end.
+		newPos = consumers[i].heldEnd.loadAcquire();
+		newPos = (newPos < ringStartPos) ? ringStartPos : newPos;
+		curSkipPos = consumers[i].skipPos.load();
+		newPos = (curSkipPos > newPos) ? curSkipPos : newPos;
+		while (newPos < pos && _end - newPos > bufSize)
+		{
+			newPos += chunkLen(newPos);
+		}
+
+		if (newPos > curSkipPos)
+		{
+			consumers[i].skipPos.fetchAndStoreOrdered(newPos);
+		}
+	}
+}
+
+
+bool CycDataBuffer::reserveOldest(uint64_t _pos, uint64_t _len)
+{
+	uint64_t	padLen = ALIGN_UP(sizeof(ChunkHeader));
+	uint64_t	start = _pos;
+	uint64_t	end;
+	ChunkHeader	header;
+
+	do
+	{
+		// A consumer that has stalled keeps holding its last chunks. Put the
+		// new chunk right after them instead of dropping it, the space in
+		// between is covered by a padding record that the consumers step
+		// over. The space for the next padding record stays free as well.
+		start = _pos;
+		while (start + _len - _pos <= bufSize && (end = heldOverlap(start, _len + padLen)))
+		{
+			start = end;
+		}
+
+		// The new chunk should not overwrite the padding record, and the
+		// padding record should not overwrite the held chunks either
+		if (start + _len - _pos > bufSize)
+		{
+			return(false);
+		}
+		if (start != _pos && (start - _pos < padLen || heldOverlap(_pos, padLen)))
+		{
+			return(false);
+		}
+
+		// Everything else the new chunk and the padding overwrite is
+		// skipped. A consumer might have taken some of those chunks in the
+		// meantime, see tryGetChunks(); then they are held and the place
+		// is looked for again.
+		skipOldest(start + _len + padLen);
+	}
+	while (heldOverlap(start, _len + padLen) || (start != _pos && heldOverlap(_pos, padLen)));
+
+	if (start != _pos)
+	{
+		memset(&header, 0, sizeof(header));
+		header.padLen = start - _pos;
+		memcpy(dataBuf + (_pos % bufSize), (unsigned char*)(&header), sizeof(ChunkHeader));
+
+		// Rewinding stops at the padding: the memory it covers belongs to
+		// other chunks
+		lastChunkLen = 0;
+		writePos.storeRelease(start);
+	}
+
+	reserveMode = RESERVE_RING;
+	reservedData = dataBuf + (start % bufSize) + sizeof(ChunkHeader);
+	return(true);
+}
+
+
+bool CycDataBuffer::reserveSpill(uint64_t _pos, int _maxSize)
+{
+	uint64_t len = ALIGN_UP(_maxSize);
+
+	// The header of a spilled chunk still goes to the main buffer
+	if (!spillBuf || !hasSpace(_pos, ALIGN_UP(sizeof(ChunkHeader))))
+	{
+		return(false);
+	}
+
+	// Reclaim the overflow area used by the chunks all the consumers have
+	// already passed
+	updateMinReadPos(_pos);
+	while (spillIndexTail < spillIndexHead && spillIndexRingPos[spillIndexTail % SPILL_INDEX_SIZE] < minHeldPos)
+	{
+		spillTailPos = spillIndexEnd[spillIndexTail % SPILL_INDEX_SIZE];
+		spillReclaimedPos = spillIndexRingPos[spillIndexTail % SPILL_INDEX_SIZE] + 1;
+		spillIndexTail++;
+	}
+
+	if (spillIndexHead - spillIndexTail >= SPILL_INDEX_SIZE || spillWritePos + len - spillTailPos > spillSize)
+	{
+		return(false);
+	}
+
+	reserveMode = RESERVE_SPILL;
+	reservedData = spillBuf + (spillWritePos % spillSize);
+	return(true);
+}
+
+
+void CycDataBuffer::dropChunk(int _chunkSize)
+{
+	// Only the producer modifies the counters
+	droppedChunks.storeRelease(droppedChunks.load() + 1);
+	droppedBytes.storeRelease(droppedBytes.load() + _chunkSize);
 }
 
 
 void CycDataBuffer::insertChunk(unsigned char* _data, ChunkAttrib _attrib)
 {
-    int            fixedStimFrameSz;
-    unsigned char* dataSrc;
+	unsigned char* dst;
+
+	checkResize();
+	checkRewind();
+
+	if(_attrib.chunkSize > getMaxChunkSize())
+	{
+		dropChunk(_attrib.chunkSize);
+		return;
+	}
+
+	dst = reserveChunk(_attrib.chunkSize);
+	if(reserveMode != RESERVE_DISCARD)
+	{
+		memcpy(dst, _data, _attrib.chunkSize);
+	}
+	commitChunk(_attrib);
+}
+
+
+unsigned char* CycDataBuffer::reserveChunk(int _maxSize)
+{
+	uint64_t		pos;
+	uint64_t		len;
+	struct timespec	startTime;
+	struct timespec	curTime;
+
+	checkResize();
+	checkRewind();
+
+	reservedSize = _maxSize;
 
-	// Check for buffer overflow. CIRC_BUF_MARG is the safety margin against
-	// race condition between consumer and producer threads when the buffer
-	// is close to full.
-	if (buffSemaphore->available() >=  bufSize * (1-CIRC_BUF_MARG))
+	// A chunk that can never fit is dropped on commit. This is the only case
+	// when the producer allocates memory; it should not happen if the buffer
+	// is sized for the largest chunk of the stream.
+	if(_maxSize > getMaxChunkSize())
 	{
-		cerr << "Circular buffer overflow!" << endl;
-		abort();
+		if(_maxSize > oversizeSize)
+		{
+			free(oversizeBuf);
+			oversizeBuf = (unsigned char*)malloc(_maxSize);
+			if(!oversizeBuf)
+			{
+				cerr << "Error allocating memory!" << endl;
+				abort();
+			}
+			oversizeSize = _maxSize;
+		}
+
+		reserveMode = RESERVE_DISCARD;
+		reservedData = oversizeBuf;
+		return(reservedData);
 	}
 
-	// Make sure that the safety margin is at least several (four) times the
-	// chunk size. This is necessary to prevent the race condition between
-	// consumer and producer threads when the buffer is close to full.
-	if(_attrib.chunkSize+sizeof(ChunkAttrib) > bufSize*MAX_CHUNK_SIZE)
+	// Only the producer modifies writePos, no need for synchronization here
+	pos = writePos.load();
+	len = ALIGN_UP(sizeof(ChunkHeader) + _maxSize);
+
+	// Normal case - make sure that we are not going to overwrite any data not
+	// yet released by some of the consumers
+	if (hasSpace(pos, len + headroom()))
+	{
+		reserveMode = RESERVE_RING;
+		reservedData = dataBuf + (pos % bufSize) + sizeof(ChunkHeader);
+		return(reservedData);
+	}
+
+	// Buffer overflow
+	switch (policy)
+	{
+	case OVERFLOW_BLOCK:
+		clock_gettime(CLOCK_MONOTONIC, &startTime);
+		do
+		{
+			QThread::usleep(CIRC_BUF_POLL_INTERVAL);
+			if (hasSpace(pos, len))
+			{
+				reserveMode = RESERVE_RING;
+				reservedData = dataBuf + (pos % bufSize) + sizeof(ChunkHeader);
+				return(reservedData);
+			}
+			clock_gettime(CLOCK_MONOTONIC, &curTime);
+		}
+		while ((curTime.tv_sec - startTime.tv_sec) * 1000 + (curTime.tv_nsec - startTime.tv_nsec) / 1000000 < blockTimeout);
+		break;
+
+	case OVERFLOW_DROP_OLDEST:
+		// The consumers skip their oldest chunks, only the chunks they hold
+		// are kept
+		if (reserveOldest(pos, len))
+		{
+			return(reservedData);
+		}
+		break;
+
+	case OVERFLOW_SPILL:
+		if (reserveSpill(pos, _maxSize))
+		{
+			return(reservedData);
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	// Nothing helped, the chunk will be dropped
+	reserveMode = RESERVE_DISCARD;
+	reservedData = discardBuf;
+	return(reservedData);
+}
+
+
+void CycDataBuffer::commitChunk(ChunkAttrib _attrib)
+{
+    int            fixedStimFrameSz;
+    unsigned char* fixedStimFrame;
+    ChunkHeader	   header;
+    uint64_t	   pos;
+    uint64_t	   len;
+
+	// A chunk larger than the reserved space is dropped as well, it does not
+	// fit where it was written
+	if(reserveMode == RESERVE_DISCARD || _attrib.chunkSize > reservedSize)
 	{
-		cerr << "The chunk size is too large!" << endl;
-		abort();
+		dropChunk(_attrib.chunkSize);
+		return;
 	}
 
-	// insert the data into the circular buffer
+	pos = writePos.load();
+
 	if(!ignoreIsRec)
 	{
 		_attrib.isRec = isRec;
@@ -88,73 +977,322 @@ void CycDataBuffer::insertChunk(unsigned char* _data, ChunkAttrib _attrib)
     if(fixedStimuli && isRec)
     {   // Check whether we might want to replace the frame with a frame from the fixedStimuli
 
-        dataSrc = fixedStimuli->findFrame(startRecTstamp, _attrib.timestamp, &fixedStimFrameSz);
-        if(dataSrc)
-        {
-            _attrib.chunkSize = fixedStimFrameSz;
-        }
-        else
+        fixedStimFrame = fixedStimuli->findFrame(startRecTstamp, _attrib.timestamp, &fixedStimFrameSz);
+        if(fixedStimFrame)
         {
-            dataSrc = _data;
+        	// The stimulus frame can be larger than the space reserved for
+        	// the original one
+        	if((fixedStimFrameSz <= reservedSize) ||
+        	   (reserveMode == RESERVE_RING && fixedStimFrameSz <= getMaxChunkSize() && hasSpace(pos, ALIGN_UP(sizeof(ChunkHeader) + fixedStimFrameSz) + headroom())))
+        	{
+                _attrib.chunkSize = fixedStimFrameSz;
+                memcpy(reservedData, fixedStimFrame, fixedStimFrameSz);
+        	}
+        	else
+        	{
+        		cerr << "No space for the fixed stimulus frame, keeping the original one" << endl;
+        	}
         }
     }
+
+    header.attrib = _attrib;
+    header.seq = seq++;
+    header.bytesBefore = bytesCommitted;
+    header.droppedChunks = droppedChunks.load();
+    header.droppedBytes = droppedBytes.load();
+    header.spillPos = spillWritePos;
+    header.padLen = 0;
+    header.isSpilled = (reserveMode == RESERVE_SPILL);
+    header.prevLen = lastChunkLen;
+    bytesCommitted += _attrib.chunkSize;
+
+    if(reserveMode == RESERVE_SPILL)
+    {
+    	spillWritePos += ALIGN_UP(_attrib.chunkSize);
+    	spillIndexRingPos[spillIndexHead % SPILL_INDEX_SIZE] = pos;
+    	spillIndexEnd[spillIndexHead % SPILL_INDEX_SIZE] = spillWritePos;
+    	spillIndexHead++;
+    	spilledChunks.storeRelease(spilledChunks.load() + 1);
+    	len = ALIGN_UP(sizeof(ChunkHeader));
+    }
     else
     {
-        dataSrc = _data;
+    	len = ALIGN_UP(sizeof(ChunkHeader) + _attrib.chunkSize);
     }
 
-	memcpy(dataBuf + insertPtr, (unsigned char*)(&_attrib), sizeof(ChunkAttrib));
-	insertPtr += sizeof(ChunkAttrib);
-	buffSemaphore->release(sizeof(ChunkAttrib));
+	memcpy(dataBuf + (pos % bufSize), (unsigned char*)(&header), sizeof(ChunkHeader));
+
+	lastChunkLen = len;
 
-    memcpy(dataBuf + insertPtr, dataSrc, _attrib.chunkSize);
-	buffSemaphore->release(_attrib.chunkSize);
+	// Publish the chunk to the consumers
+	writePos.storeRelease(pos + len);
+}
 
-    emit chunkReady(dataBuf + insertPtr);
 
-	insertPtr += _attrib.chunkSize;
-	if(insertPtr >= bufSize)
+int CycDataBuffer::registerConsumer()
+{
+	int			i;
+	QMutexLocker locker(&registerMutex);
+
+	for (i=0; i<CIRC_BUF_MAX_CONSUMERS; i++)
 	{
-		insertPtr = 0;
+		if (!consumers[i].active.load())
+		{
+			consumers[i].hasPrev = false;
+			consumers[i].heldEnd.store(writePos.loadAcquire());
+			consumers[i].readPos.store(consumers[i].heldEnd.load());
+			consumers[i].skipPos.store(0);
+			consumers[i].active.storeRelease(1);
+			return(i);
+		}
 	}
+
+	cerr << "Too many consumers for a circular buffer!" << endl;
+	abort();
+}
+
+
+void CycDataBuffer::unregisterConsumer(int _consumerId)
+{
+	consumers[_consumerId].active.storeRelease(0);
 }
 
 
-unsigned char* CycDataBuffer::getChunk(ChunkAttrib* _attrib)
+unsigned char* CycDataBuffer::getChunk(int _consumerId, ChunkAttrib* _attrib, ChunkGap* _gap)
 {
-	unsigned char* res;
+	ChunkRef chunk;
+
+	getChunks(_consumerId, &chunk, 1, 0);
+
+	*_attrib = chunk.attrib;
+	if (_gap)
+	{
+		*_gap = chunk.gap;
+	}
+
+	return(chunk.data);
+}
 
-	buffSemaphore->acquire(sizeof(ChunkAttrib));
-	memcpy((unsigned char*)_attrib, dataBuf + getPtr, sizeof(ChunkAttrib));
-	getPtr += sizeof(ChunkAttrib);
 
-	buffSemaphore->acquire(_attrib->chunkSize);
-	res = dataBuf + getPtr;
+unsigned char* CycDataBuffer::tryGetChunk(int _consumerId, ChunkAttrib* _attrib, ChunkGap* _gap)
+{
+	ChunkRef chunk;
+
+	if (!tryGetChunks(_consumerId, &chunk, 1, 0))
+	{
+		return(NULL);
+	}
+
+	*_attrib = chunk.attrib;
+	if (_gap)
+	{
+		*_gap = chunk.gap;
+	}
+
+	return(chunk.data);
+}
+
+
+int CycDataBuffer::getChunks(int _consumerId, ChunkRef* _chunks, int _maxCount, uint64_t _maxBytes)
+{
+	int res;
 
-	getPtr += _attrib->chunkSize;
-	if(getPtr >= bufSize)
+	while (!(res = tryGetChunks(_consumerId, _chunks, _maxCount, _maxBytes)))
 	{
-		getPtr = 0;
+		QThread::usleep(CIRC_BUF_POLL_INTERVAL);
 	}
 
 	return(res);
 }
 
 
-void CycDataBuffer::setIsRec(bool _isRec)
+int CycDataBuffer::tryGetChunks(int _consumerId, ChunkRef* _chunks, int _maxCount, uint64_t _maxBytes)
 {
-    struct timespec	timestamp;
+	ConsumerCursor*	cursor = &(consumers[_consumerId]);
+	ChunkHeader*	header;
+	uint64_t		heldEnd;
+	uint64_t		startPos;
+	uint64_t		pos;
+	uint64_t		endPos;
+	uint64_t		skipPos;
+	uint64_t		bytes;
+	int				n;
+	int				i;
 
-	isRec = _isRec;
+	heldEnd = cursor->heldEnd.load();
+	skipPos = cursor->skipPos.loadAcquire();
+
+	do
+	{
+		// Skip the chunks the producer has given up on
+		startPos = (skipPos > heldEnd) ? skipPos : heldEnd;
+
+		endPos = writePos.loadAcquire();
+		if (startPos >= endPos)
+		{
+			return(0);
+		}
+
+		// The chunks are consecutive in the buffer, so the whole batch can be
+		// held by a single cursor. The first chunk is always returned, even
+		// if it is larger than _maxBytes.
+		pos = startPos;
+		bytes = 0;
+		n = 0;
+		while (n<_maxCount && pos<endPos)
+		{
+			header = (ChunkHeader*)(dataBuf + (pos % bufSize));
+
+			// Step over the padding left by reserveOldest(). It only starts
+			// a batch, so that the held chunks never include it.
+			if (header->padLen)
+			{
+				if (n)
+				{
+					break;
+				}
+				pos += header->padLen;
+				startPos = pos;
+				continue;
+			}
+
+			if (n && _maxBytes && bytes + header->attrib.chunkSize > _maxBytes)
+			{
+				break;
+			}
+
+			bytes += header->attrib.chunkSize;
+			pos += chunkLen(pos);
+			n++;
+		}
+
+		if (!n)
+		{
+			return(0);
+		}
+
+		// Release the previously held chunks and hold the new ones. heldEnd
+		// goes first, see heldOverlap().
+		cursor->heldEnd.storeRelease(pos);
+		cursor->readPos.storeRelease(startPos);
+
+		// Under OVERFLOW_DROP_OLDEST the producer might have skipped the
+		// chunks while they were being looked at. The read-modify-write
+		// orders this check with the producer's update of skipPos: either
+		// the producer sees the chunks held or they are looked at again.
+		skipPos = cursor->skipPos.fetchAndAddOrdered(0);
+	}
+	while (skipPos > startPos);
+
+	pos = startPos;
+	for (i=0; i<n; i++)
+	{
+		header = (ChunkHeader*)(dataBuf + (pos % bufSize));
+
+		_chunks[i].attrib = header->attrib;
+		_chunks[i].data = header->isSpilled ? spillBuf + (header->spillPos % spillSize) : (unsigned char*)header + sizeof(ChunkHeader);
+
+		// Compute the amount of data lost since the previous chunk. It
+		// includes both the chunks dropped on insertion and the chunks
+		// skipped by this consumer.
+		if (cursor->hasPrev)
+		{
+			_chunks[i].gap.droppedChunks = (header->seq - cursor->prevSeq - 1) + (header->droppedChunks - cursor->prevDroppedChunks);
+			_chunks[i].gap.droppedBytes = (header->bytesBefore - cursor->prevBytesAfter) + (header->droppedBytes - cursor->prevDroppedBytes);
+		}
+		else
+		{
+			_chunks[i].gap.droppedChunks = 0;
+			_chunks[i].gap.droppedBytes = 0;
+		}
+
+		cursor->hasPrev = true;
+		cursor->prevSeq = header->seq;
+		cursor->prevBytesAfter = header->bytesBefore + header->attrib.chunkSize;
+		cursor->prevDroppedChunks = header->droppedChunks;
+		cursor->prevDroppedBytes = header->droppedBytes;
+
+		pos += chunkLen(pos);
+	}
+
+	return(n);
+}
+
+
+bool CycDataBuffer::rewind(int _consumerId, uint64_t _timestamp)
+{
+	ConsumerCursor*	cursor = &(consumers[_consumerId]);
+	int				state;
+	int				i;
+
+	// The cursor is moved by the producer, which knows what data is still
+	// intact
+	cursor->rewindTstamp = _timestamp;
+	cursor->rewindState.storeRelease(REWIND_REQUESTED);
+	rewindRequests.fetchAndAddOrdered(1);
+
+	for (i=0; i<CIRC_BUF_REWIND_TIMEOUT*1000/CIRC_BUF_POLL_INTERVAL; i++)
+	{
+		state = cursor->rewindState.loadAcquire();
+		if (state == REWIND_MOVED || state == REWIND_NOT_MOVED)
+		{
+			break;
+		}
+		QThread::usleep(CIRC_BUF_POLL_INTERVAL);
+	}
+
+	// Withdraw the request if the producer has not picked it up
+	if (cursor->rewindState.testAndSetOrdered(REWIND_REQUESTED, REWIND_NONE))
+	{
+		rewindRequests.fetchAndAddOrdered(-1);
+		return(false);
+	}
+
+	// The producer is serving the request right now
+	while ((state = cursor->rewindState.loadAcquire()) == REWIND_SERVING)
+	{
+		QThread::usleep(CIRC_BUF_POLL_INTERVAL);
+	}
+	cursor->rewindState.store(REWIND_NONE);
+
+	if (state != REWIND_MOVED)
+	{
+		return(false);
+	}
+
+	// Start over from the new position
+	cursor->hasPrev = false;
+	return(true);
+}
+
+
+void CycDataBuffer::setIsRec(bool _isRec, uint64_t _startRecTstamp)
+{
+    struct timespec	timestamp;
 
     // TODO: The code below does not properly protect startRecTstamp against
     // muti-theaded access
 
-    if (isRec)
+    if (_isRec)
     {
-        clock_gettime(CLOCK_REALTIME, &timestamp);
+    	if (_startRecTstamp)
+    	{
+    		startRecTstamp = _startRecTstamp;
+    	}
+    	else
+    	{
+    		clock_gettime(CLOCK_REALTIME, &timestamp);
 
-        startRecTstamp = timestamp.tv_nsec / 1000000;
-        startRecTstamp += timestamp.tv_sec * 1000;
+    		startRecTstamp = timestamp.tv_nsec / 1000000;
+    		startRecTstamp += timestamp.tv_sec * 1000;
+    	}
     }
+
+	isRec = _isRec;
+}
+
+
+uint64_t CycDataBuffer::getStartRecTstamp()
+{
+	return(isRec ? startRecTstamp : 0);
 }
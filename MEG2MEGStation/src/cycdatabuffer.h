@@ -22,9 +22,12 @@
 #define CYCDATABUFFER_H_
 
 #include <stdint.h>
-#include <QObject>
-#include <QSemaphore>
+#include <time.h>
+#include <QMutex>
+#include <QAtomicInteger>
+#include <QAtomicPointer>
 
+#include "config.h"
 #include "fixedstimuli.h"
 
 //! Attributes associated with each data chunk.
@@ -33,73 +36,394 @@ typedef struct
 	int			chunkSize;
 	uint64_t	timestamp;
 	uint64_t	id;
+	uint64_t	rawTstamp;		// Captured audio only, 0 otherwise (also for
+	uint64_t	fitTstamp;		// received audio): capture time of the first
+								// frame in microseconds, as observed and as
+								// fitted by SampleClock
 	bool		isRec;
 } ChunkAttrib;
 
 
+//! Description of the data lost immediately before a chunk.
+typedef struct
+{
+	uint64_t	droppedChunks;
+	uint64_t	droppedBytes;
+} ChunkGap;
+
+
+//! A chunk returned by CycDataBuffer::getChunks().
+typedef struct
+{
+	unsigned char*	data;
+	ChunkAttrib		attrib;
+	ChunkGap		gap;			// data lost immediately before the chunk
+} ChunkRef;
+
+
+//! Expected data rate of a stream, used for choosing the buffer size.
+typedef struct
+{
+	double		bytesPerSec;
+	double		chunksPerSec;
+	double		history;		// seconds of data the buffer should hold
+	int			largestChunk;	// largest chunk the producer reserves or inserts
+} StreamRate;
+
+
+//! What the producer does when there is no space for a new chunk.
+enum OverflowPolicy
+{
+	OVERFLOW_BLOCK = 1,			// wait for the consumers, drop the new chunk on timeout
+	OVERFLOW_DROP_NEWEST = 2,	// drop the new chunk
+	OVERFLOW_DROP_OLDEST = 3,	// make the lagging consumers skip their oldest chunks
+	OVERFLOW_SPILL = 4			// store the new chunk in a disk-backed overflow area
+};
+
+
+//! Kind of memory pages backing the buffer.
+enum HugePages
+{
+	HUGE_PAGES_NONE = 1,		// normal pages
+	HUGE_PAGES_TRANSPARENT = 2,	// normal pages, advised for transparent huge pages
+	HUGE_PAGES_HUGETLB = 3		// explicit huge pages, normal pages if none are available
+};
+
+
 //! Cyclic buffer capable of holding data chunks of variable size.
 /*!
- * Cyclic buffer for synchronizing producer/consumer threads. Supports single
- * producer, single primary consumer and multiple secondary consumers. Producer
- * and primary consumer access the buffer through insertChunk() and getChunk()
- * respectively. No additional synchronization between the producer and the
- * primary consumer is needed - the buffer takes care of it.
+ * Lock-free cyclic buffer for synchronizing producer/consumer threads.
+ * Supports single producer and multiple consumers. The producer inserts the
+ * data either by copying it with insertChunk() or by writing it in place
+ * between reserveChunk() and commitChunk() calls. Each consumer first obtains
+ * its own read cursor through registerConsumer() and then fetches the chunks
+ * one by one, in the order they were inserted, through getChunk() or
+ * tryGetChunk(). A chunk returned to a consumer stays valid until the same
+ * consumer fetches the next one. getChunks() and tryGetChunks() fetch all the
+ * available chunks in one go.
+ *
+ * The producer keeps track of the slowest consumer and never overwrites data
+ * that some consumer has not released yet. The producer side takes no locks
+ * and makes no system calls, so it is safe to use from real-time threads. A
+ * consumer waiting for data polls the buffer every CIRC_BUF_POLL_INTERVAL
+ * microseconds.
  *
- * Secondary consumers are only notified of every new chunk inserted trough
- * chunkReady() signal. The buffer provides no hard guaranty that the data will
- * not be overwritten before secondary consumers access it, but if the buffer
- * is large enough in comparison to the chunk insertion rate, the secondary
- * consumers are fast enough and the are general system load is low enough,
- * this should not typically happen.
+ * If the buffer is full, the producer acts according to the overflow policy
+ * set by setOverflowPolicy() (OVERFLOW_DROP_NEWEST by default). Whatever the
+ * policy, the data is never silently lost: the buffer counts dropped chunks
+ * and bytes, and every consumer gets a ChunkGap describing the data it missed
+ * right before each chunk.
  *
- * Neither primary nor secondary consumers should modify the content of the
- * data chunks.
+ * Consumers that should not block a thread of their own (network sending,
+ * display, indicators) are served by a ConsumerDispatcher.
  *
- * The class assumes that in general the primary consumer is considerably
- * faster than the producer, so that buffer is nearly empty most of the time.
+ * Consumers should not modify the content of the data chunks.
  */
-class CycDataBuffer : public QObject
+class CycDataBuffer
 {
-	Q_OBJECT
-
 public:
 	/*!
-	 * Buffer size is in bytes. Due to implementation details (semaphore counts
-	 * bytes rather than chunks) buffer size is limited by the size of "int" on
-	 * your platform. If _ignoreIsRec is true, does not change the isRec field
-	 * of the ChunkAttrib, otherwise sets them according to the buffer's state
-	 * set by setIsRec.
+	 * Buffer size is in bytes; it is rounded up to the page size. If
+	 * _ignoreIsRec is true, does not change the isRec field of the
+	 * ChunkAttrib, otherwise sets them according to the buffer's state set by
+	 * setIsRec.
+	 *
+	 * The memory is mapped twice back-to-back in the virtual address space,
+	 * so that chunks crossing the end of the buffer are contiguous. It is
+	 * backed by the _hugePages kind of pages and, if _lockMemory is true,
+	 * locked in memory; the same applies to the memory allocated by resize().
 	 */
-    CycDataBuffer(int _bufSize, bool _ignoreIsRec, FixedStimuli* _fixedStimuli=NULL);
+    CycDataBuffer(uint64_t _bufSize, bool _ignoreIsRec, FixedStimuli* _fixedStimuli=NULL, HugePages _hugePages=HUGE_PAGES_NONE, bool _lockMemory=false);
 	virtual ~CycDataBuffer();
+
+	/*!
+	 * Set the overflow policy. _blockTimeout (in milliseconds) is only used
+	 * by OVERFLOW_BLOCK. _spillDir and _spillSize (in bytes) are only used by
+	 * OVERFLOW_SPILL; the overflow area is an unlinked temporary file in the
+	 * _spillDir folder. Should be called before the producer starts.
+	 */
+	void setOverflowPolicy(OverflowPolicy _policy, int _blockTimeout=0, const char* _spillDir=NULL, uint64_t _spillSize=0);
+	OverflowPolicy getOverflowPolicy();
+
+	/*!
+	 * Parse policy name ("block", "drop_newest", "drop_oldest" or "spill").
+	 * A producer that must not wait (_realtime: a capture thread or the GUI
+	 * thread receiving the network streams) gets drop_newest instead of
+	 * block, so that the loss shows up as gaps rather than as overruns.
+	 */
+	static OverflowPolicy parseOverflowPolicy(const char* _name, bool _realtime=false);
+
+	//! Parse the kind of pages ("none", "transparent" or "hugetlb").
+	static HugePages parseHugePages(const char* _name);
+
+	//! Insert a copy of the chunk. Chunks that are too large are dropped.
 	void insertChunk(unsigned char* _data, ChunkAttrib _attrib);
 
 	/*!
-	 * Acquire a chunk and return a pointer to it. The chunk is implicitly
-	 * released next time getChunk is called.
+	 * Reserve space for a chunk of at most _maxSize bytes and return a
+	 * pointer to it. The producer should write the chunk's data directly to
+	 * that location and then call commitChunk(). Only one chunk can be
+	 * reserved at a time. The returned pointer is always valid; if the chunk
+	 * has to be dropped, it points to a scratch area. That includes the
+	 * chunks larger than getMaxChunkSize(), for which the scratch area is
+	 * allocated on demand.
+	 */
+	unsigned char* reserveChunk(int _maxSize);
+
+	/*!
+	 * Make the chunk reserved by reserveChunk() available to the consumers.
+	 * _attrib.chunkSize is the actual size of the chunk. A chunk larger than
+	 * the reserved size is dropped.
+	 */
+	void commitChunk(ChunkAttrib _attrib);
+
+	//! Largest chunk (in bytes) the buffer can hold.
+	int getMaxChunkSize();
+
+	/*!
+	 * Largest _maxSize the next reserveChunk() call accepts. Switches to the
+	 * resized memory first if that is due, so the value does not change
+	 * before that call. Should only be called by the producer.
 	 */
-	unsigned char* getChunk(ChunkAttrib* _attrib);
-	void setIsRec(bool _isRec);
+	int getReservableSize();
 
-signals:
 	/*!
-	 * This signal is raised when a new chunk of data has been copied to the
-	 * buffer. _data points to the chunk's data. The corresponding ChunkAttrib
-	 * structure is placed immediately before _data.
+	 * Buffer size needed to hold the history of a stream with the given
+	 * data rate. The result is never too small for the largest chunk.
 	 */
-    void chunkReady(unsigned char* _data);
+	static uint64_t sizeForRate(StreamRate _rate);
+
+	/*!
+	 * Change the buffer size. The new memory is allocated right away, but
+	 * the producer only switches to it once all the consumers have read all
+	 * the data, so no data is lost. Supposed to be called between the
+	 * recordings from the thread that created the buffer. The buffer should
+	 * stay large enough for the largest chunk the producer reserves.
+	 */
+	void resize(uint64_t _bufSize);
+
+	/*!
+	 * Resize the buffer according to the data rate observed since the
+	 * previous call (or since the buffer creation). If there was no data,
+	 * use the expected rate _rate.
+	 */
+	void resizeForRate(StreamRate _rate);
+
+	//! Total number of chunks dropped or spilled so far.
+	uint64_t getDroppedChunks();
+	uint64_t getDroppedBytes();
+	uint64_t getSpilledChunks();
+
+	/*!
+	 * Register a new consumer and return its id. The consumer will receive
+	 * all the chunks inserted after this call. Consumers should be
+	 * registered before the producer starts inserting the data.
+	 */
+	int registerConsumer();
+
+	/*!
+	 * Release the consumer's cursor. After this call the producer no longer
+	 * waits for the consumer.
+	 */
+	void unregisterConsumer(int _consumerId);
+
+	/*!
+	 * Acquire the next chunk for the given consumer and return a pointer to
+	 * it. Block until the chunk is available. The chunk is implicitly
+	 * released when the consumer acquires the next one. If _gap is not NULL,
+	 * it receives the description of the data this consumer lost since the
+	 * previous chunk.
+	 */
+	unsigned char* getChunk(int _consumerId, ChunkAttrib* _attrib, ChunkGap* _gap=NULL);
+
+	/*!
+	 * Same as getChunk(), but return NULL immediately if no new chunk is
+	 * available. In that case the previously acquired chunk is not released.
+	 */
+	unsigned char* tryGetChunk(int _consumerId, ChunkAttrib* _attrib, ChunkGap* _gap=NULL);
+
+	/*!
+	 * Acquire all the chunks available to the consumer at once, but at most
+	 * _maxCount chunks and _maxBytes bytes of data (0 means no limit; the
+	 * first chunk is returned whatever its size). Return the number of
+	 * chunks stored in _chunks. Block until at least one chunk is available.
+	 * All the chunks stay valid until the consumer acquires the next ones.
+	 */
+	int getChunks(int _consumerId, ChunkRef* _chunks, int _maxCount, uint64_t _maxBytes=0);
+
+	//! Same as getChunks(), but return 0 immediately if no chunk is available.
+	int tryGetChunks(int _consumerId, ChunkRef* _chunks, int _maxCount, uint64_t _maxBytes=0);
+
+	/*!
+	 * Move the consumer's cursor back to the oldest chunk still available in
+	 * the buffer whose timestamp is not earlier than _timestamp. The next
+	 * getChunk() returns that chunk, the chunk held by the consumer is
+	 * released. Chunks older than the currently held one are never skipped
+	 * by this call. Waits until the producer inserts the next chunk; returns
+	 * false if the cursor could not be moved back within
+	 * CIRC_BUF_REWIND_TIMEOUT.
+	 */
+	bool rewind(int _consumerId, uint64_t _timestamp);
+
+	/*!
+	 * Set the recording state of the buffer. _startRecTstamp is the start of
+	 * the recording in milliseconds (as in ChunkAttrib::timestamp); if it is
+	 * 0, the current time is used. Pass the same value to all the buffers to
+	 * have the streams aligned.
+	 */
+	void setIsRec(bool _isRec, uint64_t _startRecTstamp=0);
+
+	//! Start of the current recording, 0 if the buffer is not recording.
+	uint64_t getStartRecTstamp();
 
 private:
+	// Header stored in front of every chunk. The counters are cumulative
+	// since the creation of the buffer, so that any consumer can compute the
+	// amount of data lost between two consecutive chunks it has read.
+	typedef struct
+	{
+		ChunkAttrib	attrib;
+		uint64_t	seq;			// number of chunks committed before this one
+		uint64_t	bytesBefore;	// payload bytes committed before this one
+		uint64_t	droppedChunks;	// chunks dropped on insertion before this one
+		uint64_t	droppedBytes;
+		uint64_t	spillPos;		// position of the payload in the overflow area
+		uint64_t	padLen;			// non-zero for a padding record, see reserveOldest()
+		uint32_t	isSpilled;
+		uint32_t	prevLen;		// space taken by the previous chunk, 0 if none
+	} ChunkHeader;
+
+	// Read cursor of a single consumer. Positions are byte offsets counted
+	// from the creation of the buffer and never wrap. Padded to keep the
+	// consumers from sharing cache lines.
+	typedef struct
+	{
+		QAtomicInteger<quint64>	readPos;	// start of the chunks held by the consumer
+		QAtomicInteger<quint64>	heldEnd;	// end of the chunks held by the consumer
+		QAtomicInteger<quint64>	skipPos;	// set by the producer under OVERFLOW_DROP_OLDEST
+		QAtomicInt				active;
+		QAtomicInt				rewindState;
+		uint64_t				rewindTstamp;
+
+		// Only accessed by the consumer's thread
+		bool					hasPrev;
+		uint64_t				prevSeq;
+		uint64_t				prevBytesAfter;
+		uint64_t				prevDroppedChunks;
+		uint64_t				prevDroppedBytes;
+
+		char					padding[64];
+	} ConsumerCursor;
+
+	// Memory holding the chunks. Replaced as a whole when the buffer is
+	// resized.
+	typedef struct
+	{
+		unsigned char*	data;
+		unsigned char*	discard;		// scratch area for dropped chunks
+		uint64_t		size;
+		int				maxChunkSize;
+		uint64_t		endPos;			// position where the producer stopped using it
+	} RingMapping;
+
+	// State of a consumer's rewind request
+	enum RewindState
+	{
+		REWIND_NONE,
+		REWIND_REQUESTED,
+		REWIND_SERVING,
+		REWIND_MOVED,
+		REWIND_NOT_MOVED
+	};
+
+	// Where the reserved chunk lives
+	enum ReserveMode
+	{
+		RESERVE_RING,
+		RESERVE_SPILL,
+		RESERVE_DISCARD
+	};
+
+	static RingMapping* allocRing(uint64_t _bufSize, HugePages _hugePages, bool _lockMemory);
+	static void freeRing(RingMapping* _ring);
+	void useRing(RingMapping* _ring);
+	void releaseRetiredRing();
+	bool consumersCaughtUp(uint64_t _pos);
+	void checkResize();
+	void checkRewind();
+	double measureDataRate();
+	uint64_t chunkLen(uint64_t _pos);
+	void updateMinReadPos(uint64_t _pos);
+	bool hasSpace(uint64_t _pos, uint64_t _len);
+	uint64_t headroom();
+	uint64_t heldOverlap(uint64_t _pos, uint64_t _len);
+	void skipOldest(uint64_t _end);
+	bool reserveOldest(uint64_t _pos, uint64_t _len);
+	bool reserveSpill(uint64_t _pos, int _maxSize);
+	void dropChunk(int _chunkSize);
+
     volatile bool	  isRec;
     volatile uint64_t startRecTstamp;
 
-    QSemaphore*		  buffSemaphore;	// counts number of bytes available for reading
     unsigned char*	  dataBuf;
+    unsigned char*	  discardBuf;			// scratch area for dropped chunks
+    unsigned char*	  oversizeBuf;			// same, for chunks that never fit
+    int				  oversizeSize;
     FixedStimuli*     fixedStimuli;
 
-    int				  insertPtr;
-    int				  getPtr;
-    int				  bufSize;
+    QAtomicInteger<quint64>	writePos;		// end of the last inserted chunk
+    uint64_t		  minReadPos;			// cached position of the slowest consumer
+    uint64_t		  minHeldPos;			// same, including the chunks in retiredRing
+    ConsumerCursor	  consumers[CIRC_BUF_MAX_CONSUMERS];
+    QMutex			  registerMutex;		// serializes registerConsumer() calls
+
+    // State of the current reservation
+    ReserveMode		  reserveMode;
+    unsigned char*	  reservedData;
+    int				  reservedSize;
+
+    // Overflow handling
+    OverflowPolicy	  policy;
+    int				  blockTimeout;
+    uint64_t		  seq;
+    uint64_t		  bytesCommitted;
+    QAtomicInteger<quint64>	droppedChunks;
+    QAtomicInteger<quint64>	droppedBytes;
+    QAtomicInteger<quint64>	spilledChunks;
+
+    // Disk-backed overflow area. Works as a second cyclic buffer holding only
+    // the payloads; the headers always stay in the main buffer. spillIndex
+    // remembers where each spilled chunk's header is, so that the space can
+    // be reclaimed once all the consumers have passed it.
+    unsigned char*	  spillBuf;
+    uint64_t		  spillSize;
+    uint64_t		  spillWritePos;
+    uint64_t		  spillTailPos;
+    uint64_t		  spillIndexRingPos[SPILL_INDEX_SIZE];
+    uint64_t		  spillIndexEnd[SPILL_INDEX_SIZE];
+    uint64_t		  spillIndexHead;
+    uint64_t		  spillIndexTail;
+    uint64_t		  spillHeadroom;
+    uint64_t		  spillReclaimedPos;	// chunks before it may have lost the payload
+
+    // Rewinding
+    QAtomicInt		  rewindRequests;
+    uint64_t		  lastChunkLen;
+
+    // Resizing. The control thread puts the new memory to pendingRing, the
+    // producer moves the memory it stops using to retiredRing, and the
+    // control thread frees it once no consumer holds a chunk there.
+    RingMapping*	  curRing;
+    QAtomicPointer<RingMapping> pendingRing;
+    QAtomicPointer<RingMapping> retiredRing;
+    uint64_t		  ringStartPos;			// first position in the current memory
+    struct timespec	  rateStartTime;
+    uint64_t		  rateStartBytes;
+    HugePages		  hugePages;
+    bool			  lockMemory;
+
+    uint64_t		  bufSize;
+    int				  maxChunkSize;
     bool			  ignoreIsRec;
 };
 
@@ -0,0 +1,94 @@
+/*
+ * datarates.cpp
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include "config.h"
+#include "settings.h"
+#include "datarates.h"
+#include "audioformat.h"
+#include "pixelformat.h"
+
+using namespace std;
+
+
+DataRates::DataRates()
+{
+	Settings	settings;
+	VideoFormat	videoFormat;
+	double		periodsPerSec;
+
+	videoFormat.width = settings.videoWidth;
+	videoFormat.height = settings.videoHeight;
+	videoFormat.fps = settings.fps;
+
+	// Uncompressed frames from the camera
+	rawVideo.chunksPerSec = videoFormat.fps;
+	rawVideo.largestChunk = pixelFormatFrameSize(parsePixelFormat(settings.color, settings.colorFormat), videoFormat.width, videoFormat.height);
+	rawVideo.bytesPerSec = double(rawVideo.largestChunk) * videoFormat.fps;
+	rawVideo.history = settings.rawVideoBufHistory;
+
+	// Compressed frames. The compressed size mostly depends on the quality
+	// setting; the numbers below err on the large side for typical scenes.
+	jpegBitsPerPixel = (0.5 + 0.03 * settings.jpgQuality) * (settings.color ? 1 : 0.6);
+	jpegVideo = jpegRate(videoFormat);
+	jpegVideo.history = settings.bufHistory + settings.preRoll;
+
+	receiverVideo = jpegVideo;
+
+	// Audio comes in periods of framesPerPeriod frames
+	periodsPerSec = double(settings.sampRate) / settings.framesPerPeriod;
+
+	senderAudio.chunksPerSec = periodsPerSec;
+	senderAudio.largestChunk = settings.framesPerPeriod * AudioFormat(AudioFormat::parseSampleFormat(settings.sampleFormat), settings.nSenderChans).getFrameSize();
+	senderAudio.bytesPerSec = senderAudio.largestChunk * periodsPerSec;
+	senderAudio.history = settings.bufHistory + settings.preRoll;
+
+	receiverAudio.chunksPerSec = periodsPerSec;
+	receiverAudio.largestChunk = MAX_DATAGRAM_SIZE;
+	receiverAudio.bytesPerSec = settings.framesPerPeriod * N_CHANS_NET * sizeof(NET_AUDIO_TYPE) * periodsPerSec;
+	receiverAudio.history = settings.bufHistory + settings.preRoll;
+}
+
+
+void DataRates::setReceiverVideoFormat(VideoFormat _format)
+{
+	double	history = receiverVideo.history;
+
+	// The remote station is assumed to use the same quality setting
+	receiverVideo = jpegRate(_format);
+	receiverVideo.history = history;
+}
+
+
+StreamRate DataRates::jpegRate(VideoFormat _format)
+{
+	StreamRate	res;
+
+	res.chunksPerSec = _format.fps;
+	res.bytesPerSec = double(_format.width) * _format.height * jpegBitsPerPixel / 8 * _format.fps;
+
+	// JPEG_BUF_SIZE is only reached by noise at the highest quality; sizing
+	// the buffers for it would take hundreds of megabytes for large frames
+	res.largestChunk = int(min(res.bytesPerSec / _format.fps * JPEG_PEAK_RATIO + 2048, double(JPEG_BUF_SIZE(_format.width, _format.height))));
+	res.history = 0;
+
+	return(res);
+}
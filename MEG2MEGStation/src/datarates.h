@@ -0,0 +1,56 @@
+/*
+ * datarates.h
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DATARATES_H_
+#define DATARATES_H_
+
+#include "cycdatabuffer.h"
+#include "pixelformat.h"
+
+//! Expected data rates of the streams going through the circular buffers.
+/*!
+ * The rates are derived from the application settings. To get them simply
+ * create the instance of this class and read the values from the
+ * corresponding public variables of the class. The compressed video rate is
+ * a rough upper estimate; the buffers are corrected according to the
+ * observed rates between the recordings (see CycDataBuffer::resizeForRate()).
+ * The remote station is assumed to use the same video settings until its
+ * video format is known, see setReceiverVideoFormat().
+ */
+class DataRates {
+public:
+	DataRates();
+
+	//! The video format of the remote station; updates receiverVideo.
+	void setReceiverVideoFormat(VideoFormat _format);
+
+	StreamRate	rawVideo;		// camera -> compressor
+	StreamRate	jpegVideo;		// compressor -> file writer, network, display
+	StreamRate	receiverVideo;	// network -> file writer, display
+	StreamRate	senderAudio;	// microphone -> file writer, network
+	StreamRate	receiverAudio;	// network -> file writer
+
+private:
+	double		jpegBitsPerPixel;
+
+	StreamRate jpegRate(VideoFormat _format);
+};
+
+#endif /* DATARATES_H_ */
@@ -0,0 +1,225 @@
+/*
+ * demosaic.cpp
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "demosaic.h"
+
+using namespace std;
+
+// Each pixel gets the averages of its neighbors of the missing colors. The
+// averages are computed exactly like _mm_avg_epu8() (rounding up, pairwise),
+// so the SIMD and the scalar code give identical results. Outside the frame
+// the mosaic is mirrored about the edge pixels, which keeps the color
+// pattern.
+
+DemosaicMethod parseDemosaicMethod(const char* _name)
+{
+	if(!strcmp(_name, "bilinear"))
+	{
+		return(DEMOSAIC_BILINEAR);
+	}
+	else if(!strcmp(_name, "edge"))
+	{
+		return(DEMOSAIC_EDGE);
+	}
+
+	cerr << "Invalid demosaic method: " << _name << ", should be bilinear or edge" << endl;
+	abort();
+}
+
+
+static inline unsigned char avg(unsigned char _a, unsigned char _b)
+{
+	return((_a + _b + 1) >> 1);
+}
+
+
+/*!
+ * Demosaic pixel _x of row _cur, with the rows _up and _down above and
+ * below it. _isSite tells whether the pixel is a red or blue sample;
+ * _isRedRow whether the row holds red samples (otherwise blue ones).
+ */
+template<bool EDGE>
+static inline void demosaicPixel(const unsigned char* _up, const unsigned char* _cur, const unsigned char* _down, int _x, int _width,
+                                 bool _isSite, bool _isRedRow, unsigned char* _dst)
+{
+	int				xl = (_x > 0) ? _x - 1 : 1;
+	int				xr = (_x < _width - 1) ? _x + 1 : _width - 2;
+	unsigned char	h = avg(_cur[xl], _cur[xr]);
+	unsigned char	v = avg(_up[_x], _down[_x]);
+	unsigned char	g;
+	unsigned char	a;			// color of the row's samples
+	unsigned char	o;			// the other one
+	int				dh;
+	int				dv;
+
+	if(_isSite)
+	{
+		g = avg(h, v);
+		if(EDGE)
+		{
+			dh = abs(_cur[xl] - _cur[xr]);
+			dv = abs(_up[_x] - _down[_x]);
+			g = (dh < dv) ? h : ((dv < dh) ? v : g);
+		}
+		a = _cur[_x];
+		o = avg(avg(_up[xl], _up[xr]), avg(_down[xl], _down[xr]));
+	}
+	else
+	{
+		g = _cur[_x];
+		a = h;
+		o = v;
+	}
+
+	_dst[0] = _isRedRow ? a : o;
+	_dst[1] = g;
+	_dst[2] = _isRedRow ? o : a;
+}
+
+
+#ifdef __SSE2__
+static inline __m128i select(__m128i _mask, __m128i _a, __m128i _b)
+{
+	return(_mm_or_si128(_mm_and_si128(_mask, _a), _mm_andnot_si128(_mask, _b)));
+}
+
+
+// Green at the red and blue samples, along the direction with the smaller
+// gradient, or the average of both if they are equal
+static inline __m128i edgeGreen(__m128i _l, __m128i _r, __m128i _u, __m128i _d, __m128i _h, __m128i _v)
+{
+	__m128i	dh = _mm_or_si128(_mm_subs_epu8(_l, _r), _mm_subs_epu8(_r, _l));
+	__m128i	dv = _mm_or_si128(_mm_subs_epu8(_u, _d), _mm_subs_epu8(_d, _u));
+	__m128i	minD = _mm_min_epu8(dh, dv);
+	__m128i	hLe = _mm_cmpeq_epi8(minD, dh);
+	__m128i	vLe = _mm_cmpeq_epi8(minD, dv);
+
+	return(select(_mm_and_si128(hLe, vLe), _mm_avg_epu8(_h, _v), select(hLe, _h, _v)));
+}
+#endif
+
+
+template<int RED_ROW, int RED_COL, bool EDGE>
+static void demosaicRow(const unsigned char* _up, const unsigned char* _cur, const unsigned char* _down, int _y, int _width, unsigned char* _dst)
+{
+	bool	isRedRow = ((_y & 1) == RED_ROW);
+	int		siteCol = isRedRow ? RED_COL : 1 - RED_COL;	// column parity of the red or blue samples
+	int		x = 1;
+
+	demosaicPixel<EDGE>(_up, _cur, _down, 0, _width, (siteCol == 0), isRedRow, _dst);
+
+#ifdef __SSE2__
+	// 16 pixels per iteration, starting at the odd column 1, so the lanes
+	// holding the red or blue samples are the odd ones if siteCol is 1
+	__m128i			siteMask = (siteCol == 1) ? _mm_set1_epi16(0x00FF) : _mm_set1_epi16((short)0xFF00);
+	unsigned char	red[16];
+	unsigned char	green[16];
+	unsigned char	blue[16];
+	int				i;
+
+	for (; x+17<=_width; x+=16)
+	{
+		__m128i	c = _mm_loadu_si128((const __m128i*)(_cur + x));
+		__m128i	l = _mm_loadu_si128((const __m128i*)(_cur + x - 1));
+		__m128i	r = _mm_loadu_si128((const __m128i*)(_cur + x + 1));
+		__m128i	u = _mm_loadu_si128((const __m128i*)(_up + x));
+		__m128i	d = _mm_loadu_si128((const __m128i*)(_down + x));
+		__m128i	diag = _mm_avg_epu8(_mm_avg_epu8(_mm_loadu_si128((const __m128i*)(_up + x - 1)), _mm_loadu_si128((const __m128i*)(_up + x + 1))),
+		                            _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(_down + x - 1)), _mm_loadu_si128((const __m128i*)(_down + x + 1))));
+		__m128i	h = _mm_avg_epu8(l, r);
+		__m128i	v = _mm_avg_epu8(u, d);
+		__m128i	siteGreen = EDGE ? edgeGreen(l, r, u, d, h, v) : _mm_avg_epu8(h, v);
+		__m128i	a = select(siteMask, c, h);
+		__m128i	g = select(siteMask, siteGreen, c);
+		__m128i	o = select(siteMask, diag, v);
+
+		_mm_storeu_si128((__m128i*)red, isRedRow ? a : o);
+		_mm_storeu_si128((__m128i*)green, g);
+		_mm_storeu_si128((__m128i*)blue, isRedRow ? o : a);
+
+		for (i=0; i<16; i++)
+		{
+			_dst[3*(x+i)] = red[i];
+			_dst[3*(x+i) + 1] = green[i];
+			_dst[3*(x+i) + 2] = blue[i];
+		}
+	}
+#endif
+
+	for (; x<_width; x++)
+	{
+		demosaicPixel<EDGE>(_up, _cur, _down, x, _width, ((x & 1) == siteCol), isRedRow, _dst + 3*x);
+	}
+}
+
+
+template<int RED_ROW, int RED_COL, bool EDGE>
+static void demosaicFrame(const unsigned char* _raw, int _width, int _height, unsigned char* _rgb)
+{
+	const unsigned char*	up;
+	const unsigned char*	down;
+	int						y;
+
+	for (y=0; y<_height; y++)
+	{
+		up = _raw + ((y > 0) ? y - 1 : 1) * _width;
+		down = _raw + ((y < _height - 1) ? y + 1 : _height - 2) * _width;
+		demosaicRow<RED_ROW, RED_COL, EDGE>(up, _raw + y * _width, down, y, _width, _rgb + 3 * y * _width);
+	}
+}
+
+
+template<bool EDGE>
+static DemosaicFunc getFunc(PixelFormat _format)
+{
+	switch(_format)
+	{
+	case PIXEL_BAYER_RGGB:
+		return(demosaicFrame<0, 0, EDGE>);
+
+	case PIXEL_BAYER_GRBG:
+		return(demosaicFrame<0, 1, EDGE>);
+
+	case PIXEL_BAYER_BGGR:
+		return(demosaicFrame<1, 1, EDGE>);
+
+	default:
+		return(demosaicFrame<1, 0, EDGE>);		// GBRG
+	}
+}
+
+
+DemosaicFunc getDemosaicFunc(PixelFormat _format, DemosaicMethod _method)
+{
+	if(!isBayer(_format))
+	{
+		cerr << "Demosaicing needs a Bayer format" << endl;
+		abort();
+	}
+
+	return((_method == DEMOSAIC_EDGE) ? getFunc<true>(_format) : getFunc<false>(_format));
+}
@@ -0,0 +1,49 @@
+/*
+ * demosaic.h
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DEMOSAIC_H_
+#define DEMOSAIC_H_
+
+#include "pixelformat.h"
+
+//! Ways of interpolating the missing colors of a Bayer mosaic.
+enum DemosaicMethod
+{
+	DEMOSAIC_BILINEAR,		// average of the nearest samples of each color
+	DEMOSAIC_EDGE			// green interpolated along edges, otherwise bilinear
+};
+
+//! Return the method called _name ("bilinear" or "edge").
+DemosaicMethod parseDemosaicMethod(const char* _name);
+
+/*!
+ * Function converting a _width x _height Bayer frame _raw to interleaved
+ * RGB in _rgb. _width and _height should be even and at least 2.
+ */
+typedef void (*DemosaicFunc)(const unsigned char* _raw, int _width, int _height, unsigned char* _rgb);
+
+/*!
+ * Return the demosaic function for the Bayer format _format. Each pattern
+ * and method has its own instantiation, so the inner loops know the
+ * position of the colors at compile time.
+ */
+DemosaicFunc getDemosaicFunc(PixelFormat _format, DemosaicMethod _method);
+
+#endif /* DEMOSAIC_H_ */
@@ -0,0 +1,211 @@
+/*
+ * driftresampler.cpp
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "driftresampler.h"
+
+using namespace std;
+
+
+DriftResampler::DriftResampler(JitterBuffer* _input, int _framesPerPeriod, int _sampRate, AudioFormat _outFormat)
+{
+	input = _input;
+	outFormat = _outFormat;
+	framesPerPeriod = _framesPerPeriod;
+	periodsPerSec = double(_sampRate) / framesPerPeriod;
+
+	// Enough for a period at the maximal ratio, the interpolation margin and
+	// a whole appended period
+	histCapacity = int(framesPerPeriod * (1 + DRIFT_MAX_RATIO)) + 2 * framesPerPeriod + 8;
+
+	if (posix_memalign((void**)&hist, CACHE_LINE_SIZE, histCapacity * N_CHANS_NET * sizeof(float)) ||
+		posix_memalign((void**)&posInd, CACHE_LINE_SIZE, framesPerPeriod * sizeof(int)) ||
+		posix_memalign((void**)&posFrac, CACHE_LINE_SIZE, framesPerPeriod * sizeof(float)) ||
+		posix_memalign((void**)&outFloat, CACHE_LINE_SIZE, framesPerPeriod * N_CHANS_NET * sizeof(float)))
+	{
+		cerr << "Cannot allocate memory for the resampler" << endl;
+		abort();
+	}
+
+	// One frame of silence in front of the first input frame, for the
+	// interpolation
+	memset(hist, 0, histCapacity * N_CHANS_NET * sizeof(float));
+	histFrames = 1;
+	pos = 1;
+
+	ratio = 1;
+	smoothedDepth = -1;
+	nOutPeriods = 0;
+	driftPpm.store(0);
+}
+
+
+DriftResampler::~DriftResampler()
+{
+	free(outFloat);
+	free(posFrac);
+	free(posInd);
+	free(hist);
+}
+
+
+int DriftResampler::getDriftPpm()
+{
+	return(driftPpm.load());
+}
+
+
+void DriftResampler::appendPeriod()
+{
+	NET_AUDIO_TYPE*	data = input->getPeriod();
+	int					i;
+	int					ch;
+
+	for (ch=0; ch<N_CHANS_NET; ch++)
+	{
+		float*	dst = hist + ch * histCapacity + histFrames;
+
+		for (i=0; i<framesPerPeriod; i++)
+		{
+			dst[i] = data[i * N_CHANS_NET + ch];
+		}
+	}
+
+	histFrames += framesPerPeriod;
+}
+
+
+void DriftResampler::updateRatio()
+{
+	struct timespec	timestamp;
+	double			inRate;
+	double			outRate;
+	double			drift;
+	double			correction;
+	int				depth = input->getDepth();
+
+	clock_gettime(CLOCK_REALTIME, &timestamp);
+	outputRate.addSample(double(timestamp.tv_sec) * 1000 + double(timestamp.tv_nsec) / 1000000, nOutPeriods);
+
+	// Smooth out the jitter of the buffer depth
+	if (smoothedDepth < 0)
+	{
+		smoothedDepth = depth;
+	}
+	smoothedDepth += (depth - smoothedDepth) / (DRIFT_CORRECTION_TIME * periodsPerSec);
+
+	inRate = input->getInputRate();
+	outRate = outputRate.getRate();
+	drift = (inRate > 0 && outRate > 0) ? inRate / outRate - 1 : 0;
+
+	// Each period of excess depth is played out within DRIFT_CORRECTION_TIME
+	correction = (smoothedDepth - input->getTargetDepth()) / (DRIFT_CORRECTION_TIME * periodsPerSec);
+
+	ratio = 1 + drift + correction;
+	ratio = (ratio < 1 + DRIFT_MAX_RATIO) ? ratio : 1 + DRIFT_MAX_RATIO;
+	ratio = (ratio > 1 - DRIFT_MAX_RATIO) ? ratio : 1 - DRIFT_MAX_RATIO;
+
+	driftPpm.store(int((ratio - 1) * 1000000));
+}
+
+
+void DriftResampler::getPeriod(void* _out)
+{
+	int		i;
+	int		ch;
+	int		shift;
+	double	p;
+
+	updateRatio();
+	nOutPeriods++;
+
+	// Positions of the output frames in the input, and enough input to
+	// interpolate at all of them (two frames past the last position)
+	for (i=0; i<framesPerPeriod; i++)
+	{
+		p = pos + i * ratio;
+		posInd[i] = int(p);
+		posFrac[i] = float(p - posInd[i]);
+	}
+
+	while (posInd[framesPerPeriod-1] + 2 >= histFrames)
+	{
+		appendPeriod();
+	}
+
+	for (ch=0; ch<N_CHANS_NET; ch++)
+	{
+		const float*	x = hist + ch * histCapacity;
+		float*			y = outFloat + ch * framesPerPeriod;
+
+		i = 0;
+#ifdef __SSE2__
+		// Four output frames at a time
+		for (; i+4<=framesPerPeriod; i+=4)
+		{
+			const int*	ind = posInd + i;
+			__m128	t = _mm_load_ps(posFrac + i);
+			__m128	xm1 = _mm_set_ps(x[ind[3]-1], x[ind[2]-1], x[ind[1]-1], x[ind[0]-1]);
+			__m128	x0 = _mm_set_ps(x[ind[3]], x[ind[2]], x[ind[1]], x[ind[0]]);
+			__m128	x1 = _mm_set_ps(x[ind[3]+1], x[ind[2]+1], x[ind[1]+1], x[ind[0]+1]);
+			__m128	x2 = _mm_set_ps(x[ind[3]+2], x[ind[2]+2], x[ind[1]+2], x[ind[0]+2]);
+			__m128	half = _mm_set1_ps(0.5f);
+			__m128	a, b, c;
+
+			// Catmull-Rom spline coefficients
+			a = _mm_mul_ps(half, _mm_add_ps(_mm_sub_ps(x2, xm1), _mm_mul_ps(_mm_set1_ps(3.0f), _mm_sub_ps(x0, x1))));
+			b = _mm_sub_ps(_mm_add_ps(xm1, _mm_add_ps(x1, x1)), _mm_mul_ps(half, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(5.0f), x0), x2)));
+			c = _mm_mul_ps(half, _mm_sub_ps(x1, xm1));
+			_mm_storeu_ps(y + i, _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(a, t), b), t), c), t), x0));
+		}
+#endif
+		for (; i<framesPerPeriod; i++)
+		{
+			const float*	s = x + posInd[i];
+			float			t = posFrac[i];
+			float			a = 0.5f * (s[2] - s[-1] + 3 * (s[0] - s[1]));
+			float			b = s[-1] + 2 * s[1] - 0.5f * (5 * s[0] + s[2]);
+			float			c = 0.5f * (s[1] - s[-1]);
+
+			y[i] = ((a * t + b) * t + c) * t + s[0];
+		}
+	}
+
+	// Rounding and saturation happen in the conversion
+	outFormat.storePlayback(outFloat, framesPerPeriod, _out);
+
+	// Drop the consumed input, keeping one frame before the next position
+	pos += framesPerPeriod * ratio;
+	shift = int(pos) - 1;
+	for (ch=0; ch<N_CHANS_NET; ch++)
+	{
+		memmove(hist + ch * histCapacity, hist + ch * histCapacity + shift, (histFrames - shift) * sizeof(float));
+	}
+	histFrames -= shift;
+	pos -= shift;
+}
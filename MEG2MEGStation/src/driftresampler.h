@@ -0,0 +1,90 @@
+/*
+ * driftresampler.h
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DRIFTRESAMPLER_H_
+#define DRIFTRESAMPLER_H_
+
+#include <QAtomicInteger>
+
+#include "config.h"
+#include "audioformat.h"
+#include "jitterbuffer.h"
+#include "rateestimator.h"
+
+//! Compensation of the clock drift between the two sites' sound cards.
+/*!
+ * The sender's and the receiver's sound cards run from independent clocks,
+ * so the received periods arrive slightly faster or slower than they are
+ * played. This class resamples the output of the JitterBuffer by a ratio
+ * close to one, so that the buffer depth stays constant.
+ *
+ * The ratio is the rate at which the periods arrive divided by the rate at
+ * which they are played, both measured over DRIFT_WINDOW seconds, plus a
+ * small correction that brings the smoothed depth of the jitter buffer to
+ * its target within about DRIFT_CORRECTION_TIME seconds. It is limited to
+ * 1 +- DRIFT_MAX_RATIO. The resampling uses cubic (Catmull-Rom)
+ * interpolation. The output is converted to the sound card's format.
+ *
+ * All the methods except getDriftPpm() should be called from the playback
+ * thread.
+ */
+class DriftResampler
+{
+public:
+	DriftResampler(JitterBuffer* _input, int _framesPerPeriod, int _sampRate, AudioFormat _outFormat);
+	virtual ~DriftResampler();
+
+	//! Write the next period to be played into _out. Never blocks.
+	void getPeriod(void* _out);
+
+	//! Current deviation of the resampling ratio from one, in ppm.
+	int getDriftPpm();
+
+private:
+	void updateRatio();
+	void appendPeriod();
+
+	JitterBuffer*		input;
+	int					framesPerPeriod;
+	double				periodsPerSec;
+
+	// Input frames not consumed yet, deinterleaved to floats. The next
+	// output frame is interpolated at position pos.
+	float*				hist;
+	int					histFrames;
+	int					histCapacity;	// in frames
+	double				pos;
+
+	// Position of each output frame of the current period
+	int*				posInd;
+	float*				posFrac;
+
+	// The current period before the conversion to the output format
+	float*				outFloat;
+	AudioFormat			outFormat;
+
+	double				ratio;			// input frames per output frame
+	double				smoothedDepth;
+	uint64_t			nOutPeriods;
+	RateEstimator		outputRate;
+	QAtomicInt			driftPpm;
+};
+
+#endif /* DRIFTRESAMPLER_H_ */
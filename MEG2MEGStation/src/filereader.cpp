@@ -0,0 +1,366 @@
+/*
+ * filereader.cpp
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "filereader.h"
+#include "varint.h"
+
+FileReader::FileReader()
+{
+	file = NULL;
+	buf = NULL;
+	bufLen = 0;
+	blocked = false;
+	nFields = 0;
+	chunksLeft = 0;
+	hasPending = false;
+	error[0] = 0;
+}
+
+
+FileReader::~FileReader()
+{
+	close();
+	free(buf);
+}
+
+
+void FileReader::close()
+{
+	if(file)
+	{
+		fclose(file);
+		file = NULL;
+	}
+
+	chunksLeft = 0;
+	hasPending = false;
+}
+
+
+bool FileReader::readBytes(void* _dst, size_t _len)
+{
+	return(fread(_dst, 1, _len, file) == _len);
+}
+
+
+bool FileReader::readHeader(void* _dst, size_t _len)
+{
+	return(file && readBytes(_dst, _len));
+}
+
+
+bool FileReader::openFile(const char* _fileName, const char* _magic)
+{
+	char*		magic;
+	uint8_t		site;
+	uint8_t		sender;
+	bool		ok;
+
+	close();
+
+	file = fopen(_fileName, "rb");
+	if(!file)
+	{
+		snprintf(error, sizeof(error), "Cannot open the file %s", _fileName);
+		return(false);
+	}
+
+	magic = new char[strlen(_magic)];
+	ok = readBytes(magic, strlen(_magic)) && !memcmp(magic, _magic, strlen(_magic)) && readBytes(&version, sizeof(uint32_t));
+	delete[] magic;
+
+	if(!ok)
+	{
+		snprintf(error, sizeof(error), "%s does not start with %s", _fileName, _magic);
+		close();
+		return(false);
+	}
+
+	if(!readBytes(&site, 1) || !readBytes(&sender, 1))
+	{
+		snprintf(error, sizeof(error), "Truncated header in %s", _fileName);
+		close();
+		return(false);
+	}
+
+	siteId = site;
+	isSender = sender;
+	return(true);
+}
+
+
+void FileReader::setLayout(bool _blocked, int _nFields)
+{
+	blocked = _blocked;
+	nFields = _nFields;
+}
+
+
+bool FileReader::reserveBuf(unsigned char** _buf, size_t* _bufLen, size_t _len)
+{
+	unsigned char*	newBuf;
+
+	if(_len <= *_bufLen)
+	{
+		return(true);
+	}
+
+	newBuf = (unsigned char*)realloc(*_buf, _len);
+	if(!newBuf)
+	{
+		return(false);
+	}
+
+	*_buf = newBuf;
+	*_bufLen = _len;
+	return(true);
+}
+
+
+FileRecordType FileReader::readRecord(FileRecord* _rec)
+{
+	if(!file)
+	{
+		snprintf(error, sizeof(error), "No file open");
+		return(FILE_RECORD_ERROR);
+	}
+
+	if(hasPending)
+	{
+		*_rec = pending;
+		hasPending = false;
+		return(FILE_RECORD_CHUNK);
+	}
+
+	if(blocked)
+	{
+		return(readBlockChunk(_rec));
+	}
+	else
+	{
+		return(readChunkRecord(_rec));
+	}
+}
+
+
+FileRecordType FileReader::readChunkRecord(FileRecord* _rec)
+{
+	uint32_t	size;
+	int			rc;
+	int			i;
+
+	// The file ends cleanly only between records
+	rc = fread(&(_rec->timestamp), 1, sizeof(uint64_t), file);
+	if(rc == 0 && feof(file))
+	{
+		return(FILE_RECORD_END);
+	}
+
+	if(rc != sizeof(uint64_t) || !readBytes(&(_rec->id), sizeof(uint64_t)) || !readBytes(&size, sizeof(uint32_t)))
+	{
+		snprintf(error, sizeof(error), "Truncated record");
+		return(FILE_RECORD_ERROR);
+	}
+
+	if(size == GAP_RECORD_MARKER)
+	{
+		if(!readBytes(&(_rec->policy), sizeof(uint32_t)) || !readBytes(&(_rec->droppedChunks), sizeof(uint64_t))
+		   || !readBytes(&(_rec->droppedBytes), sizeof(uint64_t)))
+		{
+			snprintf(error, sizeof(error), "Truncated gap record");
+			return(FILE_RECORD_ERROR);
+		}
+		return(FILE_RECORD_GAP);
+	}
+
+	for(i=0; i<nFields; i++)
+	{
+		if(!readBytes(&(_rec->fields[i]), sizeof(uint64_t)))
+		{
+			snprintf(error, sizeof(error), "Truncated record");
+			return(FILE_RECORD_ERROR);
+		}
+	}
+
+	if(!reserveBuf(&buf, &bufLen, size))
+	{
+		snprintf(error, sizeof(error), "Cannot allocate memory");
+		return(FILE_RECORD_ERROR);
+	}
+
+	if(!readBytes(buf, size))
+	{
+		snprintf(error, sizeof(error), "Truncated chunk data");
+		return(FILE_RECORD_ERROR);
+	}
+
+	_rec->size = size;
+	_rec->data = buf;
+	return(FILE_RECORD_CHUNK);
+}
+
+
+bool FileReader::readBlock()
+{
+	unsigned char	header[FILE_BLOCK_HEADER];
+	uint32_t		metaLen;
+	uint32_t		dataLen;
+	int				i;
+
+	if(!readBytes(header, FILE_BLOCK_HEADER))
+	{
+		snprintf(error, sizeof(error), "Truncated block header");
+		return(false);
+	}
+
+	memcpy(&chunksLeft, header, sizeof(uint32_t));
+	memcpy(&metaLen, header + sizeof(uint32_t), sizeof(uint32_t));
+	memcpy(&dataLen, header + 2*sizeof(uint32_t), sizeof(uint32_t));
+	memcpy(&prevTimestamp, header + 3*sizeof(uint32_t), sizeof(uint64_t));
+	memcpy(&prevId, header + 3*sizeof(uint32_t) + sizeof(uint64_t), sizeof(uint64_t));
+	prevId--;
+	for(i=0; i<nFields; i++)
+	{
+		prevFields[i] = 0;
+	}
+
+	if(chunksLeft == 0 || metaLen > uint64_t(chunksLeft) * FILE_CHUNK_MAX_META)
+	{
+		snprintf(error, sizeof(error), "Corrupt block header");
+		chunksLeft = 0;
+		return(false);
+	}
+
+	if(!reserveBuf(&buf, &bufLen, size_t(metaLen) + dataLen))
+	{
+		snprintf(error, sizeof(error), "Cannot allocate memory");
+		chunksLeft = 0;
+		return(false);
+	}
+
+	if(!readBytes(buf, size_t(metaLen) + dataLen))
+	{
+		snprintf(error, sizeof(error), "Truncated block");
+		chunksLeft = 0;
+		return(false);
+	}
+
+	metaPos = buf;
+	metaEnd = buf + metaLen;
+	dataPos = metaEnd;
+	dataEnd = dataPos + dataLen;
+	return(true);
+}
+
+
+FileRecordType FileReader::readBlockChunk(FileRecord* _rec)
+{
+	const unsigned char*	p;
+	uint64_t				sizeGap;
+	uint64_t				val;
+	int						c;
+	int						i;
+
+	if(chunksLeft == 0)
+	{
+		// The file ends cleanly only between blocks
+		c = fgetc(file);
+		if(c == EOF)
+		{
+			return(FILE_RECORD_END);
+		}
+		ungetc(c, file);
+
+		if(!readBlock())
+		{
+			return(FILE_RECORD_ERROR);
+		}
+	}
+
+	p = getVarint(metaPos, metaEnd, &sizeGap);
+	if(p && (sizeGap & 1))
+	{
+		p = getVarint(p, metaEnd, &val);
+		_rec->policy = val;
+		if(p)
+		{
+			p = getVarint(p, metaEnd, &(_rec->droppedChunks));
+		}
+		if(p)
+		{
+			p = getVarint(p, metaEnd, &(_rec->droppedBytes));
+		}
+	}
+
+	if(p)
+	{
+		p = getVarint(p, metaEnd, &val);
+		_rec->timestamp = prevTimestamp + unzigzag(val);
+	}
+	if(p)
+	{
+		p = getVarint(p, metaEnd, &val);
+		_rec->id = prevId + 1 + unzigzag(val);
+	}
+	for(i=0; i<nFields && p; i++)
+	{
+		p = getVarint(p, metaEnd, &val);
+		_rec->fields[i] = prevFields[i] + unzigzag(val);
+	}
+
+	if(!p || (sizeGap >> 1) > uint64_t(dataEnd - dataPos))
+	{
+		snprintf(error, sizeof(error), "Corrupt block metadata");
+		chunksLeft = 0;
+		return(FILE_RECORD_ERROR);
+	}
+
+	_rec->size = sizeGap >> 1;
+	_rec->data = dataPos;
+
+	metaPos = p;
+	dataPos += _rec->size;
+	prevTimestamp = _rec->timestamp;
+	prevId = _rec->id;
+	for(i=0; i<nFields; i++)
+	{
+		prevFields[i] = _rec->fields[i];
+	}
+
+	chunksLeft--;
+	if(chunksLeft == 0 && (metaPos != metaEnd || dataPos != dataEnd))
+	{
+		snprintf(error, sizeof(error), "Corrupt block metadata");
+		return(FILE_RECORD_ERROR);
+	}
+
+	if(sizeGap & 1)
+	{
+		// Return the gap first and the chunk with the next call
+		pending = *_rec;
+		hasPending = true;
+		return(FILE_RECORD_GAP);
+	}
+
+	return(FILE_RECORD_CHUNK);
+}
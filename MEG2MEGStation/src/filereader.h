@@ -0,0 +1,138 @@
+/*
+ * filereader.h
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FILEREADER_H_
+#define FILEREADER_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "config.h"
+
+//! Kinds of records returned by FileReader::readRecord()
+enum FileRecordType
+{
+	FILE_RECORD_CHUNK,
+	FILE_RECORD_GAP,
+	FILE_RECORD_END,
+	FILE_RECORD_ERROR
+};
+
+//! A chunk or a gap in a file written by FileWriter.
+struct FileRecord
+{
+	uint64_t		timestamp;		// in milliseconds
+	uint64_t		id;
+
+	// Chunks only
+	uint32_t		size;			// of the stored data, in bytes
+	const void*		data;			// valid until the next call
+	uint64_t		fields[FILE_MAX_RECORD_FIELDS];	// stream-specific
+
+	// Gaps only
+	uint32_t		policy;
+	uint64_t		droppedChunks;
+	uint64_t		droppedBytes;
+};
+
+//! Streaming reader of the files written by FileWriter.
+/*!
+ * Reads the common part of the file header and then the chunks one at a
+ * time, so files of any length can be processed in constant memory. Both
+ * the block layout and the older layout with a record per chunk are
+ * supported. A gap is returned as a separate record, with the timestamp
+ * and id of the chunk that follows it.
+ *
+ * Derived classes read the stream-specific part of the header and tell the
+ * layout with setLayout(). The readers do not depend on Qt and do not abort
+ * on errors, so that they can also be built into the MATLAB tools.
+ */
+class FileReader
+{
+public:
+	FileReader();
+	virtual ~FileReader();
+
+	virtual void close();
+
+	//! Description of the last error.
+	const char* getError() { return(error); }
+
+	uint32_t getVersion() { return(version); }
+	int getSiteId() { return(siteId); }
+	bool getIsSender() { return(isSender); }
+
+	//! Read the next record to _rec.
+	FileRecordType readRecord(FileRecord* _rec);
+
+protected:
+	//! Open the file, check the magic string and read the version, site and sender.
+	/*!
+	 * Return false on error. The rest of the header is read by the caller
+	 * right after the version, see readHeader().
+	 */
+	bool openFile(const char* _fileName, const char* _magic);
+
+	//! Read _len bytes of the header. Return false if the file ends before.
+	bool readHeader(void* _dst, size_t _len);
+
+	//! Whether the chunks are stored in blocks and the number of fields in their metadata.
+	void setLayout(bool _blocked, int _nFields);
+
+	//! Make sure that *_buf (of *_bufLen bytes) has room for _len bytes. Return false if out of memory.
+	static bool reserveBuf(unsigned char** _buf, size_t* _bufLen, size_t _len);
+
+	char			error[500];
+
+private:
+	bool readBytes(void* _dst, size_t _len);
+	FileRecordType readChunkRecord(FileRecord* _rec);
+	FileRecordType readBlockChunk(FileRecord* _rec);
+	bool readBlock();
+
+	FILE*			file;
+
+	uint32_t		version;
+	int				siteId;
+	bool			isSender;
+
+	bool			blocked;
+	int				nFields;
+
+	// The current block (or record) as read from the file
+	unsigned char*	buf;
+	size_t			bufLen;
+
+	// Position in the current block
+	uint32_t		chunksLeft;
+	const unsigned char*	metaPos;
+	const unsigned char*	metaEnd;
+	const unsigned char*	dataPos;
+	const unsigned char*	dataEnd;
+	uint64_t		prevTimestamp;
+	uint64_t		prevId;
+	uint64_t		prevFields[FILE_MAX_RECORD_FIELDS];
+
+	// The chunk following a gap, returned by the next call
+	FileRecord		pending;
+	bool			hasPending;
+};
+
+#endif /* FILEREADER_H_ */
@@ -19,20 +19,29 @@
  */
 
 #include <iostream>
-#include <fstream>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "filewriter.h"
+#include "settings.h"
+#include "varint.h"
 
 using namespace std;
 
 FileWriter::FileWriter(CycDataBuffer* _cycBuf, const char* _path, const char* _ext, int _siteId, bool _isSender, QLineEdit* _suffix)
 {
+	Settings	settings;
+
 	cycBuf = _cycBuf;
+	consumerId = cycBuf->registerConsumer();
 	siteId = _siteId;
 	isSender = _isSender;
 	suffix = _suffix;
+	preRoll = uint64_t(settings.preRoll * 1000);
 
 	path = (char*)malloc(strlen(_path)+1);
 	if(!path)
@@ -50,36 +59,208 @@ FileWriter::FileWriter(CycDataBuffer* _cycBuf, const char* _path, const char* _e
 
 	strcpy(path, _path);
 	strcpy(ext, _ext);
+
+	memset(encBuf, 0, sizeof(encBuf));
+	memset(encBufLen, 0, sizeof(encBufLen));
 }
 
 
 FileWriter::~FileWriter()
 {
+	int	i;
+
+	cycBuf->unregisterConsumer(consumerId);
 	free(ext);
 	free(path);
+
+	for (i=0; i<FILE_WRITER_BATCH; i++)
+	{
+		free(encBuf[i]);
+	}
+}
+
+
+int FileWriter::getRecordFields(const ChunkAttrib*, uint64_t*)
+{
+	return(0);
+}
+
+
+void FileWriter::startFile()
+{
+}
+
+
+int FileWriter::maxEncodedSize(const ChunkAttrib*)
+{
+	return(0);
+}
+
+
+int FileWriter::encodeChunk(const unsigned char*, const ChunkAttrib*, unsigned char*)
+{
+	return(0);
+}
+
+
+void FileWriter::queueWrite(void* _data, size_t _len)
+{
+	iov[iovCnt].iov_base = _data;
+	iov[iovCnt].iov_len = _len;
+	iovCnt++;
+}
+
+
+void FileWriter::flushWrites()
+{
+	struct iovec*	curIov = iov;
+	int				curCnt;
+	ssize_t			rc;
+
+	endBlock();
+	curCnt = iovCnt;
+
+	// writev() can write less than requested, continue from where it stopped
+	while (curCnt)
+	{
+		rc = writev(outFd, curIov, curCnt);
+		if (rc < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			// TODO: Add more elaborate error checking
+			cerr << "Error writing to the file " << nameBuf << endl;
+			abort();
+		}
+
+		while (curCnt && size_t(rc) >= curIov->iov_len)
+		{
+			rc -= curIov->iov_len;
+			curIov++;
+			curCnt--;
+		}
+
+		if (curCnt)
+		{
+			curIov->iov_base = (char*)(curIov->iov_base) + rc;
+			curIov->iov_len -= rc;
+		}
+	}
+
+	iovCnt = 0;
+}
+
+
+void FileWriter::addChunk(const ChunkAttrib* _attrib, const ChunkGap* _gap, unsigned char* _data, uint32_t _size)
+{
+	unsigned char*	meta;
+	uint64_t		fields[FILE_MAX_RECORD_FIELDS];
+	int				nFields;
+	int				i;
+
+	if (blockIov < 0)
+	{
+		// Leave room for the block header and the metadata
+		blockIov = iovCnt;
+		iovCnt += 2;
+
+		blockChunks = 0;
+		blockDataLen = 0;
+		metaLen = 0;
+		prevTimestamp = _attrib->timestamp;
+		prevId = _attrib->id - 1;
+		memset(prevFields, 0, sizeof(prevFields));
+
+		memcpy(blockHeader + 3*sizeof(uint32_t), &(_attrib->timestamp), sizeof(uint64_t));
+		memcpy(blockHeader + 3*sizeof(uint32_t) + sizeof(uint64_t), &(_attrib->id), sizeof(uint64_t));
+	}
+
+	meta = metaBuf + metaLen;
+	meta = putVarint(meta, (uint64_t(_size) << 1) | (_gap ? 1 : 0));
+	if (_gap)
+	{
+		meta = putVarint(meta, cycBuf->getOverflowPolicy());
+		meta = putVarint(meta, _gap->droppedChunks);
+		meta = putVarint(meta, _gap->droppedBytes);
+	}
+
+	meta = putVarint(meta, zigzag(int64_t(_attrib->timestamp - prevTimestamp)));
+	meta = putVarint(meta, zigzag(int64_t(_attrib->id - prevId - 1)));
+	prevTimestamp = _attrib->timestamp;
+	prevId = _attrib->id;
+
+	nFields = getRecordFields(_attrib, fields);
+	for (i=0; i<nFields; i++)
+	{
+		meta = putVarint(meta, zigzag(int64_t(fields[i] - prevFields[i])));
+		prevFields[i] = fields[i];
+	}
+
+	metaLen = meta - metaBuf;
+	blockChunks++;
+	blockDataLen += _size;
+	queueWrite(_data, _size);
+}
+
+
+void FileWriter::endBlock()
+{
+	if (blockIov < 0)
+	{
+		return;
+	}
+
+	memcpy(blockHeader, &blockChunks, sizeof(uint32_t));
+	memcpy(blockHeader + sizeof(uint32_t), &metaLen, sizeof(uint32_t));
+	memcpy(blockHeader + 2*sizeof(uint32_t), &blockDataLen, sizeof(uint32_t));
+
+	iov[blockIov].iov_base = blockHeader;
+	iov[blockIov].iov_len = FILE_BLOCK_HEADER;
+	iov[blockIov + 1].iov_base = metaBuf;
+	iov[blockIov + 1].iov_len = metaLen;
+
+	blockIov = -1;
 }
 
 
 void FileWriter::stoppableRun()
 {
-	unsigned char*	databuf;
-	bool			prevIsRec=false;
-	ofstream		outData;
-	char			nameBuf[500];
+	ChunkRef		chunks[FILE_WRITER_BATCH];
+	int				nChunks;
+	int				i;
+	bool			isWriting=false;
+	bool			inPreRoll=false;
+	bool			isFirstChunk=false;
 	time_t			timeNow;
     struct tm*		timeNowParsed;
-    ChunkAttrib		chunkAttrib;
+    ChunkAttrib*	chunkAttrib;
+    ChunkGap*		chunkGap;
+    unsigned char*	data;
     uint32_t		chunkSz;
+    int				encSz;
+    uint64_t		recStart;
+    uint64_t		preRollStart;
+    uint64_t		lastWrittenTstamp=0;
 
     unsigned char*	header;
     int				headerLen;
 
+    iovCnt = 0;
+    blockIov = -1;
+
 	while (true)
 	{
-		databuf = cycBuf->getChunk(&chunkAttrib);
-		if (chunkAttrib.isRec)
+		// Write everything available in one system call
+		nChunks = cycBuf->getChunks(consumerId, chunks, FILE_WRITER_BATCH, FILE_WRITER_BATCH_BYTES);
+		for (i=0; i<nChunks; i++)
 		{
-			if (!prevIsRec)
+			chunkAttrib = &(chunks[i].attrib);
+			chunkGap = &(chunks[i].gap);
+
+			if (chunkAttrib->isRec && !isWriting)
 			{
 				timeNow = time(NULL);
 				timeNowParsed = localtime(&timeNow);
@@ -96,38 +277,105 @@ void FileWriter::stoppableRun()
 						siteId,
 						(isSender ? "sender" : "receiver"),
 						ext);
-				outData.open(nameBuf, ios_base::out | ios_base::binary | ios_base::trunc);
-				if(outData.fail())
+				outFd = open(nameBuf, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+				if(outFd < 0)
 				{
 					// TODO: Add more elaborate error checking
 					cerr << "Error opening the file " << nameBuf << endl;
 					abort();
 				}
 				header = getHeader(&headerLen);
-				outData.write((const char*)header, headerLen);
+				queueWrite(header, headerLen);
+				startFile();
+				isWriting = true;
+				isFirstChunk = true;
+
+				// Go back in the buffer to also store the data preceding the
+				// start of the recording. All the streams that know the
+				// common start time use it; otherwise the start is this
+				// chunk. The data already stored in the previous file is not
+				// repeated.
+				recStart = cycBuf->getStartRecTstamp();
+				if (!recStart || recStart > chunkAttrib->timestamp)
+				{
+					recStart = chunkAttrib->timestamp;
+				}
+
+				preRollStart = (recStart > preRoll) ? recStart - preRoll : 0;
+				preRollStart = (preRollStart > lastWrittenTstamp) ? preRollStart : lastWrittenTstamp + 1;
+
+				// The rewind releases the rest of the batch, so the header
+				// has to be written out first
+				flushWrites();
+				if (preRoll && cycBuf->rewind(consumerId, preRollStart))
+				{
+					// Catch up with the live data as fast as possible
+					inPreRoll = true;
+					break;
+				}
 			}
 
-			chunkSz = chunkAttrib.chunkSize;
-			outData.write((const char*)(&(chunkAttrib.timestamp)), sizeof(uint64_t));
-			outData.write((const char*)(&(chunkAttrib.id)), sizeof(uint64_t));
-			outData.write((const char*)(&chunkSz), sizeof(uint32_t));
-			outData.write((const char*)databuf, chunkAttrib.chunkSize);
-		}
-		else
-		{
-			if (prevIsRec)
+			if (isWriting && (chunkAttrib->isRec || inPreRoll))
+			{
+				// The data is either encoded to encBuf or written as it is
+				data = chunks[i].data;
+				chunkSz = chunkAttrib->chunkSize;
+				encSz = maxEncodedSize(chunkAttrib);
+				if (encSz)
+				{
+					if (encSz > encBufLen[i])
+					{
+						encBuf[i] = (unsigned char*)realloc(encBuf[i], encSz);
+						if (!encBuf[i])
+						{
+							cerr << "Error allocating memory!" << endl;
+							abort();
+						}
+						encBufLen[i] = encSz;
+					}
+
+					chunkSz = encodeChunk(data, chunkAttrib, encBuf[i]);
+					data = encBuf[i];
+				}
+
+				if (!isFirstChunk && chunkGap->droppedChunks)
+				{
+					// Some data was lost in the middle of the recording
+					cerr << "Buffer overflow, " << chunkGap->droppedChunks << " chunks (" << chunkGap->droppedBytes << " bytes) lost in " << nameBuf << endl;
+					addChunk(chunkAttrib, chunkGap, data, chunkSz);
+				}
+				else
+				{
+					addChunk(chunkAttrib, NULL, data, chunkSz);
+				}
+
+				isFirstChunk = false;
+				lastWrittenTstamp = chunkAttrib->timestamp;
+
+				// The pre-roll ends at the first chunk recorded live
+				if (chunkAttrib->isRec)
+				{
+					inPreRoll = false;
+				}
+			}
+			else if (isWriting)
 			{
-				outData.close();
+				flushWrites();
+				close(outFd);
+				isWriting = false;
 			}
 		}
 
-		prevIsRec = chunkAttrib.isRec;
+		if (isWriting)
+		{
+			flushWrites();
+		}
 
 		if(shouldStop)
 		{
-			if(prevIsRec)
+			if(isWriting)
 			{
-				outData.close();
+				close(outFd);
 			}
 			return;
 		}
@@ -21,8 +21,10 @@
 #ifndef FILEWRITER_H_
 #define FILEWRITER_H_
 
+#include <sys/uio.h>
 #include <QLineEdit>
 
+#include "config.h"
 #include "stoppablethread.h"
 #include "cycdatabuffer.h"
 
@@ -35,6 +37,33 @@
  * header would contain some string identifying file type and parameters (e.g.
  * sampling rate, etc.)
  *
+ * The chunks are stored in blocks, one for each batch of chunks written
+ * together. A block starts with the number of its chunks (uint32), the size
+ * of their metadata (uint32), the size of their data (uint32), and the
+ * timestamp (uint64) and id (uint64) of its first chunk. The metadata of
+ * all the chunks follows, and then their data, one after another.
+ *
+ * The metadata of a chunk is a sequence of varints (see varint.h):
+ *  - the size of the stored data times two, plus one if chunks were lost
+ *    (because of a buffer overflow) before this one
+ *  - only if chunks were lost: the buffer's overflow policy, the number of
+ *    lost chunks and the number of lost bytes
+ *  - the difference of the timestamp from that of the previous chunk
+ *    (zigzag mapped), the block's timestamp for the first chunk
+ *  - the difference of the id from that of the previous chunk, minus one
+ *    (zigzag mapped), the block's id minus one for the first chunk
+ *  - the differences of the fields returned by getRecordFields() (none by
+ *    default) from those of the previous chunk (zigzag mapped), from zero
+ *    for the first chunk
+ *
+ * Derived classes can store the data coded by encodeChunk() instead of as
+ * it is.
+ *
+ * When the recording starts, the writer first stores the data that was
+ * inserted into the buffer during the pre-roll interval (set in the
+ * application settings) before the start, as far as the buffer still holds
+ * it, and then catches up with the live data.
+ *
  * When stopping the thread always call the stop() method while chunks are
  * still being continuously inserted into the CycDataBuffer associated with
  * the object - otherwise stop() will hang forever.
@@ -53,13 +82,63 @@ protected:
 	//! Return the header to be written at the beginning of the file.
 	virtual unsigned char* getHeader(int* _len) = 0;
 
+	/*!
+	 * Store the stream-specific fields of the chunk's metadata in _fields
+	 * and return their number, at most FILE_MAX_RECORD_FIELDS.
+	 */
+	virtual int getRecordFields(const ChunkAttrib* _attrib, uint64_t* _fields);
+
+	//! Called when a new file is opened, before any of its chunks is encoded.
+	virtual void startFile();
+
+	/*!
+	 * Return an upper bound of the size of the chunk's data after
+	 * encodeChunk(), or 0 if the data is stored as it is (the default).
+	 */
+	virtual int maxEncodedSize(const ChunkAttrib* _attrib);
+
+	//! Encode the chunk's data _data to _dst and return the size of the result.
+	virtual int encodeChunk(const unsigned char* _data, const ChunkAttrib* _attrib, unsigned char* _dst);
+
 private:
+	void queueWrite(void* _data, size_t _len);
+	void flushWrites();
+	void addChunk(const ChunkAttrib* _attrib, const ChunkGap* _gap, unsigned char* _data, uint32_t _size);
+	void endBlock();
+
 	CycDataBuffer*	cycBuf;
+	int				consumerId;
 	QLineEdit*		suffix;
 	char*			path;
 	char*			ext;
 	int				siteId;
 	bool			isSender;
+	uint64_t		preRoll;		// in milliseconds
+
+	// Output file. A whole batch of chunks is written as one block with a
+	// single writev() call: the block header and the metadata of the chunks
+	// go from blockHeader and metaBuf, the data directly from the buffer.
+	int				outFd;
+	char			nameBuf[500];
+	struct iovec	iov[FILE_WRITER_BATCH + 3];
+	int				iovCnt;
+
+	// The block being assembled. Its header and metadata are queued in iov
+	// at blockIov when the block is complete.
+	int				blockIov;		// -1 if there is no block
+	uint32_t		blockChunks;
+	uint32_t		blockDataLen;
+	uint64_t		prevTimestamp;
+	uint64_t		prevId;
+	uint64_t		prevFields[FILE_MAX_RECORD_FIELDS];
+	unsigned char	blockHeader[FILE_BLOCK_HEADER];
+	unsigned char	metaBuf[FILE_WRITER_BATCH * FILE_CHUNK_MAX_META];
+	uint32_t		metaLen;
+
+	// Encoded data of the chunks of a batch, if the derived class encodes
+	// it. Each buffer grows as needed.
+	unsigned char*	encBuf[FILE_WRITER_BATCH];
+	int				encBufLen[FILE_WRITER_BATCH];
 };
 
 #endif /* FILEWRITER_H_ */
@@ -0,0 +1,351 @@
+/*
+ * jitterbuffer.cpp
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+#include "jitterbuffer.h"
+
+using namespace std;
+
+
+JitterBuffer::JitterBuffer(NonBlockingBuffer* _input, int _framesPerPeriod, int _sampRate, int _minDepth)
+{
+	int	i;
+
+	input = _input;
+	periodSamples = _framesPerPeriod * N_CHANS_NET;
+	periodDuration = double(_framesPerPeriod) * 1000 / _sampRate;
+	minDepth = (_minDepth > 0) ? _minDepth : 1;
+
+	if (minDepth + JITTER_HYSTERESIS + 2 > JITTER_BUF_SLOTS)
+	{
+		cerr << "Minimum jitter buffer depth " << minDepth << " does not fit into " << JITTER_BUF_SLOTS << " slots" << endl;
+		abort();
+	}
+
+	if (posix_memalign((void**)&windowData, CACHE_LINE_SIZE, JITTER_BUF_SLOTS * periodSamples * sizeof(NET_AUDIO_TYPE)) ||
+		posix_memalign((void**)&outBuf, CACHE_LINE_SIZE, periodSamples * sizeof(NET_AUDIO_TYPE)))
+	{
+		cerr << "Cannot allocate memory for the jitter buffer" << endl;
+		abort();
+	}
+
+	for (i=0; i<JITTER_BUF_SLOTS; i++)
+	{
+		slotValid[i] = false;
+	}
+
+	memset(outBuf, 0, periodSamples * sizeof(NET_AUDIO_TYPE));
+	concealGain = 0;
+	nConcealed = JITTER_MAX_CONCEAL;
+
+	isPlaying = false;
+	isCompressing = false;
+	hasData = false;
+	nextId = 0;
+	latestId = 0;
+	prevTransit = 0;
+	jitter = 0;
+	targetDepth = minDepth;
+	curDepth = 0;
+
+	nPeriods.store(0);
+	fillSum.store(0);
+	minFill.store(INT_MAX);
+	maxFill.store(0);
+	statTargetDepth.store(targetDepth);
+	statJitter.store(0);
+	concealed.store(0);
+	late.store(0);
+	reordered.store(0);
+	compressed.store(0);
+	windowOverflows.store(0);
+	resetRequested.store(0);
+	prevInputOverflows = 0;
+}
+
+
+JitterBuffer::~JitterBuffer()
+{
+	free(outBuf);
+	free(windowData);
+}
+
+
+bool JitterBuffer::hasPeriod(uint64_t _id)
+{
+	int	ind = _id % JITTER_BUF_SLOTS;
+
+	return(slotValid[ind] && slotIds[ind] == _id);
+}
+
+
+NET_AUDIO_TYPE* JitterBuffer::slot(uint64_t _id)
+{
+	return(windowData + (_id % JITTER_BUF_SLOTS) * periodSamples);
+}
+
+
+void JitterBuffer::insertPeriod(NET_AUDIO_TYPE* _data, ChunkAttrib* _attrib)
+{
+	uint64_t	id = _attrib->id;
+	double		transit;
+	int			i;
+
+	// Estimate the jitter from the arrival times (RFC 3550, section 6.4.1).
+	// The ids are consecutive, so id * periodDuration is the sending time
+	// up to a constant offset.
+	transit = double(_attrib->timestamp) - double(id) * periodDuration;
+	if (hasData)
+	{
+		jitter += (fabs(transit - prevTransit) - jitter) / 16;
+	}
+	prevTransit = transit;
+
+	targetDepth = int(ceil(JITTER_MARGIN * jitter / periodDuration)) + 1;
+	targetDepth = (targetDepth > minDepth) ? targetDepth : minDepth;
+	targetDepth = (targetDepth < JITTER_BUF_SLOTS / 2) ? targetDepth : JITTER_BUF_SLOTS / 2;
+
+	if (!hasData)
+	{
+		hasData = true;
+		nextId = id;
+		latestId = id;
+	}
+
+	if (id < nextId)
+	{
+		late.store(late.load() + 1);
+		return;
+	}
+
+	// Too far ahead - the sender was restarted or the link was down for a
+	// long time. Start over from this period.
+	if (id >= nextId + JITTER_BUF_SLOTS - 1)
+	{
+		windowOverflows.store(windowOverflows.load() + 1);
+		for (i=0; i<JITTER_BUF_SLOTS; i++)
+		{
+			slotValid[i] = false;
+		}
+		nextId = id;
+		latestId = id;
+		isPlaying = false;
+		inputRate.reset();
+	}
+
+	if (id < latestId)
+	{
+		reordered.store(reordered.load() + 1);
+	}
+	else
+	{
+		latestId = id;
+		inputRate.addSample(double(_attrib->timestamp), id);
+	}
+
+	memcpy(slot(id), _data, periodSamples * sizeof(NET_AUDIO_TYPE));
+	slotIds[id % JITTER_BUF_SLOTS] = id;
+	slotValid[id % JITTER_BUF_SLOTS] = true;
+}
+
+
+void JitterBuffer::drainInput()
+{
+	NET_AUDIO_TYPE*	data;
+	ChunkAttrib			attrib;
+
+	while ((data = input->getChunk(&attrib)))
+	{
+		insertPeriod(data, &attrib);
+	}
+}
+
+
+void JitterBuffer::crossFade(NET_AUDIO_TYPE* _from, NET_AUDIO_TYPE* _to)
+{
+	int		i;
+	float	w;
+	float	step = 1.0f / periodSamples;
+
+	// _from may be outBuf itself
+	for (i=0; i<periodSamples; i++)
+	{
+		w = i * step;
+		outBuf[i] = NET_AUDIO_TYPE(_from[i] * (1 - w) + _to[i] * w);
+	}
+}
+
+
+void JitterBuffer::conceal()
+{
+	int	i;
+
+	// Repeat the last period, attenuated
+	if (nConcealed >= JITTER_MAX_CONCEAL)
+	{
+		memset(outBuf, 0, periodSamples * sizeof(NET_AUDIO_TYPE));
+		concealGain = 0;
+		return;
+	}
+
+	for (i=0; i<periodSamples; i++)
+	{
+		outBuf[i] = NET_AUDIO_TYPE(outBuf[i] * JITTER_CONCEAL_DECAY);
+	}
+
+	concealGain *= JITTER_CONCEAL_DECAY;
+	nConcealed++;
+}
+
+
+void JitterBuffer::updateStats(int _fill)
+{
+	if (resetRequested.testAndSetAcquire(1, 0))
+	{
+		nPeriods.store(0);
+		fillSum.store(0);
+		minFill.store(INT_MAX);
+		maxFill.store(0);
+		concealed.store(0);
+		late.store(0);
+		reordered.store(0);
+		compressed.store(0);
+		windowOverflows.store(0);
+	}
+
+	nPeriods.store(nPeriods.load() + 1);
+	fillSum.store(fillSum.load() + _fill);
+	if (_fill < minFill.load())
+	{
+		minFill.store(_fill);
+	}
+	if (_fill > maxFill.load())
+	{
+		maxFill.store(_fill);
+	}
+	statTargetDepth.store(targetDepth);
+	statJitter.store(int(jitter * 1000));
+}
+
+
+NET_AUDIO_TYPE* JitterBuffer::getPeriod()
+{
+	int	depth;
+
+	drainInput();
+
+	// Number of periods up to the latest one received, including the
+	// missing ones
+	depth = (hasData && latestId >= nextId) ? int(latestId - nextId + 1) : 0;
+	curDepth = depth;
+
+	updateStats(depth);
+
+	// Wait until the buffer is filled up to the target depth
+	if (!isPlaying)
+	{
+		if (depth < targetDepth)
+		{
+			conceal();
+			return(outBuf);
+		}
+		isPlaying = true;
+	}
+
+	// Once the depth exceeds the target by more than the hysteresis, reduce
+	// it all the way down to the target
+	if (depth > targetDepth + JITTER_HYSTERESIS)
+	{
+		isCompressing = true;
+	}
+	else if (depth <= targetDepth)
+	{
+		isCompressing = false;
+	}
+
+	if (isCompressing && hasPeriod(nextId) && hasPeriod(nextId+1))
+	{
+		// Too much latency - play two periods in the time of one
+		crossFade(slot(nextId), slot(nextId+1));
+		nextId += 2;
+		compressed.store(compressed.load() + 1);
+		concealGain = 1;
+		nConcealed = 0;
+	}
+	else if (hasPeriod(nextId))
+	{
+		if (concealGain < 1)
+		{
+			// Fade from the concealment to the real data
+			crossFade(outBuf, slot(nextId));
+		}
+		else
+		{
+			memcpy(outBuf, slot(nextId), periodSamples * sizeof(NET_AUDIO_TYPE));
+		}
+		nextId++;
+		concealGain = 1;
+		nConcealed = 0;
+	}
+	else
+	{
+		conceal();
+		concealed.store(concealed.load() + 1);
+
+		// If later periods are already here, this one is lost. Otherwise
+		// the data is just late; wait for it, which increases the latency.
+		if (depth > 0)
+		{
+			nextId++;
+		}
+		else
+		{
+			isPlaying = false;
+		}
+	}
+
+	return(outBuf);
+}
+
+
+void JitterBuffer::getStats(PlaybackStats* _stats)
+{
+	uint64_t	inputOverflows = input->getOverflows();
+
+	_stats->nPeriods = nPeriods.load();
+	_stats->minFill = (_stats->nPeriods) ? minFill.load() : 0;
+	_stats->maxFill = maxFill.load();
+	_stats->meanFill = (_stats->nPeriods) ? double(fillSum.load()) / _stats->nPeriods : 0;
+	_stats->targetDepth = statTargetDepth.load();
+	_stats->jitter = double(statJitter.load()) / 1000;
+	_stats->concealed = concealed.load();
+	_stats->late = late.load();
+	_stats->reordered = reordered.load();
+	_stats->compressed = compressed.load();
+	_stats->overflows = windowOverflows.load() + inputOverflows - prevInputOverflows;
+
+	prevInputOverflows = inputOverflows;
+	resetRequested.storeRelease(1);
+}
@@ -0,0 +1,144 @@
+/*
+ * jitterbuffer.h
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JITTERBUFFER_H_
+#define JITTERBUFFER_H_
+
+#include <stdint.h>
+#include <QAtomicInteger>
+
+#include "config.h"
+#include "nonblockingbuffer.h"
+#include "rateestimator.h"
+
+//! Playback statistics of a JitterBuffer.
+typedef struct
+{
+	uint64_t	nPeriods;		// number of periods played
+	int			minFill;		// in periods, seen at playback time
+	int			maxFill;
+	double		meanFill;
+	int			targetDepth;	// in periods, current value
+	double		jitter;			// in milliseconds, current estimate
+	uint64_t	concealed;		// periods synthesized in place of missing ones during playback
+	uint64_t	late;			// periods discarded because they arrived too late
+	uint64_t	reordered;		// periods that arrived out of order
+	uint64_t	compressed;		// periods skipped to reduce the latency
+	uint64_t	overflows;		// periods discarded because the buffers were full
+} PlaybackStats;
+
+
+//! Adaptive jitter buffer for the received audio.
+/*!
+ * The received periods go through a NonBlockingBuffer in the order of
+ * arrival. The jitter buffer, which runs entirely in the playback thread,
+ * moves them into a window keyed by the chunk id, so that the periods are
+ * played in the order they were recorded regardless of the arrival order.
+ *
+ * The arrival time jitter is estimated the same way as in RTP (RFC 3550)
+ * and the target depth of the buffer is set to JITTER_MARGIN times the
+ * jitter, but at least to the minimum depth given to the constructor. If the
+ * buffer holds more than the target plus JITTER_HYSTERESIS, pairs of periods
+ * are cross-faded into one until the depth is back at the target. A missing period is
+ * concealed by repeating the last played one, attenuated by
+ * JITTER_CONCEAL_DECAY each time; after JITTER_MAX_CONCEAL periods the
+ * output fades to silence. When the real data returns, it is cross-faded
+ * with the concealment.
+ *
+ * getStats() can be called from any thread, the other methods only from
+ * the playback thread.
+ */
+class JitterBuffer
+{
+public:
+	JitterBuffer(NonBlockingBuffer* _input, int _framesPerPeriod, int _sampRate, int _minDepth);
+	virtual ~JitterBuffer();
+
+	/*!
+	 * Return the next period to be played. The period stays valid until the
+	 * next call. Never blocks.
+	 */
+	NET_AUDIO_TYPE* getPeriod();
+
+	//! Depth of the buffer (in periods) at the last getPeriod() call.
+	int getDepth() { return(curDepth); }
+
+	//! Current target depth, in periods.
+	int getTargetDepth() { return(targetDepth); }
+
+	//! Rate at which the periods arrive (per second), 0 if not known yet.
+	double getInputRate() { return(inputRate.getRate()); }
+
+	//! Return the statistics collected since the previous call.
+	void getStats(PlaybackStats* _stats);
+
+private:
+	void drainInput();
+	void insertPeriod(NET_AUDIO_TYPE* _data, ChunkAttrib* _attrib);
+	bool hasPeriod(uint64_t _id);
+	NET_AUDIO_TYPE* slot(uint64_t _id);
+	void crossFade(NET_AUDIO_TYPE* _from, NET_AUDIO_TYPE* _to);
+	void conceal();
+	void updateStats(int _fill);
+
+	NonBlockingBuffer*	input;
+	int					periodSamples;
+	double				periodDuration;		// in milliseconds
+	int					minDepth;			// in periods
+
+	// Window of periods, slot i holds the period with id == i modulo
+	// JITTER_BUF_SLOTS
+	NET_AUDIO_TYPE*	windowData;
+	uint64_t			slotIds[JITTER_BUF_SLOTS];
+	bool				slotValid[JITTER_BUF_SLOTS];
+
+	NET_AUDIO_TYPE*	outBuf;				// period returned by getPeriod()
+	float				concealGain;		// gain of the concealment in outBuf, 1 if not concealing
+	int					nConcealed;			// number of consecutive concealed periods
+
+	bool				isPlaying;
+	bool				isCompressing;
+	bool				hasData;
+	uint64_t			nextId;				// id of the next period to play
+	uint64_t			latestId;			// largest id received
+	double				prevTransit;
+	double				jitter;
+	int					targetDepth;
+	int					curDepth;
+	RateEstimator		inputRate;
+
+	// Statistics. Written by the playback thread, which also does the reset
+	// requested by getStats().
+	QAtomicInteger<quint64>	nPeriods;
+	QAtomicInteger<quint64>	fillSum;
+	QAtomicInt				minFill;
+	QAtomicInt				maxFill;
+	QAtomicInt				statTargetDepth;
+	QAtomicInt				statJitter;			// in microseconds
+	QAtomicInteger<quint64>	concealed;
+	QAtomicInteger<quint64>	late;
+	QAtomicInteger<quint64>	reordered;
+	QAtomicInteger<quint64>	compressed;
+	QAtomicInteger<quint64>	windowOverflows;
+	QAtomicInt				resetRequested;
+	uint64_t				prevInputOverflows;	// accessed by getStats() only
+};
+
+#endif /* JITTERBUFFER_H_ */
@@ -0,0 +1,301 @@
+/*
+ * jpegcompressor.cpp
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdlib>
+#include <stdio.h>
+#include <iostream>
+
+#include "config.h"
+#include "jpegcompressor.h"
+
+using namespace std;
+
+// Allocate the planes of a YUV frame, if needed
+static void allocPlanes(PixelFormat _format, int _width, int _height, unsigned char** _planes)
+{
+	int		chromaSize = _width * _height / pixelFormatChromaDiv(_format);
+
+	if(_format != PIXEL_YUV422 && _format != PIXEL_YUV411)
+	{
+		_planes[0] = _planes[1] = _planes[2] = NULL;
+		return;
+	}
+
+	_planes[0] = (unsigned char*)malloc(_width * _height + 2 * chromaSize);
+	if(!_planes[0])
+	{
+		cerr << "Error allocating memory!" << endl;
+		abort();
+	}
+	_planes[1] = _planes[0] + _width * _height;
+	_planes[2] = _planes[1] + chromaSize;
+}
+
+
+// Allocate the RGB frame for a Bayer format and find its demosaic function
+static void initDemosaic(PixelFormat _format, DemosaicMethod _method, int _width, int _height, unsigned char** _rgbFrame, DemosaicFunc* _func)
+{
+	if(!isBayer(_format))
+	{
+		*_rgbFrame = NULL;
+		*_func = NULL;
+		return;
+	}
+
+	*_func = getDemosaicFunc(_format, _method);
+	*_rgbFrame = (unsigned char*)malloc(_width * _height * 3);
+	if(!*_rgbFrame)
+	{
+		cerr << "Error allocating memory!" << endl;
+		abort();
+	}
+}
+
+
+#ifdef HAVE_TURBOJPEG
+
+JpegCompressor::JpegCompressor(PixelFormat _format, int _width, int _height, int _jpgQuality, DemosaicMethod _demosaic)
+{
+	format = _format;
+	width = _width;
+	height = _height;
+	bufSize = JPEG_BUF_SIZE(width, height);
+	jpgQuality = _jpgQuality;
+	allocPlanes(format, width, height, planes);
+	initDemosaic(format, _demosaic, width, height, &rgbFrame, &demosaicFunc);
+
+	handle = tjInitCompress();
+	if(!handle)
+	{
+		cerr << "Error initializing the JPEG compressor: " << tjGetErrorStr() << endl;
+		abort();
+	}
+}
+
+
+JpegCompressor::~JpegCompressor()
+{
+	tjDestroy(handle);
+	free(planes[0]);
+	free(rgbFrame);
+}
+
+
+int JpegCompressor::compress(const unsigned char* _raw, unsigned char* _dst)
+{
+	unsigned long	jpgSize = bufSize;
+	int				rc;
+
+	// The destination is large enough for any frame, so TurboJPEG never
+	// needs to reallocate it
+	switch(format)
+	{
+	case PIXEL_YUV422:
+	case PIXEL_YUV411:
+		deinterleaveYuv(format, _raw, width * height, planes[0], planes[1], planes[2]);
+		if(format == PIXEL_YUV422)
+		{
+			averageRowPairs(planes[1], width / 2, height);
+			averageRowPairs(planes[2], width / 2, height);
+		}
+		rc = tjCompressFromYUVPlanes(handle, (const unsigned char**)planes, width, NULL, height, (format == PIXEL_YUV422 ? TJSAMP_420 : TJSAMP_411),
+		                             &_dst, &jpgSize, jpgQuality, TJFLAG_NOREALLOC);
+		break;
+
+	case PIXEL_MONO8:
+	case PIXEL_RGB8:
+		rc = tjCompress2(handle, (unsigned char*)_raw, width, 0, height, (format == PIXEL_RGB8 ? TJPF_RGB : TJPF_GRAY),
+		                 &_dst, &jpgSize, (format == PIXEL_RGB8 ? TJSAMP_420 : TJSAMP_GRAY), jpgQuality, TJFLAG_NOREALLOC);
+		break;
+
+	default:
+		demosaicFunc(_raw, width, height, rgbFrame);
+		rc = tjCompress2(handle, rgbFrame, width, 0, height, TJPF_RGB, &_dst, &jpgSize, TJSAMP_420, jpgQuality, TJFLAG_NOREALLOC);
+	}
+
+	if(rc)
+	{
+		cerr << "Error compressing the frame: " << tjGetErrorStr() << endl;
+		abort();
+	}
+
+	return(jpgSize);
+}
+
+#else
+
+// libjpeg destination manager callbacks. The compressed image is written
+// directly to the destination, which is large enough for any frame, so the
+// buffer should never need to be emptied.
+static void initDestination(j_compress_ptr)
+{
+}
+
+
+static boolean emptyOutputBuffer(j_compress_ptr)
+{
+	cerr << "Compressed frame does not fit into the reserved space!" << endl;
+	abort();
+}
+
+
+static void termDestination(j_compress_ptr)
+{
+}
+
+
+JpegCompressor::JpegCompressor(PixelFormat _format, int _width, int _height, int _jpgQuality, DemosaicMethod _demosaic)
+{
+	bool	isYuv;
+	int		chromaDiv;
+	int		i;
+
+	format = _format;
+	width = _width;
+	height = _height;
+	bufSize = JPEG_BUF_SIZE(width, height);
+	vDiv = 1;
+	jpgQuality = _jpgQuality;
+	isYuv = (format == PIXEL_YUV422 || format == PIXEL_YUV411);
+	allocPlanes(format, width, height, planes);
+	initDemosaic(format, _demosaic, width, height, &rgbFrame, &demosaicFunc);
+
+	rows[0] = (JSAMPROW*)malloc(3 * height * sizeof(JSAMPROW));
+	if(!rows[0])
+	{
+		cerr << "Error allocating memory!" << endl;
+		abort();
+	}
+	rows[1] = rows[0] + height;
+	rows[2] = rows[1] + height;
+
+	// Initialize JPEG
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_compress(&cinfo);
+
+	dest.init_destination = initDestination;
+	dest.empty_output_buffer = emptyOutputBuffer;
+	dest.term_destination = termDestination;
+	cinfo.dest = &dest;
+
+	// Set the parameters of the output file. They stay the same for all
+	// the frames, as do the tables computed from them.
+	cinfo.image_width = width;
+	cinfo.image_height = height;
+	cinfo.input_components = (format == PIXEL_MONO8 ? 1 : 3);
+	cinfo.in_color_space = (format == PIXEL_MONO8 ? JCS_GRAYSCALE : (isYuv ? JCS_YCbCr : JCS_RGB));
+
+	// Use default compression parameters
+	jpeg_set_defaults(&cinfo);
+	jpeg_set_quality(&cinfo, jpgQuality, TRUE);
+
+	if(isYuv)
+	{
+		// The planes are passed as they are, with the luma sampled
+		// chromaDiv times as densely as the chroma horizontally and
+		// vDiv times vertically
+		chromaDiv = pixelFormatChromaDiv(format);
+		vDiv = (format == PIXEL_YUV422 ? 2 : 1);
+		cinfo.raw_data_in = TRUE;
+		cinfo.comp_info[0].h_samp_factor = chromaDiv;
+		cinfo.comp_info[0].v_samp_factor = vDiv;
+		for(i=1; i<3; i++)
+		{
+			cinfo.comp_info[i].h_samp_factor = 1;
+			cinfo.comp_info[i].v_samp_factor = 1;
+		}
+
+		for(i=0; i<height; i++)
+		{
+			rows[0][i] = planes[0] + i * width;
+			rows[1][i] = planes[1] + i * (width / chromaDiv);
+			rows[2][i] = planes[2] + i * (width / chromaDiv);
+		}
+	}
+}
+
+
+JpegCompressor::~JpegCompressor()
+{
+	jpeg_destroy_compress(&cinfo);
+	free(planes[0]);
+	free(rgbFrame);
+	free(rows[0]);
+}
+
+
+int JpegCompressor::compress(const unsigned char* _raw, unsigned char* _dst)
+{
+	JSAMPARRAY	planeRows[3];
+	int			i;
+
+	dest.next_output_byte = _dst;
+	dest.free_in_buffer = bufSize;
+
+	if(cinfo.raw_data_in)
+	{
+		deinterleaveYuv(format, _raw, width * height, planes[0], planes[1], planes[2]);
+		if(vDiv == 2)
+		{
+			averageRowPairs(planes[1], width / 2, height);
+			averageRowPairs(planes[2], width / 2, height);
+		}
+
+		// The raw data goes in one MCU row (vDiv * DCTSIZE lines of luma)
+		// at a time
+		jpeg_start_compress(&cinfo, TRUE);
+		while(cinfo.next_scanline < cinfo.image_height)
+		{
+			planeRows[0] = rows[0] + cinfo.next_scanline;
+			for(i=1; i<3; i++)
+			{
+				planeRows[i] = rows[i] + cinfo.next_scanline / vDiv;
+			}
+			jpeg_write_raw_data(&cinfo, planeRows, vDiv * DCTSIZE);
+		}
+		jpeg_finish_compress(&cinfo);
+
+		return(bufSize - dest.free_in_buffer);
+	}
+
+	if(rgbFrame)
+	{
+		demosaicFunc(_raw, width, height, rgbFrame);
+		_raw = rgbFrame;
+	}
+
+	for(i=0; i<height; i++)
+	{
+		rows[0][i] = (JSAMPROW)(_raw + i * width * cinfo.input_components);
+	}
+
+	// Pass the whole frame at once; the tables are written to every frame,
+	// so that each one is a complete JPEG image
+	jpeg_start_compress(&cinfo, TRUE);
+	while(cinfo.next_scanline < cinfo.image_height)
+	{
+		jpeg_write_scanlines(&cinfo, rows[0] + cinfo.next_scanline, cinfo.image_height - cinfo.next_scanline);
+	}
+	jpeg_finish_compress(&cinfo);
+
+	return(bufSize - dest.free_in_buffer);
+}
+
+#endif
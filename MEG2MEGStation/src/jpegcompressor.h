@@ -0,0 +1,97 @@
+/*
+ * jpegcompressor.h
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JPEGCOMPRESSOR_H_
+#define JPEGCOMPRESSOR_H_
+
+#include <stdio.h>
+
+#ifdef HAVE_TURBOJPEG
+#include <turbojpeg.h>
+#else
+#include <jpeglib.h>
+#endif
+
+#include "config.h"
+#include "pixelformat.h"
+#include "demosaic.h"
+
+//! Compresses raw camera frames to JPEG.
+/*!
+ * The frames are _width x _height, in any of the PixelFormat formats (see
+ * checkVideoFormat() for the sizes allowed). An object can only be used by one thread at a time; threads
+ * compressing in parallel need one object each.
+ *
+ * The encoder is set up once in the constructor and reused for all the
+ * frames, so compressing a frame allocates no memory and does not rebuild
+ * the quantization and Huffman tables. The TurboJPEG API of libjpeg-turbo
+ * is used if it was found at build time (HAVE_TURBOJPEG), the libjpeg API
+ * otherwise.
+ *
+ * RGB frames give 4:2:0 JPEG. YUV frames are split into planes, which go
+ * to the encoder as they are (raw data input), so there is no color
+ * conversion. The chroma of YUV422 frames is averaged over pairs of rows to
+ * give 4:2:0 JPEG; YUV411 frames give 4:1:1 JPEG, which has as many chroma
+ * samples. Bayer frames are demosaiced to RGB first, with the _demosaic
+ * method, and then compressed like RGB frames.
+ */
+class JpegCompressor
+{
+public:
+	JpegCompressor(PixelFormat _format, int _width, int _height, int _jpgQuality, DemosaicMethod _demosaic=DEMOSAIC_BILINEAR);
+	virtual ~JpegCompressor();
+
+	/*!
+	 * Compress the frame _raw to _dst, which should have room for
+	 * JPEG_BUF_SIZE(_width, _height) bytes. Return the size of the
+	 * compressed frame.
+	 */
+	int compress(const unsigned char* _raw, unsigned char* _dst);
+
+private:
+	// The encoder holds pointers to itself, so it cannot be copied
+	JpegCompressor(const JpegCompressor&);
+	JpegCompressor& operator=(const JpegCompressor&);
+
+	PixelFormat		format;
+	int				width;
+	int				height;
+	int				bufSize;		// in bytes, see JPEG_BUF_SIZE
+	int				jpgQuality;
+
+	// Y, U and V planes of a YUV frame
+	unsigned char*	planes[3];
+
+	// Demosaiced Bayer frame and the function producing it
+	unsigned char*	rgbFrame;
+	DemosaicFunc	demosaicFunc;
+
+#ifdef HAVE_TURBOJPEG
+	tjhandle					handle;
+#else
+	struct jpeg_compress_struct	cinfo;
+	struct jpeg_error_mgr		jerr;
+	struct jpeg_destination_mgr	dest;
+	JSAMPROW*					rows[3];	// rows of the frame or of the planes
+	int							vDiv;		// vertical chroma subsampling of the planes
+#endif
+};
+
+#endif /* JPEGCOMPRESSOR_H_ */
@@ -0,0 +1,330 @@
+/*
+ * levelmeter.cpp
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(__GNUC__) && defined(__x86_64__)
+// The AVX2 version is compiled regardless of the compiler flags and used
+// only if the CPU supports it
+#define HAVE_AVX2_KERNEL
+#include <immintrin.h>
+#endif
+
+#include "levelmeter.h"
+
+//---------------------------------------------------------------------
+// Measuring periods of 16-bit audio. The SIMD loops keep the peak and the
+// sum of squares of every lane; as the number of lanes is a multiple of the
+// number of channels, lane j always holds channel j % _nChans.
+//
+
+#define S16_SCALE	(1.0f / 32768)
+
+
+// Add the per-lane results to the per-channel ones
+static void foldLanes(const int16_t* _laneMax, const float* _laneSq, int _nLanes, int _nChans, float* _peaks, float* _sumSquares)
+{
+	int		j;
+	int		ch;
+	float	v;
+
+	for (j=0; j<_nLanes; j++)
+	{
+		ch = j % _nChans;
+		v = _laneMax[j] * S16_SCALE;
+		_peaks[ch] = (_peaks[ch] >= v) ? _peaks[ch] : v;
+		_sumSquares[ch] += _laneSq[j] * (S16_SCALE * S16_SCALE);
+	}
+}
+
+
+// Samples left over after the SIMD loop, starting at a frame boundary
+static void measureTail(const int16_t* _data, int _nSamples, int _nChans, float* _peaks, float* _sumSquares)
+{
+	int		i;
+	int		ch;
+	float	v;
+
+	for (i=0; i<_nSamples; i++)
+	{
+		ch = i % _nChans;
+		v = fabsf(_data[i]) * S16_SCALE;
+		_peaks[ch] = (_peaks[ch] >= v) ? _peaks[ch] : v;
+		_sumSquares[ch] += v * v;
+	}
+}
+
+
+#ifdef __SSE2__
+static void measureS16Sse2(const int16_t* _data, int _nSamples, int _nChans, float* _peaks, float* _sumSquares)
+{
+	__m128i	zero = _mm_setzero_si128();
+	__m128i	maxAbs = zero;
+	__m128	acc0 = _mm_setzero_ps();
+	__m128	acc1 = _mm_setzero_ps();
+	int16_t	laneMax[8];
+	float	laneSq[8];
+	int		i = 0;
+
+	for (; i+8<=_nSamples; i+=8)
+	{
+		__m128i	x = _mm_loadu_si128((const __m128i*)(_data + i));
+		__m128	lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16));
+		__m128	hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16));
+
+		// The absolute value of -32768 saturates to 32767
+		maxAbs = _mm_max_epi16(maxAbs, _mm_max_epi16(x, _mm_subs_epi16(zero, x)));
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(lo, lo));
+		acc1 = _mm_add_ps(acc1, _mm_mul_ps(hi, hi));
+	}
+
+	_mm_storeu_si128((__m128i*)laneMax, maxAbs);
+	_mm_storeu_ps(laneSq, acc0);
+	_mm_storeu_ps(laneSq + 4, acc1);
+
+	foldLanes(laneMax, laneSq, 8, _nChans, _peaks, _sumSquares);
+	measureTail(_data + i, _nSamples - i, _nChans, _peaks, _sumSquares);
+}
+#endif
+
+
+#ifdef HAVE_AVX2_KERNEL
+__attribute__((target("avx2")))
+static void measureS16Avx2(const int16_t* _data, int _nSamples, int _nChans, float* _peaks, float* _sumSquares)
+{
+	__m256i	zero = _mm256_setzero_si256();
+	__m256i	maxAbs = zero;
+	__m256	acc0 = _mm256_setzero_ps();
+	__m256	acc1 = _mm256_setzero_ps();
+	int16_t	laneMax[16];
+	float	laneSq[16];
+	int		i = 0;
+
+	for (; i+16<=_nSamples; i+=16)
+	{
+		__m256i	x = _mm256_loadu_si256((const __m256i*)(_data + i));
+		__m256	lo = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(x)));
+		__m256	hi = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(x, 1)));
+
+		maxAbs = _mm256_max_epi16(maxAbs, _mm256_max_epi16(x, _mm256_subs_epi16(zero, x)));
+		acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(lo, lo));
+		acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(hi, hi));
+	}
+
+	_mm256_storeu_si256((__m256i*)laneMax, maxAbs);
+	_mm256_storeu_ps(laneSq, acc0);
+	_mm256_storeu_ps(laneSq + 8, acc1);
+
+	foldLanes(laneMax, laneSq, 16, _nChans, _peaks, _sumSquares);
+	measureTail(_data + i, _nSamples - i, _nChans, _peaks, _sumSquares);
+}
+#endif
+
+
+#ifdef __ARM_NEON
+static void measureS16Neon(const int16_t* _data, int _nSamples, int _nChans, float* _peaks, float* _sumSquares)
+{
+	int16x8_t	maxAbs = vdupq_n_s16(0);
+	float32x4_t	acc0 = vdupq_n_f32(0);
+	float32x4_t	acc1 = vdupq_n_f32(0);
+	int16_t		laneMax[8];
+	float		laneSq[8];
+	int			i = 0;
+
+	for (; i+8<=_nSamples; i+=8)
+	{
+		int16x8_t	x = vld1q_s16(_data + i);
+		float32x4_t	lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(x)));
+		float32x4_t	hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(x)));
+
+		maxAbs = vmaxq_s16(maxAbs, vqabsq_s16(x));
+		acc0 = vmlaq_f32(acc0, lo, lo);
+		acc1 = vmlaq_f32(acc1, hi, hi);
+	}
+
+	vst1q_s16(laneMax, maxAbs);
+	vst1q_f32(laneSq, acc0);
+	vst1q_f32(laneSq + 4, acc1);
+
+	foldLanes(laneMax, laneSq, 8, _nChans, _peaks, _sumSquares);
+	measureTail(_data + i, _nSamples - i, _nChans, _peaks, _sumSquares);
+}
+#endif
+
+
+static quint32 floatBits(float _v)
+{
+	quint32	bits;
+
+	memcpy(&bits, &_v, sizeof(bits));
+	return(bits);
+}
+
+
+static float bitsFloat(quint32 _bits)
+{
+	float	v;
+
+	memcpy(&v, &_bits, sizeof(v));
+	return(v);
+}
+
+
+//---------------------------------------------------------------------
+// LevelMeter
+//
+
+LevelMeter::LevelMeter(CycDataBuffer* _cycBuf, AudioFormat _format)
+{
+	int	ch;
+
+	format = _format;
+	nChans = format.getChans();
+
+	// All the SIMD versions need the number of lanes to be a multiple of
+	// the number of channels
+	measureS16 = NULL;
+	if (format.getFormat() == SAMPLE_S16 && 8 % nChans == 0)
+	{
+#ifdef __SSE2__
+		measureS16 = measureS16Sse2;
+#endif
+#ifdef __ARM_NEON
+		measureS16 = measureS16Neon;
+#endif
+#ifdef HAVE_AVX2_KERNEL
+		if (__builtin_cpu_supports("avx2"))
+		{
+			measureS16 = measureS16Avx2;
+		}
+#endif
+	}
+
+	for (ch=0; ch<AUDIO_MAX_CHANS; ch++)
+	{
+		queueFront[ch] = 0;
+		queueLen[ch] = 0;
+		windowSumSquares[ch] = 0;
+		peaks[ch].store(floatBits(0));
+		rms[ch].store(floatBits(0));
+	}
+	windowFrames = 0;
+	nPeriods = 0;
+
+	dispatcher = new ConsumerDispatcher(_cycBuf, this, LATENCY_INTERACTIVE, DISPATCH_ALL);
+	dispatcher->start();
+}
+
+
+LevelMeter::~LevelMeter()
+{
+	dispatcher->stop();
+	delete dispatcher;
+}
+
+
+void LevelMeter::consumeChunks(CycDataBuffer*, ChunkRef* _chunks, int _nChunks)
+{
+	int	i;
+
+	for (i=0; i<_nChunks; i++)
+	{
+		addPeriod(_chunks[i].data, _chunks[i].attrib.chunkSize / format.getFrameSize());
+	}
+}
+
+
+void LevelMeter::addPeriod(const void* _data, int _nFrames)
+{
+	float	periodPeaks[AUDIO_MAX_CHANS] = {0};
+	float	periodSumSquares[AUDIO_MAX_CHANS] = {0};
+	int		slot = nPeriods % N_BUF_4_VOL_IND;
+	int		ch;
+	int		back;
+
+	if (measureS16)
+	{
+		measureS16((const int16_t*)_data, _nFrames * nChans, nChans, periodPeaks, periodSumSquares);
+	}
+	else
+	{
+		format.measureLevels(_data, _nFrames, periodPeaks, periodSumSquares);
+	}
+
+	// The new period replaces the oldest one in the window
+	if (nPeriods >= N_BUF_4_VOL_IND)
+	{
+		windowFrames -= nFrames[slot];
+		for (ch=0; ch<nChans; ch++)
+		{
+			windowSumSquares[ch] -= sumSquares[slot][ch];
+		}
+	}
+	nFrames[slot] = _nFrames;
+	windowFrames += _nFrames;
+
+	for (ch=0; ch<nChans; ch++)
+	{
+		sumSquares[slot][ch] = periodSumSquares[ch];
+		windowSumSquares[ch] += periodSumSquares[ch];
+
+		// Drop the peak that has left the window, and all the peaks that
+		// can't be the maximum any more
+		if (queueLen[ch] && peakPeriod[ch][queueFront[ch]] + N_BUF_4_VOL_IND <= nPeriods)
+		{
+			queueFront[ch] = (queueFront[ch] + 1) % N_BUF_4_VOL_IND;
+			queueLen[ch]--;
+		}
+
+		while (queueLen[ch] && peakQueue[ch][(queueFront[ch] + queueLen[ch] - 1) % N_BUF_4_VOL_IND] <= periodPeaks[ch])
+		{
+			queueLen[ch]--;
+		}
+
+		back = (queueFront[ch] + queueLen[ch]) % N_BUF_4_VOL_IND;
+		peakQueue[ch][back] = periodPeaks[ch];
+		peakPeriod[ch][back] = nPeriods;
+		queueLen[ch]++;
+
+		peaks[ch].store(floatBits(peakQueue[ch][queueFront[ch]]));
+		rms[ch].store(floatBits(windowFrames ? sqrt(fmax(windowSumSquares[ch], 0) / windowFrames) : 0));
+	}
+
+	nPeriods++;
+}
+
+
+float LevelMeter::getPeak(int _chan)
+{
+	return(bitsFloat(peaks[_chan].load()));
+}
+
+
+float LevelMeter::getRms(int _chan)
+{
+	return(bitsFloat(rms[_chan].load()));
+}
@@ -0,0 +1,88 @@
+/*
+ * levelmeter.h
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LEVELMETER_H_
+#define LEVELMETER_H_
+
+#include <stdint.h>
+#include <QAtomicInteger>
+
+#include "config.h"
+#include "cycdatabuffer.h"
+#include "consumerdispatcher.h"
+#include "audioformat.h"
+
+//! Peak and RMS levels of the audio stream in a CycDataBuffer.
+/*!
+ * The levels are computed by the object's own ConsumerDispatcher, so the
+ * GUI thread only has to read them, at the display rate. Both are measured
+ * over the last N_BUF_4_VOL_IND periods and are relative to the full scale.
+ * Updating the window costs the same regardless of its length: the peaks
+ * are held in a monotonic queue and the RMS is a running sum.
+ *
+ * For 16-bit audio with 1, 2, 4 or 8 channels the periods are measured with
+ * SIMD instructions (SSE2, AVX2 if the CPU supports it, or NEON); otherwise
+ * with the generic code of AudioFormat.
+ */
+class LevelMeter : public ChunkConsumer
+{
+public:
+	LevelMeter(CycDataBuffer* _cycBuf, AudioFormat _format);
+	virtual ~LevelMeter();
+
+	virtual void consumeChunks(CycDataBuffer* _cycBuf, ChunkRef* _chunks, int _nChunks);
+
+	//! Peak absolute value of channel _chan, between 0 and 1. Can be called from any thread.
+	float getPeak(int _chan);
+
+	//! RMS value of channel _chan, between 0 and 1. Can be called from any thread.
+	float getRms(int _chan);
+
+private:
+	void addPeriod(const void* _data, int _nFrames);
+
+	AudioFormat			format;
+	int					nChans;
+	ConsumerDispatcher*	dispatcher;
+
+	// Function measuring a period of 16-bit audio, see levelmeter.cpp. NULL
+	// if the generic code has to be used.
+	void	(*measureS16)(const int16_t* _data, int _nSamples, int _nChans, float* _peaks, float* _sumSquares);
+
+	// Peaks of the periods in the window, decreasing from the front. Each
+	// channel has its own queue, stored in a ring of N_BUF_4_VOL_IND entries.
+	float				peakQueue[AUDIO_MAX_CHANS][N_BUF_4_VOL_IND];
+	uint64_t			peakPeriod[AUDIO_MAX_CHANS][N_BUF_4_VOL_IND];
+	int					queueFront[AUDIO_MAX_CHANS];
+	int					queueLen[AUDIO_MAX_CHANS];
+
+	// Sums of squares of the periods in the window and their total
+	float				sumSquares[N_BUF_4_VOL_IND][AUDIO_MAX_CHANS];
+	int					nFrames[N_BUF_4_VOL_IND];
+	double				windowSumSquares[AUDIO_MAX_CHANS];
+	int					windowFrames;
+	uint64_t			nPeriods;
+
+	// Published levels (bit patterns of floats)
+	QAtomicInteger<quint32>	peaks[AUDIO_MAX_CHANS];
+	QAtomicInteger<quint32>	rms[AUDIO_MAX_CHANS];
+};
+
+#endif /* LEVELMETER_H_ */
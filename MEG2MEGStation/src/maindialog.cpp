@@ -19,9 +19,13 @@
  */
 
 #include <iostream>
+#include <algorithm>
+#include <math.h>
+#include <string.h>
 
 #include "config.h"
 #include "maindialog.h"
+#include "datarates.h"
 
 using namespace std;
 
@@ -29,6 +33,7 @@ using namespace std;
 MainDialog::MainDialog(QWidget *parent)
     : QMainWindow(parent)
 {
+	DataRates	dataRates;
 
 	ui.setupUi(this);
 	setWindowFlags(Qt::WindowTitleHint);
@@ -43,23 +48,26 @@ MainDialog::MainDialog(QWidget *parent)
 	initVideo();
 
     // Set up audio recording
-    senderAudioBuf = new CycDataBuffer(CIRC_AUDIO_BUFF_SZ, false);
+    senderAudioBuf = new CycDataBuffer(CycDataBuffer::sizeForRate(dataRates.senderAudio), false, NULL, CycDataBuffer::parseHugePages(settings.bufHugePages), settings.bufLockMemory);
+    senderAudioBuf->setOverflowPolicy(CycDataBuffer::parseOverflowPolicy(settings.audioOverflowPolicy, true), settings.overflowBlockTimeout, settings.storagePath, uint64_t(settings.spillSize) * 1000000);
+    senderFormat = AudioFormat(AudioFormat::parseSampleFormat(settings.sampleFormat), settings.nSenderChans);
     microphoneThread = new MicrophoneThread(senderAudioBuf);
-    senderAudioFileWriter = new AudioFileWriter(senderAudioBuf, settings.storagePath, settings.siteId, true, N_CHANS_SENDER, ui.suffixEdit);
+    senderAudioFileWriter = new AudioFileWriter(senderAudioBuf, settings.storagePath, settings.siteId, true, senderFormat, ui.suffixEdit);
     sendingSocket = new SendingSocket();
-    QObject::connect(senderAudioBuf, SIGNAL(chunkReady(unsigned char*)), this, SLOT(onAudioUpdate(unsigned char*)));
-    QObject::connect(senderAudioBuf, SIGNAL(chunkReady(unsigned char*)), sendingSocket, SLOT(sendAudioPacket(unsigned char*)));
+    sendingSocket->setAudioBuffer(senderAudioBuf);
 
-	// Initialize volume indicator history
-	memset(volSenderMaxvals, 0, N_CHANS_SENDER * N_BUF_4_VOL_IND * sizeof(AUDIO_DATA_TYPE));
-	volSenderIndNext = 0;
+	// Set up the volume indicator; the meter starts measuring right away
+	senderMeter = new LevelMeter(senderAudioBuf, senderFormat);
+	volTimer = new QTimer(this);
+    QObject::connect(volTimer, SIGNAL(timeout()), this, SLOT(onAudioUpdate()));
 
-    ui.senderLevelLeft->setMaximum(MAX_AUDIO_VAL);
-    ui.senderLevelRight->setMaximum(MAX_AUDIO_VAL);
+    ui.senderLevelLeft->setMaximum(LEVEL_BAR_MAX);
+    ui.senderLevelRight->setMaximum(LEVEL_BAR_MAX);
 
     // Start audio running
     senderAudioFileWriter->start();
     microphoneThread->start();
+    volTimer->start(METER_UPDATE_INTERVAL);
 
     if(camera1)
     {
@@ -72,24 +80,40 @@ MainDialog::MainDialog(QWidget *parent)
     //
 
     // Set up audio recording
-    receiverAudioBuf = new CycDataBuffer(CIRC_AUDIO_BUFF_SZ, true);
-    receiverAudioFileWriter = new AudioFileWriter(receiverAudioBuf, settings.storagePath, settings.siteId, false, N_CHANS_RECEIVER, ui.suffixEdit);
+    receiverAudioBuf = new CycDataBuffer(CycDataBuffer::sizeForRate(dataRates.receiverAudio), true, NULL, CycDataBuffer::parseHugePages(settings.bufHugePages), settings.bufLockMemory);
+    receiverAudioBuf->setOverflowPolicy(CycDataBuffer::parseOverflowPolicy(settings.audioOverflowPolicy, true), settings.overflowBlockTimeout, settings.storagePath, uint64_t(settings.spillSize) * 1000000);
+    receiverAudioFileWriter = new AudioFileWriter(receiverAudioBuf, settings.storagePath, settings.siteId, false, receiverFormat, ui.suffixEdit);
 
-    // Initialize volume indicator history
-	memset(volReceiverMaxvals, 0, N_CHANS_RECEIVER * N_BUF_4_VOL_IND * sizeof(AUDIO_DATA_TYPE));
-	volReceiverIndNext = 0;
+    // Set up the volume indicator
+	receiverMeter = new LevelMeter(receiverAudioBuf, receiverFormat);
 
 	// Initialize speaker
-	speakerBuffer = new NonBlockingBuffer(settings.spkBufSz, settings.framesPerPeriod*N_CHANS_RECEIVER*sizeof(AUDIO_DATA_TYPE));
-	speakerThread = new SpeakerThread(speakerBuffer);
+	speakerBuffer = new NonBlockingBuffer(JITTER_BUF_SLOTS, settings.framesPerPeriod);
+	jitterBuffer = new JitterBuffer(speakerBuffer, settings.framesPerPeriod, settings.sampRate, settings.jitterMinDepth);
+	driftResampler = new DriftResampler(jitterBuffer, settings.framesPerPeriod, settings.sampRate, AudioFormat(AudioFormat::parseSampleFormat(settings.sampleFormat), settings.nReceiverChans));
+	speakerThread = new SpeakerThread(driftResampler);
 
-    ui.receiverLevelLeft->setMaximum(MAX_AUDIO_VAL);
+    ui.receiverLevelLeft->setMaximum(LEVEL_BAR_MAX);
 
     // Start audio running
     receiverAudioFileWriter->start();
     speakerThread->start();
 
-    receiverVideoBuf = new CycDataBuffer(CIRC_VIDEO_BUFF_SZ, true);
+    // Log the speaker buffer fill levels, for tuning its size, and the
+    // microphone's sample clock
+    playbackStatsTimer = new QTimer(this);
+    QObject::connect(playbackStatsTimer, SIGNAL(timeout()), this, SLOT(onPlaybackStats()));
+    QObject::connect(playbackStatsTimer, SIGNAL(timeout()), this, SLOT(onCaptureStats()));
+    playbackStatsTimer->start(PLAYBACK_STATS_INTERVAL);
+
+    memset(&remoteVideoFormat, 0, sizeof(remoteVideoFormat));
+    fragFrame = NULL;
+    fragFrameSize = 0;
+    fragFrameId = 0;
+    fragChunkSize = 0;
+    fragMissing = 0;
+    receiverVideoBuf = new CycDataBuffer(CycDataBuffer::sizeForRate(dataRates.receiverVideo), true, NULL, CycDataBuffer::parseHugePages(settings.bufHugePages), settings.bufLockMemory);
+    receiverVideoBuf->setOverflowPolicy(CycDataBuffer::parseOverflowPolicy(settings.videoOverflowPolicy, true), settings.overflowBlockTimeout, settings.storagePath, uint64_t(settings.spillSize) * 1000000);
 	receiverVideoDialog = new ReceiverVideoDialog(receiverVideoBuf, ui.suffixEdit);
 	receiverVideoDialog->show();
 
@@ -123,17 +147,23 @@ void MainDialog::onStartRec()
     startRecTstamp = timestamp.tv_nsec / 1000000;
     startRecTstamp += timestamp.tv_sec * 1000;
 
+    // All the streams share the same start time, so that their pre-rolls
+    // are aligned
     if(camera1)
     {
-    	senderVideoDialog->setIsRec(true);
+    	senderVideoDialog->setIsRec(true, startRecTstamp);
     }
 
-    senderAudioBuf->setIsRec(true);
+    senderAudioBuf->setIsRec(true, startRecTstamp);
+    receiverAudioBuf->setIsRec(true, startRecTstamp);
+    receiverVideoBuf->setIsRec(true, startRecTstamp);
 }
 
 
 void MainDialog::onStopRec()
 {
+	DataRates	dataRates;
+
     ui.stopButton->setEnabled(false);
     ui.startButton->setEnabled(true);
     ui.suffixEdit->setEnabled(true);
@@ -146,44 +176,123 @@ void MainDialog::onStopRec()
     }
 
     senderAudioBuf->setIsRec(false);
+    receiverAudioBuf->setIsRec(false);
+    receiverVideoBuf->setIsRec(false);
+
+    // Adjust the buffers to the data rates seen during the recording
+    if(remoteVideoFormat.fps)
+    {
+        dataRates.setReceiverVideoFormat(remoteVideoFormat);
+    }
+    senderAudioBuf->resizeForRate(dataRates.senderAudio);
+    receiverAudioBuf->resizeForRate(dataRates.receiverAudio);
+    receiverVideoBuf->resizeForRate(dataRates.receiverVideo);
 }
 
 
-void MainDialog::onAudioUpdate(unsigned char* _data)
+void MainDialog::setRemoteVideoFormat(VideoFormat _format)
 {
-	unsigned int 	i=0;
-	unsigned int	j;
-	AUDIO_DATA_TYPE	maxvals[N_CHANS_SENDER]={0};
-	AUDIO_DATA_TYPE	curval;
-
-	// Update the history
-	memset(&(volSenderMaxvals[volSenderIndNext]), 0, N_CHANS_SENDER * sizeof(AUDIO_DATA_TYPE));
-	while(i < settings.framesPerPeriod * N_CHANS_SENDER)
+	DataRates	dataRates;
+
+	// Only accept what the station can buffer; the buffers and fragFrame
+	// are allocated for the format right away
+	if(_format.width < 1 || _format.width > VIDEO_MAX_WIDTH || _format.height < 1 || _format.height > VIDEO_MAX_HEIGHT
+	   || _format.fps < 1 || _format.fps > VIDEO_MAX_FPS || double(_format.width) * _format.height * _format.fps > VIDEO_MAX_PIXEL_RATE)
 	{
-		for(j=0; j<N_CHANS_SENDER; j++)
-		{
-			curval = abs(((AUDIO_DATA_TYPE*)_data)[i++]);
-			volSenderMaxvals[volSenderIndNext + j] = (volSenderMaxvals[volSenderIndNext + j] >= curval) ? volSenderMaxvals[volSenderIndNext + j] : curval;
-		}
+		cerr << "Invalid remote video format " << _format.width << "x" << _format.height << " at " << _format.fps << " FPS, ignoring" << endl;
+		return;
 	}
 
-	volSenderIndNext += N_CHANS_SENDER;
-	volSenderIndNext %= (N_CHANS_SENDER * N_BUF_4_VOL_IND);
+	cout << "Remote video: " << _format.width << "x" << _format.height << " at " << _format.fps << " FPS" << endl;
+	remoteVideoFormat = _format;
 
-	// Compute maxima for all channels
-	i = 0;
-	while(i < N_CHANS_SENDER * N_BUF_4_VOL_IND)
+	free(fragFrame);
+	fragFrameSize = JPEG_BUF_SIZE(_format.width, _format.height);
+	fragFrame = (unsigned char*)malloc(fragFrameSize);
+	if(!fragFrame)
 	{
-		for(j=0; j<N_CHANS_SENDER; j++)
+		cerr << "Error allocating memory!" << endl;
+		abort();
+	}
+	fragReceived.clear();
+
+	receiverVideoDialog->setVideoFormat(_format);
+
+	// Between the recordings the buffer can follow the new format right
+	// away, otherwise it is resized when the recording stops
+	if(!isRec)
+	{
+		dataRates.setReceiverVideoFormat(_format);
+		receiverVideoBuf->resize(CycDataBuffer::sizeForRate(dataRates.receiverVideo));
+	}
+}
+
+
+void MainDialog::receiveVideoFrame(unsigned char* _data, ChunkAttrib _chunkAttrib, uint64_t _msec)
+{
+	unsigned char*	dataSrc;
+	int				fixedStimFrameSz;
+
+	_chunkAttrib.timestamp = _msec;
+
+	if(isRec)
+	{   // Check whether we might want to replace the frame with a frame from the fixedStimuli
+		dataSrc = fixedStimuli->findFrame(startRecTstamp, _chunkAttrib.timestamp, &fixedStimFrameSz);
+		if(dataSrc)
 		{
-			curval = volSenderMaxvals[i++];
-			maxvals[j] = (maxvals[j] >= curval) ? maxvals[j] : curval;
+			_chunkAttrib.chunkSize = fixedStimFrameSz;
+			_data = dataSrc;
 		}
 	}
 
-	// Update only two level bars
-	ui.senderLevelLeft->setValue(maxvals[0]);
-	ui.senderLevelRight->setValue(maxvals[1]);
+	receiverVideoBuf->insertChunk(_data, _chunkAttrib);
+}
+
+
+static void updateLevelBar(QProgressBar* _bar, LevelMeter* _meter, int _chan)
+{
+	float	peak = _meter->getPeak(_chan);
+	float	rms = _meter->getRms(_chan);
+
+	_bar->setValue(int(peak * LEVEL_BAR_MAX));
+	_bar->setToolTip(QString("Peak %1 dBFS, RMS %2 dBFS")
+					 .arg(20 * log10(fmax(peak, 1e-5)), 0, 'f', 1)
+					 .arg(20 * log10(fmax(rms, 1e-5)), 0, 'f', 1));
+}
+
+
+void MainDialog::onAudioUpdate()
+{
+	// Update only two level bars for the sender, showing the first two
+	// channels, and one for the receiver
+	updateLevelBar(ui.senderLevelLeft, senderMeter, 0);
+	updateLevelBar(ui.senderLevelRight, senderMeter, (senderFormat.getChans() > 1) ? 1 : 0);
+	updateLevelBar(ui.receiverLevelLeft, receiverMeter, 0);
+}
+
+
+void MainDialog::onPlaybackStats()
+{
+	PlaybackStats	stats;
+
+	jitterBuffer->getStats(&stats);
+
+	clog << "Speaker buffer: " << stats.nPeriods << " periods, fill min/mean/max "
+		 << stats.minFill << "/" << stats.meanFill << "/" << stats.maxFill << ", target "
+		 << stats.targetDepth << ", jitter " << stats.jitter << " ms, "
+		 << stats.concealed << " concealed, " << stats.late << " late, "
+		 << stats.reordered << " reordered, " << stats.compressed << " compressed, "
+		 << stats.overflows << " overflows, drift " << driftResampler->getDriftPpm() << " ppm" << endl;
+}
+
+
+void MainDialog::onCaptureStats()
+{
+	SampleClock*	sampleClock = microphoneThread->getSampleClock();
+
+	clog << "Microphone clock: drift " << sampleClock->getDriftPpm() << " ppm, residual "
+		 << sampleClock->getResidual() << " us, " << sampleClock->getOutliers() << " outliers, "
+		 << sampleClock->getRestarts() << " restarts" << endl;
 }
 
 
@@ -235,7 +344,13 @@ void MainDialog::onUdpPacketArrived()
     quint16			senderPort;
     ChunkAttrib		chunkAttrib;
     unsigned char*  dataSrc;
-    int             fixedStimFrameSz;
+    unsigned char*  dataEnd;
+    int             nPeriods;
+    int             periodIdx;
+    double          periodMsec;
+    uint32_t        fragOffset;
+    int             fragIndex;
+    VideoFormat     videoFormat;
 
 	struct timespec	timestamp;
 	uint64_t		msec;
@@ -253,81 +368,154 @@ void MainDialog::onUdpPacketArrived()
         switch(datagram.data()[0])
         {
         case UDP_AUDIO_PACKET:
-        	chunkAttrib = *((ChunkAttrib*)(((unsigned char*)datagram.data())+1));
-        	chunkAttrib.timestamp = msec;
-            receiverAudioBuf->insertChunk(((unsigned char*)datagram.data())+sizeof(ChunkAttrib)+1, chunkAttrib);
-            speakerBuffer->insertChunk(((unsigned char*)datagram.data())+sizeof(ChunkAttrib)+1);
-            updateReceiverAudioBars(((unsigned char*)datagram.data())+sizeof(ChunkAttrib)+1);
-        	break;
+            dataSrc = ((unsigned char*)datagram.data())+sizeof(NetChunkHeader)+1;
+            dataEnd = ((unsigned char*)datagram.data())+datagram.size();
+            if (dataSrc > dataEnd)
+            {
+                cerr << "Truncated audio datagram, dropping" << endl;
+                break;
+            }
 
-        case UDP_VIDEO_PACKET:
-        	chunkAttrib = *((ChunkAttrib*)(((unsigned char*)datagram.data())+1));
-        	chunkAttrib.timestamp = msec;
+            chunkAttrib = unpackChunkHeader(((unsigned char*)datagram.data())+1);
+            if (chunkAttrib.chunkSize < 0 || chunkAttrib.chunkSize > dataEnd - dataSrc)
+            {
+                cerr << "Truncated audio datagram, dropping" << endl;
+                break;
+            }
 
-            if(isRec)
-            {   // Check whether we might want to replace the frame with a frame from the fixedStimuli
+        	chunkAttrib.timestamp = msec;
+            receiverAudioBuf->insertChunk(dataSrc, chunkAttrib);
+            speakerBuffer->insertChunk(dataSrc, chunkAttrib);
+        	break;
 
-                dataSrc = fixedStimuli->findFrame(startRecTstamp, chunkAttrib.timestamp, &fixedStimFrameSz);
-                if(dataSrc)
-                {
-                    chunkAttrib.chunkSize = fixedStimFrameSz;
-                }
-                else
+        case UDP_AUDIO_BATCH_PACKET:
+            // Several periods, see SendingSocket. The recorded periods are
+            // stamped as if they had arrived one by one, the last one at the
+            // arrival time of the datagram. The jitter buffer gets the
+            // arrival time for all of them, so that it sees the burst and
+            // keeps enough periods to cover it.
+            nPeriods = ((unsigned char*)datagram.data())[1];
+            periodMsec = settings.framesPerPeriod * 1000.0 / settings.sampRate;
+            dataSrc = ((unsigned char*)datagram.data())+2;
+            dataEnd = ((unsigned char*)datagram.data())+datagram.size();
+            for (periodIdx=0; periodIdx < nPeriods && dataSrc + sizeof(NetChunkHeader) <= dataEnd; periodIdx++)
+            {
+                chunkAttrib = unpackChunkHeader(dataSrc);
+                dataSrc += sizeof(NetChunkHeader);
+                if (chunkAttrib.chunkSize < 0 || chunkAttrib.chunkSize > dataEnd - dataSrc)
                 {
-                    dataSrc = ((unsigned char*)datagram.data())+sizeof(ChunkAttrib)+1;
-                }
+                    break;
                 }
-            else
+
+                chunkAttrib.timestamp = msec - uint64_t((nPeriods - 1 - periodIdx) * periodMsec + 0.5);
+                receiverAudioBuf->insertChunk(dataSrc, chunkAttrib);
+                chunkAttrib.timestamp = msec;
+                speakerBuffer->insertChunk(dataSrc, chunkAttrib);
+                dataSrc += chunkAttrib.chunkSize;
+            }
+
+            if (periodIdx < nPeriods)
             {
-                dataSrc = ((unsigned char*)datagram.data())+sizeof(ChunkAttrib)+1;
+                cerr << "Truncated audio datagram, dropping the rest" << endl;
             }
+            break;
 
-            receiverVideoBuf->insertChunk(dataSrc, chunkAttrib);
+        case UDP_VIDEO_PACKET:
+            dataSrc = ((unsigned char*)datagram.data())+sizeof(NetChunkHeader)+1;
+            dataEnd = ((unsigned char*)datagram.data())+datagram.size();
+            if (dataSrc > dataEnd)
+            {
+                cerr << "Truncated video datagram, dropping" << endl;
+                break;
+            }
+
+            chunkAttrib = unpackChunkHeader(((unsigned char*)datagram.data())+1);
+            if (chunkAttrib.chunkSize < 0 || chunkAttrib.chunkSize > dataEnd - dataSrc)
+            {
+                cerr << "Truncated video datagram, dropping" << endl;
+                break;
+            }
+
+            receiveVideoFrame(dataSrc, chunkAttrib, msec);
         	break;
 
-        default:
-        	cerr << "Unknown UDP datagram type, dropping" << endl;
-        }
-    }
-}
+        case UDP_VIDEO_FRAGMENT_PACKET:
+            // Part of a frame too large for one datagram, see SendingSocket.
+            // The parts are collected in fragFrame until every one of them
+            // has arrived; a part of another frame drops the incomplete one.
+            // Until the format is known there is no room for the frame.
+            if (!fragFrame)
+            {
+                break;
+            }
 
+            dataSrc = ((unsigned char*)datagram.data())+sizeof(NetChunkHeader)+sizeof(uint32_t)+1;
+            dataEnd = ((unsigned char*)datagram.data())+datagram.size();
+            if (dataSrc > dataEnd)
+            {
+                cerr << "Truncated video fragment, dropping" << endl;
+                break;
+            }
 
-void MainDialog::updateReceiverAudioBars(unsigned char* _data)
-{
+            chunkAttrib = unpackChunkHeader(((unsigned char*)datagram.data())+1);
+            memcpy(&fragOffset, datagram.data()+sizeof(NetChunkHeader)+1, sizeof(uint32_t));
+            // Every fragment but the last one is exactly UDP_VIDEO_FRAGMENT_SIZE
+            // bytes long
+            if (chunkAttrib.chunkSize <= 0 || chunkAttrib.chunkSize > fragFrameSize
+                || fragOffset >= uint32_t(chunkAttrib.chunkSize) || fragOffset % UDP_VIDEO_FRAGMENT_SIZE
+                || dataEnd - dataSrc != min(int64_t(UDP_VIDEO_FRAGMENT_SIZE), int64_t(chunkAttrib.chunkSize - fragOffset)))
+            {
+                cerr << "Invalid video fragment, dropping" << endl;
+                break;
+            }
 
-	// TODO: unify with the similar code for the server
-	unsigned int 	i=0;
-	unsigned int	j;
-	AUDIO_DATA_TYPE	maxvals[N_CHANS_RECEIVER]={0};
-	AUDIO_DATA_TYPE	curval;
+            if (chunkAttrib.id != fragFrameId || fragReceived.isEmpty())
+            {
+                fragFrameId = chunkAttrib.id;
+                fragChunkSize = chunkAttrib.chunkSize;
+                fragMissing = (fragChunkSize + UDP_VIDEO_FRAGMENT_SIZE - 1) / UDP_VIDEO_FRAGMENT_SIZE;
+                fragReceived.fill(false, fragMissing);
+            }
+            else if (chunkAttrib.chunkSize != fragChunkSize)
+            {
+                cerr << "Invalid video fragment, dropping" << endl;
+                break;
+            }
 
-	// Update the history
-	memset(&(volReceiverMaxvals[volReceiverIndNext]), 0, N_CHANS_RECEIVER * sizeof(AUDIO_DATA_TYPE));
-	while(i < settings.framesPerPeriod * N_CHANS_RECEIVER)
-	{
-		for(j=0; j<N_CHANS_RECEIVER; j++)
-		{
-			curval = abs(((AUDIO_DATA_TYPE*)_data)[i++]);
-			volReceiverMaxvals[volReceiverIndNext + j] = (volReceiverMaxvals[volReceiverIndNext + j] >= curval) ? volReceiverMaxvals[volReceiverIndNext + j] : curval;
-		}
-	}
+            // A complete frame keeps its bits set, so late duplicates of its
+            // fragments are ignored as well
+            fragIndex = fragOffset / UDP_VIDEO_FRAGMENT_SIZE;
+            if (fragReceived.testBit(fragIndex))
+            {
+                break;
+            }
 
-	volReceiverIndNext += N_CHANS_RECEIVER;
-	volReceiverIndNext %= (N_CHANS_RECEIVER * N_BUF_4_VOL_IND);
+            memcpy(fragFrame + fragOffset, dataSrc, dataEnd - dataSrc);
+            fragReceived.setBit(fragIndex);
+            if (--fragMissing == 0)
+            {
+                receiveVideoFrame(fragFrame, chunkAttrib, msec);
+            }
+            break;
 
-	// Compute maxima for all channels
-	i = 0;
-	while(i < N_CHANS_RECEIVER * N_BUF_4_VOL_IND)
-	{
-		for(j=0; j<N_CHANS_RECEIVER; j++)
-		{
-			curval = volReceiverMaxvals[i++];
-			maxvals[j] = (maxvals[j] >= curval) ? maxvals[j] : curval;
-		}
-	}
+        case UDP_VIDEO_FORMAT_PACKET:
+            if (datagram.size() < int(sizeof(VideoFormat)) + 1)
+            {
+                cerr << "Truncated video format datagram, dropping" << endl;
+                break;
+            }
+
+            memcpy(&videoFormat, datagram.data()+1, sizeof(VideoFormat));
+            if (memcmp(&videoFormat, &remoteVideoFormat, sizeof(VideoFormat)))
+            {
+                setRemoteVideoFormat(videoFormat);
+            }
+            break;
 
-	// Update only one level bar
-	ui.receiverLevelLeft->setValue(maxvals[0]);
+        default:
+        	cerr << "Unknown UDP datagram type, dropping" << endl;
+        }
+    }
 }
 
 
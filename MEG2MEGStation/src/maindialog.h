@@ -23,6 +23,8 @@
 
 #include <stdint.h>
 #include <QMainWindow>
+#include <QTimer>
+#include <QBitArray>
 
 #include "config.h"
 #include "ui_maindialog.h"
@@ -31,13 +33,17 @@
 #include "cycdatabuffer.h"
 #include "videofilewriter.h"
 #include "audiofilewriter.h"
+#include "audioformat.h"
 #include "speakerthread.h"
+#include "jitterbuffer.h"
+#include "driftresampler.h"
 #include "videocompressorthread.h"
 #include "sendervideodialog.h"
 #include "settings.h"
 #include "sendingsocket.h"
 #include "receivervideodialog.h"
 #include "fixedstimuli.h"
+#include "levelmeter.h"
 
 class MainDialog : public QMainWindow
 {
@@ -50,11 +56,15 @@ public:
 public slots:
     void onStartRec();
     void onStopRec();
-    void onAudioUpdate(unsigned char* _data);
+    void onAudioUpdate();
+    void onPlaybackStats();
+    void onCaptureStats();
     void onUdpPacketArrived();
 
 private:
     void initVideo();
+    void setRemoteVideoFormat(VideoFormat _format);
+    void receiveVideoFrame(unsigned char* _data, ChunkAttrib _chunkAttrib, uint64_t _msec);
 
     Ui::MainDialogClass ui;
 	Settings 			settings;
@@ -72,29 +82,43 @@ private:
     AudioFileWriter*	senderAudioFileWriter;
 	SendingSocket*		sendingSocket;
 
-    // Data structures for volume indicator. volMaxvals is a cyclic buffer
-    // that stores maximal values for the last N_BUF_4_VOL_IND periods for
-    // all channels in an interleaved fashion.
-	AUDIO_DATA_TYPE		volSenderMaxvals[N_CHANS_SENDER * N_BUF_4_VOL_IND];
-	int					volSenderIndNext;
+	AudioFormat			senderFormat;
+
+	// The level bars of both sides are refreshed by volTimer from the meters
+	LevelMeter*			senderMeter;
+	QTimer*				volTimer;
 
 
 	//---------------------------------------------------------------------
 	// Client stuff
 	//
-	void updateReceiverAudioBars(unsigned char* _data);
-
 	ReceiverVideoDialog*	receiverVideoDialog;
 
     CycDataBuffer*			receiverAudioBuf;
     CycDataBuffer*			receiverVideoBuf;
     AudioFileWriter*		receiverAudioFileWriter;
     NonBlockingBuffer*		speakerBuffer;
+    JitterBuffer*			jitterBuffer;
+    DriftResampler*			driftResampler;
 	SpeakerThread*			speakerThread;
+	QTimer*					playbackStatsTimer;
 	QUdpSocket*				udpSocket;
 
-	AUDIO_DATA_TYPE			volReceiverMaxvals[N_CHANS_RECEIVER * N_BUF_4_VOL_IND];
-	int						volReceiverIndNext;
+	AudioFormat				receiverFormat;		// the network format
+	LevelMeter*				receiverMeter;
+
+	// Video format of the remote station, all zeros until it is received,
+	// and the frame being put together from UDP_VIDEO_FRAGMENT_PACKET
+	// datagrams, with room for the largest frame of that format. Bit i of
+	// fragReceived is set once the fragment at i*UDP_VIDEO_FRAGMENT_SIZE has
+	// arrived, so duplicated datagrams are not counted twice.
+	VideoFormat				remoteVideoFormat;
+	unsigned char*			fragFrame;
+	int						fragFrameSize;		// in bytes
+	uint64_t				fragFrameId;
+	int						fragChunkSize;		// in bytes, of the current frame
+	QBitArray				fragReceived;
+	int						fragMissing;		// fragments not received yet
 
     volatile bool           isRec;
     volatile uint64_t       startRecTstamp;
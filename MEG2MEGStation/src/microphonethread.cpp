@@ -29,9 +29,6 @@ using namespace std;
 
 MicrophoneThread::MicrophoneThread(CycDataBuffer* _cycBuf)
 {
-	int 					rc;
-	snd_pcm_hw_params_t*	params;
-	unsigned int			val;
 	struct timespec			timestamp;
 
 	cycBuf = _cycBuf;
@@ -42,87 +39,17 @@ MicrophoneThread::MicrophoneThread(CycDataBuffer* _cycBuf)
 	curChunkId = timestamp.tv_nsec / 1000000;
 	curChunkId += timestamp.tv_sec * 1000;
 
-	/* Open PCM device for recording (capture). */
-	rc = snd_pcm_open(&pcmHandle, settings.inpAudioDev, SND_PCM_STREAM_CAPTURE, 0);
-	if (rc < 0)
-	{
-		cerr << "unable to open pcm device: " << snd_strerror(rc) << endl;
-	    abort();
-	}
-
-	/* Allocate a hardware parameters object. */
-	snd_pcm_hw_params_alloca(&params);
-
-	/* Fill it in with default values. */
-	if (snd_pcm_hw_params_any(pcmHandle, params) < 0)
-	{
-		cerr << "Can not configure PCM device: " << settings.inpAudioDev << endl;
-		abort();
-	}
-
-	/* Set the desired hardware parameters. */
-
-	/* Interleaved mode */
-	snd_pcm_hw_params_set_access(pcmHandle, params, SND_PCM_ACCESS_RW_INTERLEAVED);
-
-	/* Signed 16-bit little-endian format */
-	snd_pcm_hw_params_set_format(pcmHandle, params, AUDIO_FORMAT);
-
-	/* Specify the number of channels */
-	snd_pcm_hw_params_set_channels(pcmHandle, params, N_CHANS_SENDER);
-
-	/* Set sampling rate */
-	val = settings.sampRate;
-	snd_pcm_hw_params_set_rate_near(pcmHandle, params, &val, NULL);
-
-	/* Set period size (in frames) */
-	framesPerPeriod = settings.framesPerPeriod;
-	snd_pcm_hw_params_set_period_size_near(pcmHandle, params, &framesPerPeriod, NULL);
-
-    /* Set number of periods */
-    if (snd_pcm_hw_params_set_periods(pcmHandle, params, settings.nSenderPeriods, 0) < 0)
-    {
-      cerr << "Error setting periods" << endl;
-      abort();
-    }
-
-	/* Write the parameters to the driver */
-	rc = snd_pcm_hw_params(pcmHandle, params);
-	if (rc < 0)
-	{
-		cerr << "unable to set hw parameters: " << snd_strerror(rc) << endl;
-		abort();
-	}
-
-	snd_pcm_hw_params_get_rate(params, &val, NULL);
-	if (val != settings.sampRate)
-	{
-		cout << "unable to set sampling rate: requested " << settings.sampRate << ", actual " << val << endl;
-		abort();
-	}
-
-	snd_pcm_hw_params_get_period_size(params, &framesPerPeriod, NULL);
-	if (settings.framesPerPeriod != framesPerPeriod)
-	{
-		cout << "unable to set frames per period: requested " << settings.framesPerPeriod << ", actual " << framesPerPeriod << endl;
-		abort();
-	}
-
-	/* Use a buffer large enough to hold one period */
-	periodBuffer = (unsigned char*)malloc(framesPerPeriod * N_CHANS_SENDER * sizeof(AUDIO_DATA_TYPE));
-	if (!periodBuffer)
-	{
-		cerr << "Failed to allocate period buffer" << endl;
-		abort();
-	}
+	format = AudioFormat(AudioFormat::parseSampleFormat(settings.sampleFormat), settings.nSenderChans);
+	device = new AlsaDevice(settings.inpAudioDev, SND_PCM_STREAM_CAPTURE, format, settings.sampRate, settings.framesPerPeriod, settings.nSenderPeriods, settings.audioMmap);
+	framesPerPeriod = device->getFramesPerPeriod();
+	sampleClock = new SampleClock(settings.sampRate);
 }
 
 
 MicrophoneThread::~MicrophoneThread()
 {
-	snd_pcm_drain(pcmHandle);
-	snd_pcm_close(pcmHandle);
-	free(periodBuffer);
+	delete sampleClock;
+	delete device;
 }
 
 
@@ -133,6 +60,16 @@ void MicrophoneThread::stoppableRun()
 	uint64_t			msec;
     struct sched_param	sch_param;
     ChunkAttrib			chunkAttrib;
+    unsigned char*		periodBuffer;
+    int					periodSize;
+    uint64_t			periodDuration;		// in microseconds
+    uint64_t			firstFrame;
+    uint64_t			posFrames;
+    uint64_t			posTime;
+    uint64_t			trigTime;
+    uint64_t			usec;
+    uint64_t			lastMsec = 0;
+    bool				needTrigger = true;
 
     // Set priority
     sch_param.sched_priority = MIC_THREAD_PRIORITY;
@@ -141,34 +78,86 @@ void MicrophoneThread::stoppableRun()
     	cerr << "Cannot set microphone thread priority. Continuing nevertheless, but don't blame me if you experience any strange problems." << endl;
     }
 
+    periodSize = framesPerPeriod * format.getFrameSize();
+    periodDuration = uint64_t(framesPerPeriod) * 1000000 / settings.sampRate;
+
     // Start the acquisition loop
 	while(true)
 	{
-	    rc = snd_pcm_readi(pcmHandle, periodBuffer, framesPerPeriod);
+		// Read the period directly into the circular buffer
+		periodBuffer = cycBuf->reserveChunk(periodSize);
+
+		firstFrame = device->getFramesTransferred();
+	    rc = device->readPeriod(periodBuffer);
 	    clock_gettime(CLOCK_REALTIME, &timestamp);
+	    usec = uint64_t(timestamp.tv_sec) * 1000000 + timestamp.tv_nsec / 1000;
 
 	    if (rc == -EPIPE)
 	    {
 	    	// EPIPE means overrun
 	    	cerr << "Overrun occurred" << endl;
-	    	snd_pcm_prepare(pcmHandle);
+	    	device->recover(rc);
+	    	memset(periodBuffer, 0, periodSize);
 	    }
 	    else if (rc < 0)
 	    {
 	    	cerr << "Error from read: " << snd_strerror(rc) << endl;
+	    	device->recover(rc);
+	    	memset(periodBuffer, 0, periodSize);
 	    }
 	    else if (rc != (int)framesPerPeriod)
 	    {
 	    	cerr << "short read, read " << rc << " frames instead of " << framesPerPeriod << endl;
+	    	memset(periodBuffer + rc * format.getFrameSize(), 0, periodSize - rc * format.getFrameSize());
+	    }
+
+	    if (rc > 0)
+	    {
+	    	format.prepareCapture(periodBuffer, rc);
+
+	    	// Relate the frames to the system time. If the sound card does not
+	    	// report hardware timestamps, the time when the read returned is
+	    	// the best we have.
+	    	if (device->getPosition(&posFrames, &posTime))
+	    	{
+	    		// The stream start anchors the fit right away
+	    		if (needTrigger && device->getTriggerTime(&trigTime))
+	    		{
+	    			sampleClock->addPoint(0, trigTime);
+	    		}
+	    	}
+	    	else
+	    	{
+	    		posFrames = device->getFramesTransferred();
+	    		posTime = usec;
+	    	}
+	    	needTrigger = false;
+
+	    	sampleClock->addPoint(posFrames, posTime);
+
+	    	chunkAttrib.rawTstamp = posTime - (posFrames - firstFrame) * 1000000 / settings.sampRate;
+	    	chunkAttrib.fitTstamp = sampleClock->getTime(firstFrame);
+	    }
+	    else
+	    {
+	    	// The frame counter starts over with the restarted stream, and so
+	    	// does the fit
+	    	sampleClock->reset();
+	    	needTrigger = true;
+
+	    	chunkAttrib.rawTstamp = usec - periodDuration;
+	    	chunkAttrib.fitTstamp = chunkAttrib.rawTstamp;
 	    }
 
-		msec = timestamp.tv_nsec / 1000000;
-		msec += timestamp.tv_sec * 1000;
+		// Chunk timestamps must not go back, even when the fit is restarted
+		msec = chunkAttrib.fitTstamp / 1000;
+		msec = (msec > lastMsec) ? msec : lastMsec;
+		lastMsec = msec;
 
-		chunkAttrib.chunkSize = settings.framesPerPeriod * N_CHANS_SENDER * sizeof(AUDIO_DATA_TYPE);
+		chunkAttrib.chunkSize = periodSize;
 		chunkAttrib.timestamp = msec;
 		chunkAttrib.id = curChunkId++;
 
-	    cycBuf->insertChunk(periodBuffer, chunkAttrib);
+	    cycBuf->commitChunk(chunkAttrib);
 	}
 }
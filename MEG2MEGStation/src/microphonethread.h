@@ -21,11 +21,9 @@
 #ifndef MICROPHONETHREAD_H_
 #define MICROPHONETHREAD_H_
 
-// Use the newer ALSA API
-#define ALSA_PCM_NEW_HW_PARAMS_API
-
-#include <alsa/asoundlib.h>
 #include "stoppablethread.h"
+#include "alsadevice.h"
+#include "sampleclock.h"
 #include "cycdatabuffer.h"
 #include "settings.h"
 
@@ -35,14 +33,18 @@ public:
 	MicrophoneThread(CycDataBuffer* _cycBuf);
 	virtual ~MicrophoneThread();
 
+	//! Estimate of the sound card's clock, for reporting.
+	SampleClock* getSampleClock() { return(sampleClock); }
+
 protected:
 	virtual void stoppableRun();
 
 private:
 	CycDataBuffer*		cycBuf;
-	snd_pcm_t*			pcmHandle;
+	AudioFormat			format;
+	AlsaDevice*			device;
+	SampleClock*		sampleClock;
 	snd_pcm_uframes_t	framesPerPeriod;
-	unsigned char*		periodBuffer;
 	Settings			settings;
 	uint64_t			curChunkId;
 };
@@ -21,80 +21,73 @@
 #include <iostream>
 #include <stdlib.h>
 #include <string.h>
-#include <QMutexLocker>
 
 #include "nonblockingbuffer.h"
 
 using namespace std;
 
 
-NonBlockingBuffer::NonBlockingBuffer(int _bufSize, long _chunkSize)
+NonBlockingBuffer::NonBlockingBuffer(int _bufSize, int _framesPerPeriod)
 {
-	insertPtr = 0;				// if getPtr == insertPtr the buffer is empty
-	getPtr = 0;
-	bufSize = _bufSize+1;		// to store N items we use N+1 slots to simplify
-								// head/tail pointer arithmetics
-	chunkSize = _chunkSize;
-    buffMutex = new QMutex();
-
-    // Allocate buffers
-    dataBuf = (char*)malloc(bufSize * chunkSize);
-    if (!dataBuf)
-    {
-    	cerr << "Cannot allocate memory for non-blocking buffer" << endl;
-    	abort();
-    }
-
-    zeroChunk = (char*)malloc(chunkSize);
-    if (!zeroChunk)
-    {
-    	cerr << "Cannot allocate memory for the chunk of zeros" << endl;
-    	abort();
-    }
-
-    memset(zeroChunk, 0, chunkSize);
+	// One extra slot for the period held by the consumer
+	ring = new AudioRing<NET_AUDIO_TYPE, N_CHANS_NET>(_bufSize+1, _framesPerPeriod);
+	isHeld = false;
+    overflows.store(0);
 }
 
 
 NonBlockingBuffer::~NonBlockingBuffer()
 {
-	free(zeroChunk);
-    free(dataBuf);
-    delete(buffMutex);
+    delete ring;
 }
 
 
-void NonBlockingBuffer::insertChunk(void* _data)
+void NonBlockingBuffer::insertChunk(void* _data, ChunkAttrib _attrib)
 {
-	QMutexLocker locker(buffMutex);
+	if(_attrib.chunkSize != ring->getPeriodSize())
+	{
+		cerr << "Audio chunk of " << _attrib.chunkSize << " bytes instead of " << ring->getPeriodSize() << ", discarding" << endl;
+		return;
+	}
 
 	// if the buffer is full discard the data
-	if((insertPtr+1) % bufSize == getPtr)
+	if(ring->isFull())
 	{
-		// cerr << "Non-blocking buffer overflow, discarding the data" << endl;
+		overflows.fetchAndAddRelaxed(1);
 		return;
 	}
 
 	// insert the data into the circular buffer
-	memcpy(dataBuf + chunkSize * insertPtr, _data, chunkSize);
-	insertPtr = (insertPtr+1) % bufSize;
+	memcpy(ring->back(), _data, ring->getPeriodSize());
+	ring->push(_attrib.id, _attrib.timestamp);
 }
 
 
-void* NonBlockingBuffer::getChunk()
+NET_AUDIO_TYPE* NonBlockingBuffer::getChunk(ChunkAttrib* _attrib)
 {
-	void*			res;
-	QMutexLocker	locker(buffMutex);
-
-	if(insertPtr==getPtr)
+	// Release the period returned by the previous call
+	if(isHeld)
 	{
-		// cerr << "Non-blocking buffer underflow, returning zeros" << endl;
-		return(zeroChunk);
+		ring->pop();
+		isHeld = false;
 	}
-	else
+
+	if(ring->isEmpty())
 	{
-		res = dataBuf + chunkSize * getPtr;
-		getPtr = (getPtr+1) % bufSize;
-		return(res);
+		return(NULL);
 	}
+
+	_attrib->chunkSize = ring->getPeriodSize();
+	_attrib->id = ring->frontId();
+	_attrib->timestamp = ring->frontTimestamp();
+	_attrib->isRec = false;
+
+	isHeld = true;
+	return(ring->front());
+}
+
+
+uint64_t NonBlockingBuffer::getOverflows()
+{
+	return(overflows.load());
 }
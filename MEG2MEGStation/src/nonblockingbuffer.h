@@ -21,26 +21,39 @@
 #ifndef NONBLOCKINGBUFFER_H_
 #define NONBLOCKINGBUFFER_H_
 
-#include <QMutex>
+#include <QAtomicInteger>
 
+#include "config.h"
+#include "audioring.h"
+#include "cycdatabuffer.h"
+
+//! Queue of received audio periods between the network and the playback.
+/*!
+ * Neither side ever waits: if the buffer is full, the new period is
+ * discarded (and counted), and if it is empty, getChunk() returns NULL.
+ * Supports a single producer and a single consumer, which do not take any
+ * locks, so the consumer can be a real-time thread.
+ */
 class NonBlockingBuffer {
 public:
-	NonBlockingBuffer(int _bufSize, long _chunkSize);
+	//! Create a buffer holding _bufSize periods of _framesPerPeriod frames.
+	NonBlockingBuffer(int _bufSize, int _framesPerPeriod);
 	virtual ~NonBlockingBuffer();
-	void insertChunk(void* _data);
 
-	// Acquire a chunk and return a pointer to it. The chunk is implicitly
-	// released next time getChunk is called.
-	void* getChunk();
+	//! Insert a period. Chunks of a wrong size are discarded.
+	void insertChunk(void* _data, ChunkAttrib _attrib);
+
+	// Acquire a chunk and return a pointer to it, or NULL if the buffer is
+	// empty. The chunk is implicitly released next time getChunk is called.
+	NET_AUDIO_TYPE* getChunk(ChunkAttrib* _attrib);
+
+	//! Number of periods discarded because the buffer was full.
+	uint64_t getOverflows();
 
 private:
-	QMutex*	buffMutex;
-    char*	dataBuf;
-    char*	zeroChunk;
-	int		bufSize;
-	long	chunkSize;
-	int		insertPtr;
-	int		getPtr;
+	AudioRing<NET_AUDIO_TYPE, N_CHANS_NET>*	ring;
+	bool					isHeld;			// the front period is acquired by the consumer
+	QAtomicInteger<quint64>	overflows;
 };
 
 #endif /* NONBLOCKINGBUFFER_H_ */
@@ -0,0 +1,247 @@
+/*
+ * pixelformat.cpp
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && defined(__x86_64__)
+// The SSSE3 version is compiled regardless of the compiler flags and used
+// only if the CPU supports it
+#define HAVE_SSSE3_KERNEL
+#include <tmmintrin.h>
+#endif
+
+#include "pixelformat.h"
+
+using namespace std;
+
+PixelFormat parsePixelFormat(bool _color, const char* _name)
+{
+	if(!_color)
+	{
+		return(PIXEL_MONO8);
+	}
+	else if(!strcmp(_name, "RGB8"))
+	{
+		return(PIXEL_RGB8);
+	}
+	else if(!strcmp(_name, "YUV422"))
+	{
+		return(PIXEL_YUV422);
+	}
+	else if(!strcmp(_name, "YUV411"))
+	{
+		return(PIXEL_YUV411);
+	}
+	else if(!strcmp(_name, "BAYER_RGGB"))
+	{
+		return(PIXEL_BAYER_RGGB);
+	}
+	else if(!strcmp(_name, "BAYER_GBRG"))
+	{
+		return(PIXEL_BAYER_GBRG);
+	}
+	else if(!strcmp(_name, "BAYER_GRBG"))
+	{
+		return(PIXEL_BAYER_GRBG);
+	}
+	else if(!strcmp(_name, "BAYER_BGGR"))
+	{
+		return(PIXEL_BAYER_BGGR);
+	}
+
+	cerr << "Invalid color format: " << _name << ", should be RGB8, YUV422, YUV411, BAYER_RGGB, BAYER_GBRG, BAYER_GRBG or BAYER_BGGR" << endl;
+	abort();
+}
+
+
+void checkVideoFormat(PixelFormat _format, VideoFormat _videoFormat)
+{
+	uint32_t	widthUnit = 1;
+	uint32_t	heightUnit = 1;
+
+	switch(_format)
+	{
+	case PIXEL_YUV422:
+		widthUnit = 16;
+		heightUnit = 16;
+		break;
+
+	case PIXEL_YUV411:
+		widthUnit = 32;
+		heightUnit = 8;
+		break;
+
+	default:
+		if(isBayer(_format))
+		{
+			widthUnit = 2;
+			heightUnit = 2;
+		}
+	}
+
+	if(_videoFormat.width < widthUnit || _videoFormat.width > VIDEO_MAX_WIDTH || _videoFormat.width % widthUnit
+	   || _videoFormat.height < heightUnit || _videoFormat.height > VIDEO_MAX_HEIGHT || _videoFormat.height % heightUnit)
+	{
+		cerr << "Invalid frame size: " << _videoFormat.width << "x" << _videoFormat.height << ", should be multiples of "
+		     << widthUnit << "x" << heightUnit << " up to " << VIDEO_MAX_WIDTH << "x" << VIDEO_MAX_HEIGHT << " for this color format" << endl;
+		abort();
+	}
+
+	if(_videoFormat.fps < 1 || _videoFormat.fps > VIDEO_MAX_FPS)
+	{
+		cerr << "Invalid frame rate: " << _videoFormat.fps << ", should be between 1 and " << VIDEO_MAX_FPS << endl;
+		abort();
+	}
+}
+
+
+static void deinterleaveUyvy(const unsigned char* _src, int _nPixels, unsigned char* _y, unsigned char* _u, unsigned char* _v)
+{
+	int		i = 0;
+
+#ifdef __SSE2__
+	// 16 pixels per iteration. The Y samples are the odd bytes, U and V
+	// alternate in the even ones.
+	__m128i	lowBytes = _mm_set1_epi16(0x00FF);
+
+	for (; i+16<=_nPixels; i+=16)
+	{
+		__m128i	a = _mm_loadu_si128((const __m128i*)(_src + 2*i));
+		__m128i	b = _mm_loadu_si128((const __m128i*)(_src + 2*i + 16));
+		__m128i	uv = _mm_packus_epi16(_mm_and_si128(a, lowBytes), _mm_and_si128(b, lowBytes));
+
+		_mm_storeu_si128((__m128i*)(_y + i), _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+		_mm_storel_epi64((__m128i*)(_u + i/2), _mm_packus_epi16(_mm_and_si128(uv, lowBytes), uv));
+		_mm_storel_epi64((__m128i*)(_v + i/2), _mm_packus_epi16(_mm_srli_epi16(uv, 8), uv));
+	}
+#endif
+
+	for (; i<_nPixels; i+=2)
+	{
+		_u[i/2] = _src[2*i];
+		_y[i] = _src[2*i + 1];
+		_v[i/2] = _src[2*i + 2];
+		_y[i + 1] = _src[2*i + 3];
+	}
+}
+
+
+static void deinterleaveUyyvyyScalar(const unsigned char* _src, int _nPixels, unsigned char* _y, unsigned char* _u, unsigned char* _v)
+{
+	int		i;
+
+	for (i=0; i<_nPixels; i+=4)
+	{
+		_u[i/4] = _src[i*3/2];
+		_y[i] = _src[i*3/2 + 1];
+		_y[i + 1] = _src[i*3/2 + 2];
+		_v[i/4] = _src[i*3/2 + 3];
+		_y[i + 2] = _src[i*3/2 + 4];
+		_y[i + 3] = _src[i*3/2 + 5];
+	}
+}
+
+
+#ifdef HAVE_SSSE3_KERNEL
+__attribute__((target("ssse3")))
+static void deinterleaveUyyvyySsse3(const unsigned char* _src, int _nPixels, unsigned char* _y, unsigned char* _u, unsigned char* _v)
+{
+	// 16 pixels (24 bytes) per iteration, read as two overlapping vectors:
+	// a holds the bytes 0-15 and b the bytes 8-23. The shuffles gather the
+	// samples of each plane, -1 clears a byte.
+	const __m128i	yFromA = _mm_setr_epi8(1, 2, 4, 5, 7, 8, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1);
+	const __m128i	yFromB = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, 5, 6, 8, 9, 11, 12, 14, 15);
+	const __m128i	uvFromA = _mm_setr_epi8(0, 6, -1, -1, 3, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+	const __m128i	uvFromB = _mm_setr_epi8(-1, -1, 4, 10, -1, -1, 7, 13, -1, -1, -1, -1, -1, -1, -1, -1);
+	int				i = 0;
+	int				uv;
+
+	for (; i+16<=_nPixels; i+=16)
+	{
+		__m128i	a = _mm_loadu_si128((const __m128i*)(_src + i*3/2));
+		__m128i	b = _mm_loadu_si128((const __m128i*)(_src + i*3/2 + 8));
+		__m128i	uvs = _mm_or_si128(_mm_shuffle_epi8(a, uvFromA), _mm_shuffle_epi8(b, uvFromB));
+
+		_mm_storeu_si128((__m128i*)(_y + i), _mm_or_si128(_mm_shuffle_epi8(a, yFromA), _mm_shuffle_epi8(b, yFromB)));
+		uv = _mm_cvtsi128_si32(uvs);
+		memcpy(_u + i/4, &uv, 4);
+		uv = _mm_cvtsi128_si32(_mm_srli_si128(uvs, 4));
+		memcpy(_v + i/4, &uv, 4);
+	}
+
+	deinterleaveUyyvyyScalar(_src + i*3/2, _nPixels - i, _y + i, _u + i/4, _v + i/4);
+}
+#endif
+
+
+void deinterleaveYuv(PixelFormat _format, const unsigned char* _src, int _nPixels, unsigned char* _y, unsigned char* _u, unsigned char* _v)
+{
+	if (_format == PIXEL_YUV422)
+	{
+		deinterleaveUyvy(_src, _nPixels, _y, _u, _v);
+		return;
+	}
+
+#ifdef HAVE_SSSE3_KERNEL
+	if (__builtin_cpu_supports("ssse3"))
+	{
+		deinterleaveUyyvyySsse3(_src, _nPixels, _y, _u, _v);
+		return;
+	}
+#endif
+
+	deinterleaveUyyvyyScalar(_src, _nPixels, _y, _u, _v);
+}
+
+
+void averageRowPairs(unsigned char* _plane, int _width, int _height)
+{
+	const unsigned char*	upper;
+	const unsigned char*	lower;
+	unsigned char*			dst;
+	int						r;
+	int						i;
+
+	// Row r only depends on the rows 2r and 2r+1, so it can be overwritten
+	for (r=0; r<_height/2; r++)
+	{
+		upper = _plane + 2*r * _width;
+		lower = upper + _width;
+		dst = _plane + r * _width;
+		i = 0;
+
+#ifdef __SSE2__
+		for (; i+16<=_width; i+=16)
+		{
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(upper + i)), _mm_loadu_si128((const __m128i*)(lower + i))));
+		}
+#endif
+
+		for (; i<_width; i++)
+		{
+			dst[i] = (upper[i] + lower[i] + 1) >> 1;
+		}
+	}
+}
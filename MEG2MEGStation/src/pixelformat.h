@@ -0,0 +1,117 @@
+/*
+ * pixelformat.h
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PIXELFORMAT_H_
+#define PIXELFORMAT_H_
+
+#include <stdint.h>
+
+#include "config.h"
+
+//! Formats of the raw frames delivered by the camera.
+enum PixelFormat
+{
+	PIXEL_MONO8,
+	PIXEL_RGB8,
+	PIXEL_YUV422,			// U Y V Y, chroma subsampled 2:1 horizontally
+	PIXEL_YUV411,			// U Y Y V Y Y, chroma subsampled 4:1 horizontally
+
+	// Raw Bayer mosaic, one byte per pixel. The name gives the colors of
+	// the top left 2x2 block, row by row.
+	PIXEL_BAYER_RGGB,
+	PIXEL_BAYER_GBRG,
+	PIXEL_BAYER_GRBG,
+	PIXEL_BAYER_BGGR
+};
+
+//! Size and rate of a video stream.
+/*!
+ * Comes from the settings on the sending station and travels with the
+ * stream to the receiver (UDP_VIDEO_FORMAT_PACKET) and to the .vid header,
+ * so it is sent as it is and should only hold fixed size fields.
+ */
+typedef struct
+{
+	uint32_t	width;			// in pixels
+	uint32_t	height;
+	uint32_t	fps;			// nominal frame rate
+} VideoFormat;
+
+inline bool isBayer(PixelFormat _format)
+{
+	return(_format >= PIXEL_BAYER_RGGB);
+}
+
+//! Size of a raw _width x _height frame of format _format in bytes.
+inline int pixelFormatFrameSize(PixelFormat _format, int _width, int _height)
+{
+	if(isBayer(_format))
+	{
+		return(_width * _height);
+	}
+
+	switch(_format)
+	{
+	case PIXEL_MONO8:
+		return(_width * _height);
+
+	case PIXEL_RGB8:
+		return(_width * _height * 3);
+
+	case PIXEL_YUV422:
+		return(_width * _height * 2);
+
+	default:
+		return(_width * _height * 3 / 2);
+	}
+}
+
+//! Horizontal chroma subsampling factor of a YUV format.
+inline int pixelFormatChromaDiv(PixelFormat _format)
+{
+	return((_format == PIXEL_YUV411) ? 4 : 2);
+}
+
+//! Raw format for the color setting and the color format name ("RGB8", "YUV422", "YUV411" or BAYER_ and the pattern, e.g. "BAYER_RGGB").
+PixelFormat parsePixelFormat(bool _color, const char* _name);
+
+/*!
+ * Check that frames of _videoFormat can be captured in _format and
+ * compressed, abort if not. YUV frames go to the JPEG encoder as they are,
+ * in whole blocks of 16x16 pixels (32x8 for YUV411), so their size should
+ * be a multiple of that. Bayer frames should have even size.
+ */
+void checkVideoFormat(PixelFormat _format, VideoFormat _videoFormat);
+
+/*!
+ * Split _nPixels pixels of a YUV frame into the Y, U and V planes. The U
+ * and V planes get _nPixels / pixelFormatChromaDiv(_format) samples. _nPixels
+ * should be a multiple of 16.
+ */
+void deinterleaveYuv(PixelFormat _format, const unsigned char* _src, int _nPixels, unsigned char* _y, unsigned char* _u, unsigned char* _v);
+
+/*!
+ * Halve the vertical resolution of the _width x _height plane _plane in
+ * place by averaging pairs of rows. The result occupies the first
+ * _height / 2 rows.
+ */
+void averageRowPairs(unsigned char* _plane, int _width, int _height);
+
+#endif /* PIXELFORMAT_H_ */
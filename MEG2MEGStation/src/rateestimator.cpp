@@ -0,0 +1,62 @@
+/*
+ * rateestimator.cpp
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "rateestimator.h"
+
+RateEstimator::RateEstimator()
+{
+	reset();
+}
+
+
+void RateEstimator::reset()
+{
+	nCheckpoints = 0;
+	newest = 0;
+}
+
+
+void RateEstimator::addSample(double _time, uint64_t _count)
+{
+	if (nCheckpoints && _time - times[newest] < DRIFT_CHECKPOINT_INTERVAL)
+	{
+		return;
+	}
+
+	newest = (newest + 1) % DRIFT_WINDOW;
+	times[newest] = _time;
+	counts[newest] = _count;
+	nCheckpoints = (nCheckpoints < DRIFT_WINDOW) ? nCheckpoints + 1 : DRIFT_WINDOW;
+}
+
+
+double RateEstimator::getRate()
+{
+	int	oldest;
+
+	if (nCheckpoints < 2)
+	{
+		return(0);
+	}
+
+	oldest = (newest - nCheckpoints + 1 + DRIFT_WINDOW) % DRIFT_WINDOW;
+
+	return(double(counts[newest] - counts[oldest]) * 1000 / (times[newest] - times[oldest]));
+}
@@ -0,0 +1,55 @@
+/*
+ * rateestimator.h
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RATEESTIMATOR_H_
+#define RATEESTIMATOR_H_
+
+#include <stdint.h>
+
+#include "config.h"
+
+//! Long-term estimate of the rate of a counter.
+/*!
+ * The counter value is sampled every DRIFT_CHECKPOINT_INTERVAL milliseconds
+ * and the rate is computed over the last DRIFT_WINDOW checkpoints, so that
+ * the timing noise of individual samples averages out.
+ */
+class RateEstimator
+{
+public:
+	RateEstimator();
+
+	//! Forget all the checkpoints.
+	void reset();
+
+	//! Add a sample: _count at time _time (in milliseconds).
+	void addSample(double _time, uint64_t _count);
+
+	//! Counts per second, 0 if not known yet.
+	double getRate();
+
+private:
+	double		times[DRIFT_WINDOW];
+	uint64_t	counts[DRIFT_WINDOW];
+	int			nCheckpoints;
+	int			newest;
+};
+
+#endif /* RATEESTIMATOR_H_ */
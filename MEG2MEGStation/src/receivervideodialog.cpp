@@ -30,6 +30,7 @@ ReceiverVideoDialog::ReceiverVideoDialog(CycDataBuffer* _cycVideoBuf, QLineEdit*
     : QDialog(parent)
 {
 	Settings	settings;
+	VideoFormat	videoFormat;
 
 	ui.setupUi(this);
 	setWindowFlags(Qt::Window | Qt::CustomizeWindowHint | Qt::WindowTitleHint| Qt::WindowSystemMenuHint | Qt::WindowMinMaxButtonsHint);
@@ -37,9 +38,15 @@ ReceiverVideoDialog::ReceiverVideoDialog(CycDataBuffer* _cycVideoBuf, QLineEdit*
 
 	// Set up video recording
 	cycVideoBuf = _cycVideoBuf;
-	videoFileWriter = new VideoFileWriter(cycVideoBuf, settings.storagePath, settings.siteId, false, _suffix);
+	// The format is not known until the remote station sends it. Stations
+	// that never send it have fixed 640x480 frames; the frame rate is
+	// unknown (0), as for the files written before the format was stored.
+	videoFormat.width = 640;
+	videoFormat.height = 480;
+	videoFormat.fps = 0;
+	videoFileWriter = new VideoFileWriter(cycVideoBuf, settings.storagePath, settings.siteId, false, videoFormat, _suffix);
     ui.videoWidget->rotate = settings.receiverRotate;
-    QObject::connect(cycVideoBuf, SIGNAL(chunkReady(unsigned char*)), ui.videoWidget, SLOT(onDrawFrame(unsigned char*)));
+    ui.videoWidget->setSource(cycVideoBuf);
 
     // Start video running
     videoFileWriter->start();
@@ -53,6 +60,12 @@ ReceiverVideoDialog::~ReceiverVideoDialog()
 }
 
 
+void ReceiverVideoDialog::setVideoFormat(VideoFormat _videoFormat)
+{
+	videoFileWriter->setVideoFormat(_videoFormat);
+}
+
+
 void ReceiverVideoDialog::stopThreads()
 {
 	// The piece of code stopping the threads should execute fast enough,
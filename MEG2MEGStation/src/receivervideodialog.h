@@ -37,6 +37,9 @@ public:
     virtual ~ReceiverVideoDialog();
     void setIsRec(bool _isRec);
 
+    //! Format of the frames coming from the remote station, for the file headers.
+    void setVideoFormat(VideoFormat _videoFormat);
+
 public slots:
 
     //! Stop all the threads associated with the dialog.
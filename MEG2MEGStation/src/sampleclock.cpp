@@ -0,0 +1,165 @@
+/*
+ * sampleclock.cpp
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+
+#include "sampleclock.h"
+
+SampleClock::SampleClock(unsigned int _sampRate)
+{
+	nominalSlope = 1000000.0 / _sampRate;
+	driftPpm.store(0);
+	residual.store(0);
+	outliers.store(0);
+	restarts.store(0);
+	reset();
+}
+
+
+void SampleClock::reset()
+{
+	nPoints = 0;
+	newest = 0;
+	nConsecOutliers = 0;
+	slope = nominalSlope;
+	intercept = 0;
+}
+
+
+void SampleClock::addPoint(uint64_t _frame, uint64_t _time)
+{
+	double	frame;
+	double	time;
+
+	if (!nPoints)
+	{
+		frame0 = _frame;
+		time0 = _time;
+	}
+
+	frame = double(int64_t(_frame - frame0));
+	time = double(int64_t(_time - time0));
+
+	if (nPoints >= CLOCK_MIN_POINTS && fabs(time - (intercept + slope * frame)) > CLOCK_OUTLIER_THRESH)
+	{
+		outliers.fetchAndAddRelaxed(1);
+		if (++nConsecOutliers < CLOCK_MAX_OUTLIERS)
+		{
+			return;
+		}
+
+		// The fit does not describe the clock any more, start over
+		restarts.fetchAndAddRelaxed(1);
+		reset();
+		frame0 = _frame;
+		time0 = _time;
+		frame = 0;
+		time = 0;
+	}
+
+	nConsecOutliers = 0;
+	newest = (newest + 1) % CLOCK_FIT_WINDOW;
+	frames[newest] = frame;
+	times[newest] = time;
+	nPoints = (nPoints < CLOCK_FIT_WINDOW) ? nPoints + 1 : CLOCK_FIT_WINDOW;
+
+	fit();
+}
+
+
+void SampleClock::fit()
+{
+	double	meanFrame = 0;
+	double	meanTime = 0;
+	double	sxx = 0;
+	double	sxy = 0;
+	double	sse = 0;
+	double	df;
+	double	err;
+	int		i;
+	int		ind;
+
+	// Two passes over the window keep the sums well conditioned
+	for (i=0; i<nPoints; i++)
+	{
+		ind = (newest - i + CLOCK_FIT_WINDOW) % CLOCK_FIT_WINDOW;
+		meanFrame += frames[ind];
+		meanTime += times[ind];
+	}
+	meanFrame /= nPoints;
+	meanTime /= nPoints;
+
+	for (i=0; i<nPoints; i++)
+	{
+		ind = (newest - i + CLOCK_FIT_WINDOW) % CLOCK_FIT_WINDOW;
+		df = frames[ind] - meanFrame;
+		sxx += df * df;
+		sxy += df * (times[ind] - meanTime);
+	}
+
+	slope = (nPoints >= CLOCK_MIN_POINTS && sxx > 0) ? sxy / sxx : nominalSlope;
+	intercept = meanTime - slope * meanFrame;
+
+	for (i=0; i<nPoints; i++)
+	{
+		ind = (newest - i + CLOCK_FIT_WINDOW) % CLOCK_FIT_WINDOW;
+		err = times[ind] - (intercept + slope * frames[ind]);
+		sse += err * err;
+	}
+
+	// Positive drift means that the sound card runs fast
+	driftPpm.store(int(lrint((nominalSlope / slope - 1) * 1e6)));
+	residual.store(int(lrint(sqrt(sse / nPoints))));
+}
+
+
+uint64_t SampleClock::getTime(uint64_t _frame)
+{
+	if (!nPoints)
+	{
+		return(0);
+	}
+
+	return(time0 + int64_t(llrint(intercept + slope * double(int64_t(_frame - frame0)))));
+}
+
+
+int SampleClock::getDriftPpm()
+{
+	return(driftPpm.load());
+}
+
+
+int SampleClock::getResidual()
+{
+	return(residual.load());
+}
+
+
+int SampleClock::getOutliers()
+{
+	return(outliers.load());
+}
+
+
+int SampleClock::getRestarts()
+{
+	return(restarts.load());
+}
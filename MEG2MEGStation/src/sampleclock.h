@@ -0,0 +1,95 @@
+/*
+ * sampleclock.h
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SAMPLECLOCK_H_
+#define SAMPLECLOCK_H_
+
+#include <stdint.h>
+#include <QAtomicInteger>
+
+#include "config.h"
+
+//! Online estimate of the sound card's sample clock.
+/*!
+ * The capture thread adds an observation for every period: the index of a
+ * frame and the system time (in microseconds) when the sound card captured
+ * it. The time of any frame is then given by a least-squares line fitted to
+ * the last CLOCK_FIT_WINDOW observations, which removes the timing noise of
+ * the individual observations. Until the fit has CLOCK_MIN_POINTS
+ * observations, the nominal sampling rate is used for the slope.
+ *
+ * Observations that are more than CLOCK_OUTLIER_THRESH microseconds away
+ * from the fit are ignored. If CLOCK_MAX_OUTLIERS of them arrive in a row
+ * (e.g. the system time was stepped), the fit is restarted.
+ *
+ * All the methods except the get*() ones returning statistics should be
+ * called from the capture thread.
+ */
+class SampleClock
+{
+public:
+	SampleClock(unsigned int _sampRate);
+
+	//! Forget all the observations, e.g. after the frame counter was reset.
+	void reset();
+
+	//! Frame _frame was captured at _time (in microseconds).
+	void addPoint(uint64_t _frame, uint64_t _time);
+
+	//! Fitted capture time of frame _frame in microseconds, 0 if not known.
+	uint64_t getTime(uint64_t _frame);
+
+	//! Deviation of the fitted sampling rate from the nominal one, in ppm.
+	int getDriftPpm();
+
+	//! RMS residual of the fit, in microseconds.
+	int getResidual();
+
+	//! Number of ignored observations since the start.
+	int getOutliers();
+
+	//! Number of times the fit was restarted since the start.
+	int getRestarts();
+
+private:
+	void fit();
+
+	double		nominalSlope;			// microseconds per frame
+
+	// Observations, relative to the first one after reset()
+	uint64_t	frame0;
+	uint64_t	time0;
+	double		frames[CLOCK_FIT_WINDOW];
+	double		times[CLOCK_FIT_WINDOW];
+	int			nPoints;
+	int			newest;
+	int			nConsecOutliers;
+
+	// time = intercept + slope * frame
+	double		slope;
+	double		intercept;
+
+	QAtomicInt	driftPpm;
+	QAtomicInt	residual;
+	QAtomicInt	outliers;
+	QAtomicInt	restarts;
+};
+
+#endif /* SAMPLECLOCK_H_ */
@@ -0,0 +1,40 @@
+/*
+ * sampleformat.h
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SAMPLEFORMAT_H_
+#define SAMPLEFORMAT_H_
+
+//! Sample formats supported for the sound cards. The values are stored in
+//! the audio files.
+enum SampleFormat
+{
+	SAMPLE_S16 = 0,
+	SAMPLE_S24 = 1,			// in the lower three bytes of 32 bits
+	SAMPLE_S32 = 2,
+	SAMPLE_FLOAT = 3
+};
+
+//! Size of a sample of format _format in bytes.
+inline int sampleFormatSize(SampleFormat _format)
+{
+	return((_format == SAMPLE_S16) ? 2 : 4);
+}
+
+#endif /* SAMPLEFORMAT_H_ */
@@ -23,6 +23,7 @@
 #include "sendervideodialog.h"
 #include "config.h"
 #include "settings.h"
+#include "datarates.h"
 
 using namespace std;
 
@@ -31,6 +32,9 @@ SenderVideoDialog::SenderVideoDialog(dc1394camera_t* _camera, int _cameraId, Sen
 {
 	char		winCaption[500];
 	Settings	settings;
+	DataRates	dataRates;
+	PixelFormat	pixelFormat;
+	VideoFormat	videoFormat;
 
 	ui.setupUi(this);
 	setWindowFlags(Qt::Window | Qt::CustomizeWindowHint | Qt::WindowTitleHint| Qt::WindowSystemMenuHint | Qt::WindowMinMaxButtonsHint);
@@ -40,16 +44,28 @@ SenderVideoDialog::SenderVideoDialog(dc1394camera_t* _camera, int _cameraId, Sen
 	sendingSocket = _sendingSocket;
 
 	// Set up video recording
-	cycVideoBufRaw = new CycDataBuffer(CIRC_VIDEO_BUFF_SZ, false);
-    cycVideoBufJpeg = new CycDataBuffer(CIRC_VIDEO_BUFF_SZ, false, _fixedStimuli);
-    cameraThread = new CameraThread(camera, cycVideoBufRaw, settings.color, settings.highFps);
-	videoFileWriter = new VideoFileWriter(cycVideoBufJpeg, settings.storagePath, settings.siteId, true, _suffix);
-	videoCompressorThread = new VideoCompressorThread(cycVideoBufRaw, cycVideoBufJpeg, settings.color, settings.jpgQuality);
+	cycVideoBufRaw = new CycDataBuffer(CycDataBuffer::sizeForRate(dataRates.rawVideo), false, NULL, CycDataBuffer::parseHugePages(settings.bufHugePages), settings.bufLockMemory);
+    cycVideoBufJpeg = new CycDataBuffer(CycDataBuffer::sizeForRate(dataRates.jpegVideo), false, _fixedStimuli, CycDataBuffer::parseHugePages(settings.bufHugePages), settings.bufLockMemory);
+    cycVideoBufRaw->setOverflowPolicy(CycDataBuffer::parseOverflowPolicy(settings.videoOverflowPolicy, true), settings.overflowBlockTimeout, settings.storagePath, uint64_t(settings.spillSize) * 1000000);
+    cycVideoBufJpeg->setOverflowPolicy(CycDataBuffer::parseOverflowPolicy(settings.videoOverflowPolicy), settings.overflowBlockTimeout, settings.storagePath, uint64_t(settings.spillSize) * 1000000);
+    pixelFormat = parsePixelFormat(settings.color, settings.colorFormat);
+    videoFormat.width = settings.videoWidth;
+    videoFormat.height = settings.videoHeight;
+    videoFormat.fps = settings.fps;
+    cameraThread = new CameraThread(camera, cycVideoBufRaw, pixelFormat, videoFormat, settings.roiLeft, settings.roiTop);
+    // The camera might not manage the requested frame rate. The buffers
+    // keep their size for the requested one, which is an upper bound.
+    videoFormat = cameraThread->getVideoFormat();
+	videoFileWriter = new VideoFileWriter(cycVideoBufJpeg, settings.storagePath, settings.siteId, true, videoFormat, _suffix);
+	videoCompressorThread = new VideoCompressorThread(cycVideoBufRaw, cycVideoBufJpeg, pixelFormat, videoFormat, settings.jpgQuality, parseDemosaicMethod(settings.demosaic));
     ui.videoWidget->rotate = settings.senderRotate;
 
-    QObject::connect(cycVideoBufJpeg, SIGNAL(chunkReady(unsigned char*)), ui.videoWidget, SLOT(onDrawFrame(unsigned char*)));
-	QObject::connect(cycVideoBufJpeg, SIGNAL(chunkReady(unsigned char*)), sendingSocket, SLOT(sendVideoPacket(unsigned char*)));
-    QObject::connect(cycVideoBufJpeg, SIGNAL(chunkReady(unsigned char*)), this, SLOT(onNewFrame(unsigned char*)));
+    ui.videoWidget->setSource(cycVideoBufJpeg);
+	sendingSocket->setVideoBuffer(cycVideoBufJpeg, videoFormat);
+	fpsX10.store(0);
+	fpsDispatcher = new ConsumerDispatcher(cycVideoBufJpeg, this, LATENCY_BACKGROUND, DISPATCH_ALL);
+	fpsTimer = new QTimer(this);
+    QObject::connect(fpsTimer, SIGNAL(timeout()), this, SLOT(onUpdateFps()));
 
 	// Setup gain/shutter sliders
     ui.shutterSlider->setMinimum(SHUTTER_MIN_VAL);
@@ -73,12 +89,15 @@ SenderVideoDialog::SenderVideoDialog(dc1394camera_t* _camera, int _cameraId, Sen
     // Start video running
     videoFileWriter->start();
     videoCompressorThread->start();
+    fpsDispatcher->start();
     cameraThread->start();
+    fpsTimer->start(GUI_UPDATE_INTERVAL);
 }
 
 
 SenderVideoDialog::~SenderVideoDialog()
 {
+	delete fpsDispatcher;
 	delete cycVideoBufRaw;
 	delete cycVideoBufJpeg;
 	delete cameraThread;
@@ -95,6 +114,8 @@ void SenderVideoDialog::stopThreads()
 	videoFileWriter->stop();
 	videoCompressorThread->stop();
 	cameraThread->stop();
+	fpsDispatcher->stop();
+	fpsTimer->stop();
 }
 
 
@@ -176,33 +197,51 @@ void SenderVideoDialog::onVRChanged(int _newVal)
 }
 
 
-void SenderVideoDialog::onNewFrame(unsigned char* _jpegBuf)
+void SenderVideoDialog::consumeChunks(CycDataBuffer*, ChunkRef* _chunks, int _nChunks)
 {
-    ChunkAttrib chunkAttrib;
-    float       fps;
-    char        fpsLabelBuff[100];
-
-    chunkAttrib = *((ChunkAttrib*)(_jpegBuf-sizeof(ChunkAttrib)));
+    int         i;
+    uint64_t    tstamp;
 
-    if (prevFrameTstamp)
+    for (i=0; i<_nChunks; i++)
     {
-        fps = 1 / (float(chunkAttrib.timestamp - prevFrameTstamp) / 1000);
-        sprintf(fpsLabelBuff, "FPS: %02.01f", fps);
+        tstamp = _chunks[i].attrib.timestamp;
 
         // Update FPS every 10 frames to make it smoother
-        if(frameCnt == 10)
+        if (prevFrameTstamp && frameCnt >= 10 && tstamp > prevFrameTstamp)
         {
-            ui.fpsLabel->setText(fpsLabelBuff);
+            fpsX10.store(int(10000 / (tstamp - prevFrameTstamp)));
             frameCnt = 0;
         }
+
+        prevFrameTstamp = tstamp;
+        frameCnt++;
     }
+}
+
+
+void SenderVideoDialog::onUpdateFps()
+{
+    char        fpsLabelBuff[100];
+    int         fps = fpsX10.load();
 
-    prevFrameTstamp = chunkAttrib.timestamp;
-    frameCnt++;
+    if (fps)
+    {
+        sprintf(fpsLabelBuff, "FPS: %02.01f", fps / 10.0);
+        ui.fpsLabel->setText(fpsLabelBuff);
+    }
 }
 
 
-void SenderVideoDialog::setIsRec(bool _isRec)
+void SenderVideoDialog::setIsRec(bool _isRec, uint64_t _startRecTstamp)
 {
-	cycVideoBufJpeg->setIsRec(_isRec);
+	DataRates	dataRates;
+
+	cycVideoBufJpeg->setIsRec(_isRec, _startRecTstamp);
+
+	// Adjust the buffers to the data rates seen during the recording
+	if (!_isRec)
+	{
+		cycVideoBufRaw->resizeForRate(dataRates.rawVideo);
+		cycVideoBufJpeg->resizeForRate(dataRates.jpegVideo);
+	}
 }
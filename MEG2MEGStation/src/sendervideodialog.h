@@ -22,6 +22,8 @@
 #define SENDERVIDEODIALOG_H
 
 #include <QDialog>
+#include <QTimer>
+#include <QAtomicInteger>
 #include "ui_sendervideodialog.h"
 #include "camerathread.h"
 #include "cycdatabuffer.h"
@@ -29,23 +31,27 @@
 #include "videocompressorthread.h"
 #include "sendingsocket.h"
 #include "fixedstimuli.h"
+#include "consumerdispatcher.h"
 
 
-class SenderVideoDialog : public QDialog
+class SenderVideoDialog : public QDialog, public ChunkConsumer
 {
     Q_OBJECT
 
 public:
     SenderVideoDialog(dc1394camera_t* _camera, int _cameraId, SendingSocket* _sendingSocket, QLineEdit* _suffix, FixedStimuli* _fixedStimuli, QWidget *parent = 0);
     virtual ~SenderVideoDialog();
-    void setIsRec(bool _isRec);
+    void setIsRec(bool _isRec, uint64_t _startRecTstamp=0);
+
+    //! Measure the frame rate. Called by fpsDispatcher.
+    virtual void consumeChunks(CycDataBuffer* _cycBuf, ChunkRef* _chunks, int _nChunks);
 
 public slots:
     void onShutterChanged(int _newVal);
     void onGainChanged(int _newVal);
     void onUVChanged(int _newVal);
     void onVRChanged(int _newVal);
-    void onNewFrame(unsigned char* _jpegBuf);
+    void onUpdateFps();
 
     //! Stop all the threads associated with the dialog.
     /*!
@@ -65,10 +71,14 @@ private:
     VideoFileWriter*		videoFileWriter;
     VideoCompressorThread*	videoCompressorThread;
     SendingSocket*			sendingSocket;
+    ConsumerDispatcher*		fpsDispatcher;
+    QTimer*					fpsTimer;
 
-    // This variables are used for showing the FPS
+    // This variables are used for showing the FPS. The first two are only
+    // accessed by fpsDispatcher.
     uint64_t                prevFrameTstamp=0;
     int                     frameCnt=0;
+    QAtomicInt				fpsX10;				// frames per 10 seconds, 0 if unknown
 };
 
 #endif // SENDERVIDEODIALOG_H
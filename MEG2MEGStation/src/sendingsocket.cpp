@@ -18,7 +18,14 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
 
 #include "config.h"
 #include "sendingsocket.h"
@@ -27,76 +34,305 @@
 
 using namespace std;
 
+void packChunkHeader(const ChunkAttrib& _attrib, unsigned char* _dst)
+{
+	NetChunkHeader	header;
+
+	memset(&header, 0, sizeof(header));
+	header.chunkSize = _attrib.chunkSize;
+	header.timestamp = _attrib.timestamp;
+	header.id = _attrib.id;
+	header.isRec = _attrib.isRec;
+
+	memcpy(_dst, &header, sizeof(header));
+}
+
+
+ChunkAttrib unpackChunkHeader(const unsigned char* _src)
+{
+	NetChunkHeader	header;
+	ChunkAttrib		res;
+
+	memcpy(&header, _src, sizeof(header));
+
+	memset(&res, 0, sizeof(res));
+	res.chunkSize = header.chunkSize;
+	res.timestamp = header.timestamp;
+	res.id = header.id;
+	res.isRec = header.isRec;
+
+	return(res);
+}
+
+
 SendingSocket::SendingSocket()
 {
-	Settings settings;
+	Settings	settings;
+	const char*	gains;
+	char*		end;
+	int			ch;
 
-	udpSocket = new QUdpSocket();
-	udpClientAddr = new QHostAddress(settings.udpRemoteReceiverAddr);
-	udpClientPort = settings.udpRemoteReceiverPort;
-	socketMutex = new QMutex();
+	sockFd = socket(AF_INET, SOCK_DGRAM, 0);
+	if(sockFd == -1)
+	{
+		cerr << "Error creating UDP socket: " << strerror(errno) << endl;
+		abort();
+	}
+
+	memset(&udpClientAddr, 0, sizeof(udpClientAddr));
+	udpClientAddr.sin_family = AF_INET;
+	udpClientAddr.sin_port = htons(settings.udpRemoteReceiverPort);
+	if(inet_pton(AF_INET, settings.udpRemoteReceiverAddr, &(udpClientAddr.sin_addr)) != 1)
+	{
+		cerr << "Invalid remote receiver address: " << settings.udpRemoteReceiverAddr << endl;
+		abort();
+	}
+
+	audioFormat = AudioFormat(AudioFormat::parseSampleFormat(settings.sampleFormat), settings.nSenderChans);
+
+	sendChannel = settings.sendChannel;
+	if(sendChannel >= audioFormat.getChans() || sendChannel < -1)
+	{
+		cerr << "Invalid audio channel to send: " << sendChannel << ", should be between -1 and " << audioFormat.getChans() - 1 << endl;
+		abort();
+	}
+
+	// Gains not given default to equal ones
+	gains = settings.sendMixGains;
+	for(ch=0; ch<audioFormat.getChans(); ch++)
+	{
+		mixGains[ch] = 1.0f / audioFormat.getChans();
+	}
+
+	for(ch=0; *gains && ch<audioFormat.getChans(); ch++)
+	{
+		mixGains[ch] = strtof(gains, &end);
+		if(end == gains)
+		{
+			cerr << "Invalid audio mix gains: " << settings.sendMixGains << endl;
+			abort();
+		}
+
+		gains = end + strspn(end, ", ");
+	}
+
+	periodsPerPacket = settings.periodsPerPacket;
+	if(periodsPerPacket < 1 || periodsPerPacket > AUDIO_MAX_PACKET_PERIODS)
+	{
+		cerr << "Invalid number of audio periods per packet: " << periodsPerPacket << ", should be between 1 and " << AUDIO_MAX_PACKET_PERIODS << endl;
+		abort();
+	}
+	batchLen = 0;
+	batchPeriods = 0;
+
+	audioBuf = NULL;
+	videoBuf = NULL;
+	audioDispatcher = NULL;
+	videoDispatcher = NULL;
 }
 
 
 SendingSocket::~SendingSocket()
 {
-	delete socketMutex;
-	delete udpClientAddr;
-	delete udpSocket;
+	if(audioDispatcher)
+	{
+		audioDispatcher->stop();
+		delete audioDispatcher;
+	}
+
+	if(videoDispatcher)
+	{
+		videoDispatcher->stop();
+		delete videoDispatcher;
+	}
+
+	close(sockFd);
+}
+
+
+void SendingSocket::setAudioBuffer(CycDataBuffer* _audioBuf)
+{
+	audioBuf = _audioBuf;
+	audioDispatcher = new ConsumerDispatcher(audioBuf, this, LATENCY_REALTIME, DISPATCH_ALL);
+	audioDispatcher->start();
 }
 
 
-void SendingSocket::sendPacket(unsigned char* _data, char _packetType)
+void SendingSocket::setVideoBuffer(CycDataBuffer* _videoBuf, VideoFormat _videoFormat)
 {
-	unsigned int	i;
-	qint64			rc;
-	ChunkAttrib 	chunkAttrib;
-	chunkAttrib = *((ChunkAttrib*)(_data-sizeof(ChunkAttrib)));
-	char			buf[chunkAttrib.chunkSize + sizeof(ChunkAttrib) + 1];
+	videoFormat = _videoFormat;
+	framesSinceFormat = 0;
+	videoBuf = _videoBuf;
+	videoDispatcher = new ConsumerDispatcher(videoBuf, this, LATENCY_REALTIME, DISPATCH_ALL);
+	videoDispatcher->start();
+}
 
-	// Send the data over UDP. The first byte of the datagram contains type
-	// identifier (audio/video).
 
-	// Copy the data. If audio data, send only one channel.
-	if(_packetType == UDP_AUDIO_PACKET)
-	{
-		chunkAttrib.chunkSize /= N_CHANS_SENDER;
+void SendingSocket::consumeChunks(CycDataBuffer* _cycBuf, ChunkRef* _chunks, int _nChunks)
+{
+	int		i;
 
-		for(i=0; i<chunkAttrib.chunkSize/sizeof(AUDIO_DATA_TYPE); i++)
+	for(i=0; i<_nChunks; i++)
+	{
+		if(_cycBuf == audioBuf)
 		{
-			((AUDIO_DATA_TYPE*)(buf+1+sizeof(ChunkAttrib)))[i] = ((AUDIO_DATA_TYPE*)_data)[N_CHANS_SENDER*i];
+			sendAudio(_chunks[i].data, _chunks[i].attrib);
 		}
+		else
+		{
+			sendVideo(_chunks[i].data, _chunks[i].attrib);
+		}
+	}
+}
+
+
+void SendingSocket::sendVideo(unsigned char* _data, ChunkAttrib _chunkAttrib)
+{
+	unsigned char	header[sizeof(NetChunkHeader) + sizeof(uint32_t) + 1];
+	struct iovec	iov[2];
+	uint32_t		offset;
+
+	if(!framesSinceFormat)
+	{
+		header[0] = UDP_VIDEO_FORMAT_PACKET;
+		memcpy(header+1, &videoFormat, sizeof(VideoFormat));
+
+		iov[0].iov_base = header;
+		iov[0].iov_len = sizeof(VideoFormat) + 1;
+		sendDatagram(iov, 1);
+	}
+	framesSinceFormat = (framesSinceFormat + 1) % videoFormat.fps;
+
+	if(_chunkAttrib.chunkSize <= UDP_VIDEO_FRAGMENT_SIZE)
+	{
+		sendPacket(_data, _chunkAttrib, UDP_VIDEO_PACKET);
+		return;
+	}
+
+	header[0] = UDP_VIDEO_FRAGMENT_PACKET;
+	packChunkHeader(_chunkAttrib, header+1);
+
+	for(offset=0; offset<uint32_t(_chunkAttrib.chunkSize); offset+=UDP_VIDEO_FRAGMENT_SIZE)
+	{
+		memcpy(header+1+sizeof(NetChunkHeader), &offset, sizeof(uint32_t));
+
+		iov[0].iov_base = header;
+		iov[0].iov_len = sizeof(header);
+		iov[1].iov_base = _data + offset;
+		iov[1].iov_len = min(uint32_t(UDP_VIDEO_FRAGMENT_SIZE), _chunkAttrib.chunkSize - offset);
+		sendDatagram(iov, 2);
+	}
+}
+
+
+void SendingSocket::sendAudio(unsigned char* _data, ChunkAttrib _chunkAttrib)
+{
+	int				nFrames;
+	ChunkAttrib 	chunkAttrib = _chunkAttrib;
+
+	// Send only one channel or a mix
+	nFrames = chunkAttrib.chunkSize / audioFormat.getFrameSize();
+	if(sendChannel >= 0)
+	{
+		audioFormat.extractChannel(_data, nFrames, sendChannel, (NET_AUDIO_TYPE*)audioPacket);
 	}
 	else
 	{
-		memcpy(buf+1+sizeof(ChunkAttrib), _data, chunkAttrib.chunkSize);
+		audioFormat.mixDown(_data, nFrames, mixGains, (NET_AUDIO_TYPE*)audioPacket);
 	}
+	chunkAttrib.chunkSize = nFrames * N_CHANS_NET * sizeof(NET_AUDIO_TYPE);
 
-	buf[0] = _packetType;
-	*((ChunkAttrib*)(buf+1)) = chunkAttrib;
+	if(periodsPerPacket == 1)
+	{
+		sendPacket(audioPacket, chunkAttrib, UDP_AUDIO_PACKET);
+		return;
+	}
 
-	socketMutex->lock();
-	rc = udpSocket->writeDatagram(buf, chunkAttrib.chunkSize + sizeof(ChunkAttrib) + 1, *udpClientAddr, udpClientPort);
-	socketMutex->unlock();
+	// Append the period to the batch, sending the batch first if the period
+	// does not fit
+	if(batchPeriods && batchLen + sizeof(NetChunkHeader) + chunkAttrib.chunkSize > MAX_DATAGRAM_SIZE)
+	{
+		sendBatch();
+	}
 
-	if(rc == -1)
+	if(!batchPeriods)
 	{
-		cerr << "Error sending the datagram: " << udpSocket->errorString().toLatin1().data() << endl;
+		batchPacket[0] = UDP_AUDIO_BATCH_PACKET;
+		batchLen = 2;
 	}
-	else if(rc != (chunkAttrib.chunkSize + sizeof(ChunkAttrib) + 1))
+
+	packChunkHeader(chunkAttrib, batchPacket + batchLen);
+	memcpy(batchPacket + batchLen + sizeof(NetChunkHeader), audioPacket, chunkAttrib.chunkSize);
+	batchLen += sizeof(NetChunkHeader) + chunkAttrib.chunkSize;
+	batchPeriods++;
+
+	if(batchPeriods == periodsPerPacket)
 	{
-		cerr << "Error sending the datagram: only " << rc << " bytes were sent" << endl;
+		sendBatch();
 	}
 }
 
 
-void SendingSocket::sendAudioPacket(unsigned char* _data)
+void SendingSocket::sendBatch()
 {
-	sendPacket(_data, UDP_AUDIO_PACKET);
+	struct iovec	iov;
+
+	batchPacket[1] = batchPeriods;
+
+	iov.iov_base = batchPacket;
+	iov.iov_len = batchLen;
+	sendDatagram(&iov, 1);
+
+	batchPeriods = 0;
+}
+
+
+void SendingSocket::sendPacket(unsigned char* _data, ChunkAttrib _chunkAttrib, char _packetType)
+{
+	unsigned char	header[sizeof(NetChunkHeader) + 1];
+	struct iovec	iov[2];
+
+	// Send the data over UDP. The first byte of the datagram contains type
+	// identifier (audio/video), followed by the chunk attributes and the
+	// data, which is sent directly from _data.
+	header[0] = _packetType;
+	packChunkHeader(_chunkAttrib, header+1);
+
+	iov[0].iov_base = header;
+	iov[0].iov_len = sizeof(header);
+	iov[1].iov_base = _data;
+	iov[1].iov_len = _chunkAttrib.chunkSize;
+
+	sendDatagram(iov, 2);
 }
 
 
-void SendingSocket::sendVideoPacket(unsigned char* _data)
+void SendingSocket::sendDatagram(struct iovec* _iov, int _iovCnt)
 {
-	sendPacket(_data, UDP_VIDEO_PACKET);
+	ssize_t			rc;
+	size_t			len = 0;
+	struct msghdr	msg;
+	int				i;
+
+	for(i=0; i<_iovCnt; i++)
+	{
+		len += _iov[i].iov_len;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_name = &udpClientAddr;
+	msg.msg_namelen = sizeof(udpClientAddr);
+	msg.msg_iov = _iov;
+	msg.msg_iovlen = _iovCnt;
+
+	rc = sendmsg(sockFd, &msg, 0);
+
+	if(rc == -1)
+	{
+		cerr << "Error sending the datagram: " << strerror(errno) << endl;
+	}
+	else if(rc != (ssize_t)len)
+	{
+		cerr << "Error sending the datagram: only " << rc << " bytes were sent" << endl;
+	}
 }
@@ -21,28 +21,108 @@
 #ifndef SENDINGSOCKET_H_
 #define SENDINGSOCKET_H_
 
-#include <QUdpSocket>
-#include <QMutex>
+#include <netinet/in.h>
+#include <sys/uio.h>
 
-class SendingSocket : public QObject
+#include "config.h"
+#include "cycdatabuffer.h"
+#include "consumerdispatcher.h"
+#include "audioformat.h"
+#include "pixelformat.h"
+
+//! Chunk attributes as they are sent over the network.
+/*!
+ * The layout is fixed and the same as that of ChunkAttrib before it got
+ * the audio capture timestamps; ChunkAttrib used to be sent as it was, so
+ * stations of either version understand each other. The capture timestamps
+ * stay on the sending station and are received as zeros.
+ */
+typedef struct __attribute__((packed))
 {
-	Q_OBJECT
+	int32_t		chunkSize;
+	uint32_t	reserved1;
+	uint64_t	timestamp;
+	uint64_t	id;
+	uint8_t		isRec;
+	uint8_t		reserved2[7];
+} NetChunkHeader;
+
+//! Write the network header for _attrib to _dst (sizeof(NetChunkHeader) bytes).
+void packChunkHeader(const ChunkAttrib& _attrib, unsigned char* _dst);
+
+//! Attributes from the network header at _src.
+ChunkAttrib unpackChunkHeader(const unsigned char* _src);
 
+
+//! Sends the audio and video streams to the remote receiver over UDP.
+/*!
+ * Each stream is read by its own ConsumerDispatcher, so the sending does not
+ * depend on the GUI event loop. Both dispatchers use the same socket;
+ * sendmsg() on a datagram socket is atomic, so no locking is needed.
+ *
+ * A datagram starts with its type. A video frame or a single audio period
+ * (UDP_VIDEO_PACKET, UDP_AUDIO_PACKET) follows as its NetChunkHeader and
+ * data. If several audio periods are sent per datagram
+ * (UDP_AUDIO_BATCH_PACKET), the type is followed by their number (one byte)
+ * and by the NetChunkHeader and data of each period in turn. With one
+ * period per datagram (the default) only UDP_AUDIO_PACKET is sent, which
+ * the stations without batching understand as well.
+ *
+ * Video frames larger than UDP_VIDEO_FRAGMENT_SIZE are split over several
+ * UDP_VIDEO_FRAGMENT_PACKET datagrams, each holding the NetChunkHeader of the
+ * whole frame, the offset of the fragment in the frame (uint32_t) and the
+ * fragment. The VideoFormat of the frames is sent (UDP_VIDEO_FORMAT_PACKET)
+ * before the first frame and then once a second, so that the receiver
+ * learns it also if it is started later.
+ */
+class SendingSocket : public ChunkConsumer
+{
 public:
 	SendingSocket();
 	virtual ~SendingSocket();
 
-public slots:
-    void sendAudioPacket(unsigned char* _data);
-    void sendVideoPacket(unsigned char* _data);
+	//! Start sending all the chunks inserted into _audioBuf.
+	void setAudioBuffer(CycDataBuffer* _audioBuf);
+
+	//! Start sending all the chunks inserted into _videoBuf, frames of _videoFormat.
+	void setVideoBuffer(CycDataBuffer* _videoBuf, VideoFormat _videoFormat);
+
+	virtual void consumeChunks(CycDataBuffer* _cycBuf, ChunkRef* _chunks, int _nChunks);
 
 private:
-	QUdpSocket*	  	udpSocket;
-	QHostAddress* 	udpClientAddr;
-	int				udpClientPort;
-	QMutex*			socketMutex;
+	int						sockFd;
+	struct sockaddr_in		udpClientAddr;
+
+	CycDataBuffer*			audioBuf;
+	CycDataBuffer*			videoBuf;
+	ConsumerDispatcher*		audioDispatcher;
+	ConsumerDispatcher*		videoDispatcher;
+
+	// Only one channel of audio is sent, in the network format: either
+	// channel sendChannel of the microphones or, if it is negative, their
+	// mix with mixGains. It is written to audioPacket, which is used by the
+	// audio dispatcher's thread only.
+	AudioFormat				audioFormat;
+	int						sendChannel;
+	float					mixGains[AUDIO_MAX_CHANS];
+	unsigned char			audioPacket[MAX_DATAGRAM_SIZE];
+
+	// Periods waiting to be sent together, also used by the audio
+	// dispatcher's thread only
+	int						periodsPerPacket;
+	unsigned char			batchPacket[MAX_DATAGRAM_SIZE];
+	size_t					batchLen;		// in bytes
+	int						batchPeriods;
+
+	// Used by the video dispatcher's thread only
+	VideoFormat				videoFormat;
+	uint32_t				framesSinceFormat;
 
-	void sendPacket(unsigned char* _data, char _packetType);
+	void sendVideo(unsigned char* _data, ChunkAttrib _chunkAttrib);
+	void sendAudio(unsigned char* _data, ChunkAttrib _chunkAttrib);
+	void sendBatch();
+	void sendPacket(unsigned char* _data, ChunkAttrib _chunkAttrib, char _packetType);
+	void sendDatagram(struct iovec* _iov, int _iovCnt);
 };
 
 #endif /* SENDINGSOCKET_H_ */
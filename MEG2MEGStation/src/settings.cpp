@@ -79,6 +79,29 @@ Settings::Settings()
 		jpgQuality = settings.value("video/jpeg_quality").toInt();
 	}
 
+	// Number of threads compressing the frames (1 to VIDEO_MAX_COMPRESSORS)
+	if(!settings.contains("video/compressor_threads"))
+	{
+		settings.setValue("video/compressor_threads", 2);
+		compressorThreads = 2;
+	}
+	else
+	{
+		compressorThreads = settings.value("video/compressor_threads").toInt();
+	}
+
+	// CPUs the compressor threads are pinned to, separated by commas. The
+	// threads are assigned to the listed CPUs in turn. Empty for no pinning.
+	if(!settings.contains("video/compressor_cpus"))
+	{
+		settings.setValue("video/compressor_cpus", "");
+		compressorCpus[0] = 0;
+	}
+	else
+	{
+		sprintf(compressorCpus, settings.value("video/compressor_cpus").toString().toLocal8Bit().data());
+	}
+
 	// Use color mode
 	if(!settings.contains("video/color"))
 	{
@@ -90,6 +113,33 @@ Settings::Settings()
 		color = settings.value("video/color").toBool();
 	}
 
+	// Format of the color frames from the camera: RGB8, YUV422, YUV411 or
+	// raw Bayer (BAYER_RGGB, BAYER_GBRG, BAYER_GRBG or BAYER_BGGR, as given
+	// by the sensor). The YUV formats need less bandwidth on the bus and are
+	// compressed without color conversion; Bayer needs the least and is
+	// demosaiced by the compressor threads.
+	if(!settings.contains("video/color_format"))
+	{
+		settings.setValue("video/color_format", "RGB8");
+		sprintf(colorFormat, "RGB8");
+	}
+	else
+	{
+		sprintf(colorFormat, settings.value("video/color_format").toString().toLocal8Bit().data());
+	}
+
+	// Demosaic method for Bayer frames: bilinear or edge (interpolate green
+	// along edges, sharper but a bit slower)
+	if(!settings.contains("video/demosaic"))
+	{
+		settings.setValue("video/demosaic", "bilinear");
+		sprintf(demosaic, "bilinear");
+	}
+	else
+	{
+		sprintf(demosaic, settings.value("video/demosaic").toString().toLocal8Bit().data());
+	}
+
 	// Rotate sender window
 	if(!settings.contains("video/sender_rotate"))
 	{
@@ -112,15 +162,60 @@ Settings::Settings()
 		receiverRotate = settings.value("video/receiver_rotate").toBool();
 	}
 
-	// Use high (60 FPS) frame rate
-	if(!settings.contains("video/high_fps"))
+	// Frame size. Sizes other than 640x480 are captured in Format7 mode.
+	if(!settings.contains("video/width"))
 	{
-		settings.setValue("video/high_fps", false);
-		highFps = true;
+		settings.setValue("video/width", 640);
+		videoWidth = 640;
 	}
 	else
 	{
-		highFps = settings.value("video/high_fps").toBool();
+		videoWidth = settings.value("video/width").toInt();
+	}
+
+	if(!settings.contains("video/height"))
+	{
+		settings.setValue("video/height", 480);
+		videoHeight = 480;
+	}
+	else
+	{
+		videoHeight = settings.value("video/height").toInt();
+	}
+
+	// Position of the frame on the sensor (region of interest). Anything
+	// but 0, 0 is captured in Format7 mode. Must be even for Bayer frames.
+	if(!settings.contains("video/roi_left"))
+	{
+		settings.setValue("video/roi_left", 0);
+		roiLeft = 0;
+	}
+	else
+	{
+		roiLeft = settings.value("video/roi_left").toInt();
+	}
+
+	if(!settings.contains("video/roi_top"))
+	{
+		settings.setValue("video/roi_top", 0);
+		roiTop = 0;
+	}
+	else
+	{
+		roiTop = settings.value("video/roi_top").toInt();
+	}
+
+	// Frame rate. The standard modes support 15, 30, 60, 120 and 240 FPS
+	// (depending on the camera); other rates are captured in Format7 mode.
+	// Defaults to the older video/high_fps setting (60 or 30 FPS).
+	if(!settings.contains("video/fps"))
+	{
+		fps = (settings.contains("video/high_fps") && settings.value("video/high_fps").toBool()) ? 60 : 30;
+		settings.setValue("video/fps", fps);
+	}
+	else
+	{
+		fps = settings.value("video/fps").toInt();
 	}
 
 
@@ -139,6 +234,77 @@ Settings::Settings()
 		sampRate = settings.value("audio/sampling_rate").toInt();
 	}
 
+	// Sample format of the sound cards (S16, S24, S32 or FLOAT)
+	if(!settings.contains("audio/sample_format"))
+	{
+		settings.setValue("audio/sample_format", "S16");
+		sprintf(sampleFormat, "S16");
+	}
+	else
+	{
+		sprintf(sampleFormat, settings.value("audio/sample_format").toString().toLocal8Bit().data());
+	}
+
+	// Number of channels captured from the microphones (1 to 8)
+	if(!settings.contains("audio/sender_channels"))
+	{
+		settings.setValue("audio/sender_channels", 2);
+		nSenderChans = 2;
+	}
+	else
+	{
+		nSenderChans = settings.value("audio/sender_channels").toInt();
+	}
+
+	// Microphone channel sent to the remote site (counting from 0), or -1 to
+	// send a mix of all the channels
+	if(!settings.contains("audio/send_channel"))
+	{
+		settings.setValue("audio/send_channel", 0);
+		sendChannel = 0;
+	}
+	else
+	{
+		sendChannel = settings.value("audio/send_channel").toInt();
+	}
+
+	// Gains of the channels in the mix, separated by commas. Empty for
+	// equal gains that add up to one.
+	if(!settings.contains("audio/send_mix_gains"))
+	{
+		settings.setValue("audio/send_mix_gains", "");
+		sendMixGains[0] = 0;
+	}
+	else
+	{
+		sprintf(sendMixGains, settings.value("audio/send_mix_gains").toString().toLocal8Bit().data());
+	}
+
+	// Number of periods sent in one datagram (1 to AUDIO_MAX_PACKET_PERIODS).
+	// More periods per datagram mean fewer packets on the network but add
+	// the duration of the extra periods to the latency.
+	if(!settings.contains("audio/periods_per_packet"))
+	{
+		settings.setValue("audio/periods_per_packet", 1);
+		periodsPerPacket = 1;
+	}
+	else
+	{
+		periodsPerPacket = settings.value("audio/periods_per_packet").toInt();
+	}
+
+	// Number of channels played to the speakers (1 to 8). All of them play
+	// the same received audio.
+	if(!settings.contains("audio/receiver_channels"))
+	{
+		settings.setValue("audio/receiver_channels", 1);
+		nReceiverChans = 1;
+	}
+	else
+	{
+		nReceiverChans = settings.value("audio/receiver_channels").toInt();
+	}
+
 	// Frames per period
 	if(!settings.contains("audio/frames_per_period"))
 	{
@@ -172,15 +338,17 @@ Settings::Settings()
 		nReceiverPeriods = settings.value("audio/num_receiver_periods").toInt();
 	}
 
-	// Speaker buffer size (in frames)
-	if(!settings.contains("audio/speaker_buffer_size"))
+	// Minimum depth of the speaker jitter buffer (in periods). It replaces
+	// audio/speaker_buffer_size, the size of the former fixed buffer, which
+	// is ignored.
+	if(!settings.contains("audio/jitter_min_depth"))
 	{
-		settings.setValue("audio/speaker_buffer_size", 4);
-		spkBufSz = 4;
+		settings.setValue("audio/jitter_min_depth", 2);
+		jitterMinDepth = 2;
 	}
 	else
 	{
-		spkBufSz = settings.value("audio/speaker_buffer_size").toInt();
+		jitterMinDepth = settings.value("audio/jitter_min_depth").toInt();
 	}
 
 	// Input audio device
@@ -205,6 +373,144 @@ Settings::Settings()
 		sprintf(outAudioDev, settings.value("audio/output_audio_device").toString().toLocal8Bit().data());
 	}
 
+	// Transfer the audio directly from/to the sound card's DMA area
+	if(!settings.contains("audio/mmap"))
+	{
+		settings.setValue("audio/mmap", false);
+		audioMmap = false;
+	}
+	else
+	{
+		audioMmap = settings.value("audio/mmap").toBool();
+	}
+
+	// Store the audio files losslessly compressed (16- and 24-bit formats).
+	// Off by default, since the tools that read the raw records do not
+	// understand the compressed ones.
+	if(!settings.contains("audio/compress_files"))
+	{
+		settings.setValue("audio/compress_files", false);
+		compressAudioFiles = false;
+	}
+	else
+	{
+		compressAudioFiles = settings.value("audio/compress_files").toBool();
+	}
+
+
+	//---------------------------------------------------------------------
+	// Buffer settings
+	//
+
+	// What to do when a video buffer overflows (block, drop_newest,
+	// drop_oldest or spill). Block only applies to the buffer filled by the
+	// compressor threads; the camera and the network cannot wait and drop
+	// the newest frame instead.
+	if(!settings.contains("buffers/video_overflow_policy"))
+	{
+		settings.setValue("buffers/video_overflow_policy", "drop_newest");
+		sprintf(videoOverflowPolicy, "drop_newest");
+	}
+	else
+	{
+		sprintf(videoOverflowPolicy, settings.value("buffers/video_overflow_policy").toString().toLocal8Bit().data());
+	}
+
+	// What to do when an audio buffer overflows (drop_newest, drop_oldest or
+	// spill). The audio comes from the realtime microphone thread and from
+	// the network, neither of which can wait, so block is not available.
+	if(!settings.contains("buffers/audio_overflow_policy"))
+	{
+		settings.setValue("buffers/audio_overflow_policy", "drop_newest");
+		sprintf(audioOverflowPolicy, "drop_newest");
+	}
+	else
+	{
+		sprintf(audioOverflowPolicy, settings.value("buffers/audio_overflow_policy").toString().toLocal8Bit().data());
+	}
+
+	// How long the "block" policy waits before dropping the data (in ms)
+	if(!settings.contains("buffers/overflow_block_timeout"))
+	{
+		settings.setValue("buffers/overflow_block_timeout", 20);
+		overflowBlockTimeout = 20;
+	}
+	else
+	{
+		overflowBlockTimeout = settings.value("buffers/overflow_block_timeout").toInt();
+	}
+
+	// Size of the disk-backed overflow area used by the "spill" policy (in MB)
+	if(!settings.contains("buffers/spill_size"))
+	{
+		settings.setValue("buffers/spill_size", 1000);
+		spillSize = 1000;
+	}
+	else
+	{
+		spillSize = settings.value("buffers/spill_size").toInt();
+	}
+
+	// Back the circular buffers with huge pages (none, transparent or
+	// hugetlb)
+	if(!settings.contains("buffers/huge_pages"))
+	{
+		settings.setValue("buffers/huge_pages", "none");
+		sprintf(bufHugePages, "none");
+	}
+	else
+	{
+		sprintf(bufHugePages, settings.value("buffers/huge_pages").toString().toLocal8Bit().data());
+	}
+
+	// Lock the circular buffers in memory
+	if(!settings.contains("buffers/lock_memory"))
+	{
+		settings.setValue("buffers/lock_memory", false);
+		bufLockMemory = false;
+	}
+	else
+	{
+		bufLockMemory = settings.value("buffers/lock_memory").toBool();
+	}
+
+	// How many seconds of data the buffers feeding the file writers and
+	// the network should hold in addition to the pre-roll (the buffers are
+	// sized accordingly)
+	if(!settings.contains("buffers/history"))
+	{
+		settings.setValue("buffers/history", 10.0);
+		bufHistory = 10.0;
+	}
+	else
+	{
+		bufHistory = settings.value("buffers/history").toDouble();
+	}
+
+	// Same for the uncompressed video, which only feeds the compressor
+	if(!settings.contains("buffers/raw_video_history"))
+	{
+		settings.setValue("buffers/raw_video_history", 1.0);
+		rawVideoBufHistory = 1.0;
+	}
+	else
+	{
+		rawVideoBufHistory = settings.value("buffers/raw_video_history").toDouble();
+	}
+
+	// How many seconds of data preceding the start of the recording are
+	// stored in the files (0 to disable). The buffers are enlarged
+	// accordingly.
+	if(!settings.contains("buffers/pre_roll"))
+	{
+		settings.setValue("buffers/pre_roll", 0.0);
+		preRoll = 0;
+	}
+	else
+	{
+		preRoll = settings.value("buffers/pre_roll").toDouble();
+	}
+
 
 	//---------------------------------------------------------------------
 	// Misc settings
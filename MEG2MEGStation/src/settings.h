@@ -40,19 +40,46 @@ public:
 
 	// video
 	int				jpgQuality;
+	int				compressorThreads;
+	char			compressorCpus[500];
 	bool			color;
+	char			colorFormat[500];
+	char			demosaic[500];
 	bool			receiverRotate;
 	bool			senderRotate;
-	bool			highFps;
+	int				videoWidth;
+	int				videoHeight;
+	int				roiLeft;
+	int				roiTop;
+	int				fps;
 
 	// audio
 	unsigned int	sampRate;
 	unsigned int	framesPerPeriod;
+	char			sampleFormat[500];
+	int				nSenderChans;
+	int				sendChannel;
+	char			sendMixGains[500];
+	int				periodsPerPacket;
+	int				nReceiverChans;
 	unsigned int	nSenderPeriods;
 	unsigned int	nReceiverPeriods;
-	unsigned int	spkBufSz;
+	unsigned int	jitterMinDepth;
 	char			inpAudioDev[500];
 	char			outAudioDev[500];
+	bool			audioMmap;
+	bool			compressAudioFiles;
+
+	// buffers
+	char			videoOverflowPolicy[500];
+	char			audioOverflowPolicy[500];
+	int				overflowBlockTimeout;
+	unsigned int	spillSize;
+	char			bufHugePages[500];
+	bool			bufLockMemory;
+	double			bufHistory;
+	double			rawVideoBufHistory;
+	double			preRoll;
 
 	// misc
 	char			storagePath[500];
@@ -25,76 +25,17 @@
 
 using namespace std;
 
-SpeakerThread::SpeakerThread(NonBlockingBuffer* _buffer)
+SpeakerThread::SpeakerThread(DriftResampler* _buffer)
 {
-	int						rc;
-	snd_pcm_hw_params_t*	params;
-	unsigned int			sampRate;
-	snd_pcm_uframes_t		framesPerPeriod;
-
 	buffer = _buffer;
 
-	// Open PCM device for playback
-	rc = snd_pcm_open(&sndHandle, settings.outAudioDev, SND_PCM_STREAM_PLAYBACK, 0);
-	if (rc < 0)
-	{
-		cerr << "unable to open pcm device: " << snd_strerror(rc) << endl;
-	    exit(EXIT_FAILURE);
-	}
-
-	snd_pcm_hw_params_alloca(&params);			// Allocate a hardware parameters object
-	snd_pcm_hw_params_any(sndHandle, params);	// Fill it in with default values
-
-	// Set the desired hardware parameters
-	snd_pcm_hw_params_set_access(sndHandle, params, SND_PCM_ACCESS_RW_INTERLEAVED);
-	snd_pcm_hw_params_set_format(sndHandle, params, AUDIO_FORMAT);
-	snd_pcm_hw_params_set_channels(sndHandle, params, N_CHANS_RECEIVER);
-
-	// Set sampling rate
-	sampRate = settings.sampRate;
-	snd_pcm_hw_params_set_rate_near(sndHandle, params, &sampRate, NULL);
-
-	// Set period size
-	framesPerPeriod = settings.framesPerPeriod;
-	snd_pcm_hw_params_set_period_size_near(sndHandle, params, &framesPerPeriod, NULL);
-
-    /* Set number of periods */
-    if (snd_pcm_hw_params_set_periods(sndHandle, params, settings.nReceiverPeriods, 0) < 0)
-    {
-      cerr << "Error setting periods" << endl;
-      abort();
-    }
-
-	// Write the parameters to the driver
-	rc = snd_pcm_hw_params(sndHandle, params);
-	if (rc < 0)
-	{
-	    cerr << "unable to set hw parameters: " << snd_strerror(rc) << endl;
-	    exit(EXIT_FAILURE);
-	}
-
-	// Verify the parameters
-	sampRate = 0;
-	snd_pcm_hw_params_get_rate(params, &sampRate, NULL);
-	if (sampRate != settings.sampRate)
-	{
-		cerr << "unable to set sampling rate: requested " << settings.sampRate << ", actual " << sampRate << endl;
-		exit(EXIT_FAILURE);
-	}
-
-	framesPerPeriod = 0;
-	snd_pcm_hw_params_get_period_size(params, &framesPerPeriod, NULL);
-	if (settings.framesPerPeriod != framesPerPeriod)
-	{
-		cerr << "unable to set frames per period: requested " << settings.framesPerPeriod << ", actual " << framesPerPeriod << endl;
-		exit(EXIT_FAILURE);
-	}
+	device = new AlsaDevice(settings.outAudioDev, SND_PCM_STREAM_PLAYBACK, AudioFormat(AudioFormat::parseSampleFormat(settings.sampleFormat), settings.nReceiverChans), settings.sampRate, settings.framesPerPeriod, settings.nReceiverPeriods, settings.audioMmap);
 }
 
 
 SpeakerThread::~SpeakerThread()
 {
-	// TODO Add code for releasing the sound card
+	delete device;
 }
 
 
@@ -113,16 +54,19 @@ void SpeakerThread::stoppableRun()
     // Start the playback loop
 	while(true)
 	{
-	    rc = snd_pcm_writei(sndHandle, buffer->getChunk(), settings.framesPerPeriod);
+		// The resampler writes straight into the device's buffer
+		buffer->getPeriod(device->beginWrite());
+	    rc = device->commitWrite();
 	    if (rc == -EPIPE)
 	    {
 	    	/* EPIPE means underrun */
 			cerr << "underrun occurred" << endl;
-	    	snd_pcm_prepare(sndHandle);
+	    	device->recover(rc);
 	    }
 	    else if (rc < 0)
 	    {
 	    	cerr << "error from writei: " << snd_strerror(rc) << endl;
+	    	device->recover(rc);
 	    }
 	    else if (rc != settings.framesPerPeriod)
 	    {
@@ -21,27 +21,23 @@
 #ifndef SPEAKERTHREAD_H_
 #define SPEAKERTHREAD_H_
 
-// Use the newer ALSA API
-#define ALSA_PCM_NEW_HW_PARAMS_API
-
-#include <alsa/asoundlib.h>
-
 #include "stoppablethread.h"
-#include "nonblockingbuffer.h"
+#include "alsadevice.h"
+#include "driftresampler.h"
 #include "settings.h"
 
 class SpeakerThread : public StoppableThread
 {
 public:
-	SpeakerThread(NonBlockingBuffer* _buffer);
+	SpeakerThread(DriftResampler* _buffer);
 	virtual ~SpeakerThread();
 
 protected:
 	virtual void stoppableRun();
 
 private:
-	snd_pcm_t*			sndHandle;
-	NonBlockingBuffer*	buffer;
+	AlsaDevice*			device;
+	DriftResampler*		buffer;
 	Settings			settings;
 };
 
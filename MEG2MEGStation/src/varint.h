@@ -0,0 +1,75 @@
+/*
+ * varint.h
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VARINT_H_
+#define VARINT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Variable-length integers as used in the block metadata of the files: seven
+// bits per byte, least significant group first, the highest bit set in all
+// but the last byte. Signed values are zigzag mapped first, so that small
+// negative values stay short.
+
+#define VARINT_MAX_LEN		10		// in bytes, for 64 bits
+
+//! Write _val to _dst and return the position right after it.
+inline unsigned char* putVarint(unsigned char* _dst, uint64_t _val)
+{
+	while (_val >= 0x80)
+	{
+		*_dst++ = (unsigned char)(_val | 0x80);
+		_val >>= 7;
+	}
+	*_dst++ = (unsigned char)_val;
+	return(_dst);
+}
+
+//! Read a value from _src to _val and return the position right after it, or NULL if it does not end before _end.
+inline const unsigned char* getVarint(const unsigned char* _src, const unsigned char* _end, uint64_t* _val)
+{
+	uint64_t	val = 0;
+	int			shift;
+
+	for (shift=0; shift<64 && _src<_end; shift+=7)
+	{
+		val |= uint64_t(*_src & 0x7F) << shift;
+		if (!(*_src++ & 0x80))
+		{
+			*_val = val;
+			return(_src);
+		}
+	}
+
+	return(NULL);
+}
+
+inline uint64_t zigzag(int64_t _val)
+{
+	return((uint64_t(_val) << 1) ^ uint64_t(_val >> 63));
+}
+
+inline int64_t unzigzag(uint64_t _val)
+{
+	return(int64_t(_val >> 1) ^ -int64_t(_val & 1));
+}
+
+#endif /* VARINT_H_ */
@@ -20,77 +20,200 @@
 
 #include <cstdlib>
 #include <stdio.h>
-#include <jpeglib.h>
+#include <string.h>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
 
 #include "config.h"
 #include "videocompressorthread.h"
+#include "settings.h"
 
-VideoCompressorThread::VideoCompressorThread(CycDataBuffer* _inpBuf, CycDataBuffer* _outBuf, bool _color, int _jpgQuality)
+using namespace std;
+
+#define WORKER_POLL_INTERVAL	100		// in milliseconds. How often idle helpers check for stop.
+
+CompressorWorker::CompressorWorker(PixelFormat _format, VideoFormat _videoFormat, int _jpgQuality, DemosaicMethod _demosaic, int _cpu)
+	: compressor(_format, _videoFormat.width, _videoFormat.height, _jpgQuality, _demosaic)
+{
+	cpu = _cpu;
+	raw = NULL;
+	jpgSize = 0;
+	jpgBuf = (unsigned char*)malloc(JPEG_BUF_SIZE(_videoFormat.width, _videoFormat.height));
+	if(!jpgBuf)
+	{
+		cerr << "Error allocating memory!" << endl;
+		abort();
+	}
+}
+
+
+CompressorWorker::~CompressorWorker()
+{
+	free(jpgBuf);
+}
+
+
+void CompressorWorker::compress(const unsigned char* _raw)
+{
+	raw = _raw;
+	startSem.release();
+}
+
+
+int CompressorWorker::waitDone()
+{
+	doneSem.acquire();
+	return(jpgSize);
+}
+
+
+void CompressorWorker::stoppableRun()
+{
+	VideoCompressorThread::pinToCpu(cpu);
+
+	while(!shouldStop)
+	{
+		if(!startSem.tryAcquire(1, WORKER_POLL_INTERVAL))
+		{
+			continue;
+		}
+
+		jpgSize = compressor.compress(raw, jpgBuf);
+		doneSem.release();
+	}
+}
+
+
+VideoCompressorThread::VideoCompressorThread(CycDataBuffer* _inpBuf, CycDataBuffer* _outBuf, PixelFormat _format, VideoFormat _videoFormat, int _jpgQuality, DemosaicMethod _demosaic)
+	: compressor(_format, _videoFormat.width, _videoFormat.height, _jpgQuality, _demosaic)
 {
+	Settings	settings;
+	int			cpus[VIDEO_MAX_COMPRESSORS];
+	int			nCpus;
+	const char*	cpuList;
+	char*		end;
+	int			i;
+
 	inpBuf = _inpBuf;
 	outBuf = _outBuf;
-	color = _color;
-	jpgQuality = _jpgQuality;
+	jpgBufSize = JPEG_BUF_SIZE(_videoFormat.width, _videoFormat.height);
+	jpgBuf = (unsigned char*)malloc(jpgBufSize);
+	if(!jpgBuf)
+	{
+		cerr << "Error allocating memory!" << endl;
+		abort();
+	}
+	consumerId = inpBuf->registerConsumer();
+
+	if(settings.compressorThreads < 1 || settings.compressorThreads > VIDEO_MAX_COMPRESSORS)
+	{
+		cerr << "Invalid number of compressor threads: " << settings.compressorThreads << ", should be between 1 and " << VIDEO_MAX_COMPRESSORS << endl;
+		abort();
+	}
+
+	cpuList = settings.compressorCpus;
+	for(nCpus=0; *cpuList && nCpus<VIDEO_MAX_COMPRESSORS; nCpus++)
+	{
+		cpus[nCpus] = strtol(cpuList, &end, 10);
+		if(end == cpuList || cpus[nCpus] < 0 || cpus[nCpus] >= CPU_SETSIZE)
+		{
+			cerr << "Invalid compressor CPU list: " << settings.compressorCpus << endl;
+			abort();
+		}
+
+		cpuList = end + strspn(end, ", ");
+	}
+
+	cpu = (nCpus ? cpus[0] : -1);
+
+	nWorkers = settings.compressorThreads - 1;
+	for(i=0; i<nWorkers; i++)
+	{
+		workers[i] = new CompressorWorker(_format, _videoFormat, _jpgQuality, _demosaic, (nCpus ? cpus[(i + 1) % nCpus] : -1));
+		workers[i]->start();
+	}
 }
 
 
 VideoCompressorThread::~VideoCompressorThread()
 {
+	int		i;
+
+	for(i=0; i<nWorkers; i++)
+	{
+		workers[i]->stop();
+		delete workers[i];
+	}
+
+	inpBuf->unregisterConsumer(consumerId);
+	free(jpgBuf);
+}
+
+
+void VideoCompressorThread::pinToCpu(int _cpu)
+{
+	cpu_set_t	cpuSet;
+	int			rc;
+
+	if(_cpu < 0)
+	{
+		return;
+	}
+
+	CPU_ZERO(&cpuSet);
+	CPU_SET(_cpu, &cpuSet);
+	rc = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+	if(rc)
+	{
+		cerr << "Cannot pin the compressor thread to CPU " << _cpu << ": " << strerror(rc) << endl;
+	}
 }
 
 
 void VideoCompressorThread::stoppableRun()
 {
+	int				nChunks;
+	int				i;
+	unsigned char*	dst;
+	ChunkAttrib		chunkAttrib;
+
+	pinToCpu(cpu);
+
 	while(!shouldStop)
 	{
-		// JPEG-related stuff
-		struct jpeg_compress_struct	cinfo;
-		struct jpeg_error_mgr		jerr;
-		JSAMPROW 					row_pointer;
-		unsigned char*				jpgBuf=NULL;
-		unsigned long				jpgBufLen=0;
-
-		unsigned char*				data;
-		ChunkAttrib					chunkAttrib;
-
-		// Get raw image from the input buffer
-		data = inpBuf->getChunk(&chunkAttrib);
-
-		// Initialize JPEG
-		cinfo.err = jpeg_std_error(&jerr);
-		jpeg_create_compress(&cinfo);
-		jpeg_mem_dest(&cinfo, &jpgBuf, &jpgBufLen);
-
-		// Set the parameters of the output file
-		cinfo.image_width = VIDEO_WIDTH;
-		cinfo.image_height = VIDEO_HEIGHT;
-		cinfo.input_components = (color ? 3 : 1);
-		cinfo.in_color_space = (color ? JCS_RGB : JCS_GRAYSCALE);
-
-		// Use default compression parameters
-		jpeg_set_defaults(&cinfo);
-		jpeg_set_quality(&cinfo, jpgQuality, TRUE);
-
-		// Do the compression
-		jpeg_start_compress(&cinfo, TRUE);
-
-		// write one row at a time
-		while(cinfo.next_scanline < cinfo.image_height)
+		// Get the raw images available in the input buffer, at most one per
+		// thread. They stay valid until the next call.
+		nChunks = inpBuf->getChunks(consumerId, chunks, nWorkers + 1);
+
+		for(i=1; i<nChunks; i++)
 		{
-			row_pointer = (data + (cinfo.next_scanline * cinfo.image_width * (color ? 3 : 1)));
-			jpeg_write_scanlines(&cinfo, &row_pointer, 1);
+			workers[i-1]->compress(chunks[i].data);
 		}
 
-		// clean up after we're done compressing
-		jpeg_finish_compress(&cinfo);
-
-
-		// Insert compressed image into the output buffer
-		chunkAttrib.chunkSize = jpgBufLen;
-		outBuf->insertChunk(jpgBuf, chunkAttrib);
+		// The first image goes directly to the output buffer if it has room
+		// for the worst case. The buffer is sized for realistic frames (see
+		// JPEG_PEAK_RATIO), so otherwise the image is compressed aside and
+		// insertChunk() drops it if it turns out too large.
+		chunkAttrib = chunks[0].attrib;
+		if(jpgBufSize <= outBuf->getReservableSize())
+		{
+			dst = outBuf->reserveChunk(jpgBufSize);
+			chunkAttrib.chunkSize = compressor.compress(chunks[0].data, dst);
+			outBuf->commitChunk(chunkAttrib);
+		}
+		else
+		{
+			chunkAttrib.chunkSize = compressor.compress(chunks[0].data, jpgBuf);
+			outBuf->insertChunk(jpgBuf, chunkAttrib);
+		}
 
-		// The output buffer needs to be explicitly freed by the libjpeg client
-		free(jpgBuf);
-		jpeg_destroy_compress(&cinfo);
+		// The rest follow in the same order
+		for(i=1; i<nChunks; i++)
+		{
+			chunkAttrib = chunks[i].attrib;
+			chunkAttrib.chunkSize = workers[i-1]->waitDone();
+			outBuf->insertChunk((unsigned char*)workers[i-1]->getData(), chunkAttrib);
+		}
 	}
 }
@@ -21,23 +21,81 @@
 #ifndef VIDEOCOMPRESSORTHREAD_H_
 #define VIDEOCOMPRESSORTHREAD_H_
 
+#include <QSemaphore>
+
+#include "config.h"
 #include "stoppablethread.h"
 #include "cycdatabuffer.h"
+#include "jpegcompressor.h"
+
+//! Helper thread of VideoCompressorThread compressing one frame at a time.
+class CompressorWorker : public StoppableThread
+{
+public:
+	CompressorWorker(PixelFormat _format, VideoFormat _videoFormat, int _jpgQuality, DemosaicMethod _demosaic, int _cpu);
+	virtual ~CompressorWorker();
+
+	//! Start compressing _raw. The frame should stay valid until waitDone() returns.
+	void compress(const unsigned char* _raw);
+
+	//! Wait for the frame to be compressed and return its size. The data is in getData().
+	int waitDone();
+
+	const unsigned char* getData() { return(jpgBuf); }
+
+protected:
+	virtual void stoppableRun();
+
+private:
+	JpegCompressor			compressor;
+	int						cpu;		// -1 for no pinning
+	unsigned char*			jpgBuf;
+	int						jpgSize;
+	const unsigned char*	raw;
+	QSemaphore				startSem;
+	QSemaphore				doneSem;
+};
+
 
+//! Compresses the raw frames to JPEG, using several threads if needed.
+/*!
+ * The thread takes the frames available in the input buffer in batches of
+ * at most one frame per thread. It compresses the first frame of a batch
+ * itself, directly into the output buffer when that has room for any
+ * frame, and hands the others to its CompressorWorker helpers. The
+ * compressed frames are inserted into the output buffer in the order of
+ * the batch, so the frame order and attributes are preserved. With a
+ * single thread there are no helpers.
+ * Bayer frames are demosaiced by the thread compressing them, so the
+ * demosaicing is spread over the threads as well.
+ *
+ * The threads can be pinned to CPUs; the first listed CPU goes to this
+ * thread, the next ones to the helpers in turn.
+ */
 class VideoCompressorThread : public StoppableThread
 {
 public:
-	VideoCompressorThread(CycDataBuffer* _inpBuf, CycDataBuffer* _outBuf, bool _color, int _jpgQuality);
+	VideoCompressorThread(CycDataBuffer* _inpBuf, CycDataBuffer* _outBuf, PixelFormat _format, VideoFormat _videoFormat, int _jpgQuality, DemosaicMethod _demosaic=DEMOSAIC_BILINEAR);
 	virtual ~VideoCompressorThread();
 
+	//! Pin the calling thread to _cpu. Does nothing if _cpu is negative.
+	static void pinToCpu(int _cpu);
+
 protected:
 	virtual void stoppableRun();
 
 private:
-	CycDataBuffer*	inpBuf;
-	CycDataBuffer*	outBuf;
-	bool			color;
-	int				jpgQuality;
+	CycDataBuffer*		inpBuf;
+	CycDataBuffer*		outBuf;
+	int					jpgBufSize;		// in bytes, largest compressed frame
+	unsigned char*		jpgBuf;			// for frames the output buffer might not take
+	int					consumerId;
+	JpegCompressor		compressor;
+	int					cpu;		// -1 for no pinning
+
+	int					nWorkers;
+	CompressorWorker*	workers[VIDEO_MAX_COMPRESSORS - 1];
+	ChunkRef			chunks[VIDEO_MAX_COMPRESSORS];
 };
 
 #endif /* VIDEOCOMPRESSORTHREAD_H_ */
@@ -0,0 +1,56 @@
+/*
+ * videofilereader.cpp
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "videofilereader.h"
+
+bool VideoFileReader::open(const char* _fileName)
+{
+	if(!openFile(_fileName, MAGIC_VIDEO_STR))
+	{
+		return(false);
+	}
+
+	if(getVersion() < 4 || getVersion() > VIDEO_FILE_VERSION)
+	{
+		snprintf(error, sizeof(error), "Unsupported video file version %u", getVersion());
+		close();
+		return(false);
+	}
+
+	if(getVersion() >= 6)
+	{
+		if(!readHeader(&videoFormat.width, sizeof(uint32_t)) || !readHeader(&videoFormat.height, sizeof(uint32_t))
+		   || !readHeader(&videoFormat.fps, sizeof(uint32_t)))
+		{
+			snprintf(error, sizeof(error), "Truncated header in %s", _fileName);
+			close();
+			return(false);
+		}
+	}
+	else
+	{
+		videoFormat.width = 640;
+		videoFormat.height = 480;
+		videoFormat.fps = 0;
+	}
+
+	setLayout(getVersion() >= 5, 0);
+	return(true);
+}
@@ -0,0 +1,47 @@
+/*
+ * videofilereader.h
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VIDEOFILEREADER_H_
+#define VIDEOFILEREADER_H_
+
+#include "config.h"
+#include "filereader.h"
+#include "pixelformat.h"
+
+//! Streaming reader of the video files written by VideoFileWriter.
+/*!
+ * Each chunk is one JPEG-compressed frame, returned as stored. Files of
+ * version 4, 5 (in blocks) and 6 (with the video format) are supported.
+ * Older files always hold 640x480 frames, at a rate not stored in the file.
+ */
+class VideoFileReader : public FileReader
+{
+public:
+	//! Open the file and read its header. Return false on error, see getError().
+	bool open(const char* _fileName);
+
+	//! Size and rate of the frames. All zeros if the recording station did not know them.
+	VideoFormat getVideoFormat() { return(videoFormat); }
+
+private:
+	VideoFormat		videoFormat;
+};
+
+#endif /* VIDEOFILEREADER_H_ */
@@ -28,12 +28,15 @@
 using namespace std;
 
 
-VideoFileWriter::VideoFileWriter(CycDataBuffer* _cycBuf, const char* _path, int _siteId, bool _isSender, QLineEdit* _suffix)
+VideoFileWriter::VideoFileWriter(CycDataBuffer* _cycBuf, const char* _path, int _siteId, bool _isSender, VideoFormat _videoFormat, QLineEdit* _suffix)
 	:	FileWriter(_cycBuf, _path, "vid", _siteId, _isSender, _suffix)
 {
 	uint32_t ver = VIDEO_FILE_VERSION;
 
-	bufLen = strlen(MAGIC_VIDEO_STR) + sizeof(uint32_t) + 2;
+	videoFormat = _videoFormat;
+
+	// The format is filled in by getHeader()
+	bufLen = strlen(MAGIC_VIDEO_STR) + 4 * sizeof(uint32_t) + 2;
 	buf = (unsigned char*)malloc(bufLen);
 
 	if(!buf)
@@ -55,8 +58,22 @@ VideoFileWriter::~VideoFileWriter()
 }
 
 
+void VideoFileWriter::setVideoFormat(VideoFormat _videoFormat)
+{
+	QMutexLocker	locker(&formatMutex);
+
+	videoFormat = _videoFormat;
+}
+
+
 unsigned char* VideoFileWriter::getHeader(int* _len)
 {
+	QMutexLocker	locker(&formatMutex);
+
+	memcpy(buf + strlen(MAGIC_VIDEO_STR) + sizeof(uint32_t) + 2, &videoFormat.width, sizeof(uint32_t));		// frame width
+	memcpy(buf + strlen(MAGIC_VIDEO_STR) + 2*sizeof(uint32_t) + 2, &videoFormat.height, sizeof(uint32_t));	// frame height
+	memcpy(buf + strlen(MAGIC_VIDEO_STR) + 3*sizeof(uint32_t) + 2, &videoFormat.fps, sizeof(uint32_t));		// nominal frame rate
+
 	*_len = bufLen;
 	return(buf);
 }
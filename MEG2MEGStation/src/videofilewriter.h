@@ -21,20 +21,34 @@
 #ifndef VIDEOFILEWRITER_H_
 #define VIDEOFILEWRITER_H_
 
+#include <QMutex>
+
 #include "filewriter.h"
+#include "pixelformat.h"
 
+//! Writes the compressed frames to .vid files.
+/*!
+ * The header holds the VideoFormat of the frames. On the receiving side it
+ * is not known until the remote station sends it; until then it is stored
+ * as zeros.
+ */
 class VideoFileWriter : public FileWriter
 {
 public:
-	VideoFileWriter(CycDataBuffer* _cycBuf, const char* _path, int _siteId, bool _isSender, QLineEdit* _suffix);
+	VideoFileWriter(CycDataBuffer* _cycBuf, const char* _path, int _siteId, bool _isSender, VideoFormat _videoFormat, QLineEdit* _suffix);
 	virtual ~VideoFileWriter();
 
+	//! Change the format stored in the header of the files started from now on.
+	void setVideoFormat(VideoFormat _videoFormat);
+
 protected:
 	virtual unsigned char* getHeader(int* _len);
 
 private:
 	int				bufLen;
 	unsigned char*	buf;
+	VideoFormat		videoFormat;
+	QMutex			formatMutex;	// protects videoFormat
 };
 
 #endif /* VIDEOFILEWRITER_H_ */
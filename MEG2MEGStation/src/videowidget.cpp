@@ -20,6 +20,9 @@
 
 #include <iostream>
 #include <math.h>
+#include <QPixmap>
+#include <QTransform>
+#include <QResizeEvent>
 
 #include "config.h"
 #include "videowidget.h"
@@ -32,21 +35,77 @@ VideoWidget::VideoWidget(QWidget* parent)
     : QLabel(parent)
 {
 	rotate = false;
+	cycBuf = NULL;
+	dispatcher = NULL;
+	targetWidth.store(width());
+	targetHeight.store(height());
+	framePending.store(0);
 }
 
 
-void VideoWidget::onDrawFrame(unsigned char* _jpegBuf)
+VideoWidget::~VideoWidget()
 {
-	ChunkAttrib chunkAttrib;
-    QPixmap     pixMap;
-    QTransform  transform;
-    QTransform  trans = transform.rotate(rotate ? 180 : 0);
+	if(dispatcher)
+	{
+		dispatcher->stop();
+		delete dispatcher;
+	}
+}
 
-	chunkAttrib = *((ChunkAttrib*)(_jpegBuf-sizeof(ChunkAttrib)));
 
-    pixMap.loadFromData(_jpegBuf, chunkAttrib.chunkSize);
+void VideoWidget::setSource(CycDataBuffer* _cycBuf)
+{
+	cycBuf = _cycBuf;
+	dispatcher = new ConsumerDispatcher(cycBuf, this, LATENCY_INTERACTIVE, DISPATCH_LATEST);
+	dispatcher->start();
+}
 
-    // before displaying, scale the pixmap to preserve the aspect ratio
-    this->setPixmap(pixMap.scaled(this->width(), this->height(), Qt::KeepAspectRatio).transformed(trans));
+
+void VideoWidget::resizeEvent(QResizeEvent* _event)
+{
+	targetWidth.store(_event->size().width());
+	targetHeight.store(_event->size().height());
+	QLabel::resizeEvent(_event);
 }
 
+
+void VideoWidget::consumeChunks(CycDataBuffer* _cycBuf, ChunkRef* _chunks, int _nChunks)
+{
+	QImage		image;
+	QTransform  transform;
+	QTransform  trans = transform.rotate(rotate ? 180 : 0);
+
+	// The dispatcher only passes the latest frame
+	if(!image.loadFromData(_chunks[_nChunks-1].data, _chunks[_nChunks-1].attrib.chunkSize, "JPG"))
+	{
+		return;
+	}
+
+	// Before displaying, scale the image to preserve the aspect ratio
+	image = image.scaled(targetWidth.load(), targetHeight.load(), Qt::KeepAspectRatio).transformed(trans);
+
+	frameMutex.lock();
+	frame = image;
+	frameMutex.unlock();
+
+	// Ask the GUI thread to show the frame, unless it has not yet shown the
+	// previous one - then it will pick up this frame instead
+	if(framePending.testAndSetOrdered(0, 1))
+	{
+		QMetaObject::invokeMethod(this, "onDrawFrame", Qt::QueuedConnection);
+	}
+}
+
+
+void VideoWidget::onDrawFrame()
+{
+	QImage	image;
+
+	framePending.store(0);
+
+	frameMutex.lock();
+	image = frame;
+	frameMutex.unlock();
+
+	this->setPixmap(QPixmap::fromImage(image));
+}
@@ -22,21 +22,52 @@
 #define VIDEOWIDGET_H_
 
 #include <QLabel>
+#include <QImage>
+#include <QMutex>
+#include <QAtomicInteger>
 
-class VideoWidget : public QLabel
+#include "cycdatabuffer.h"
+#include "consumerdispatcher.h"
+
+//! Displays the latest JPEG frame from a CycDataBuffer.
+/*!
+ * The frames are decoded, scaled and rotated by a ConsumerDispatcher that
+ * only sees the newest frame. The GUI thread just puts the ready image on
+ * the screen.
+ */
+class VideoWidget : public QLabel, public ChunkConsumer
 {
     Q_OBJECT
 
 public:
     VideoWidget(QWidget* parent=0);
+    virtual ~VideoWidget();
     //int heightForWidth(int _w);
 	volatile bool rotate;
 
+	//! Start displaying JPEG frames inserted into _cycBuf.
+	void setSource(CycDataBuffer* _cycBuf);
+
+	virtual void consumeChunks(CycDataBuffer* _cycBuf, ChunkRef* _chunks, int _nChunks);
+
 public slots:
-    void onDrawFrame(unsigned char* _jpegBuf);
+    void onDrawFrame();
+
+protected:
+	virtual void resizeEvent(QResizeEvent* _event);
 
 private:
-	char*		imBuf;
+	CycDataBuffer*		cycBuf;
+	ConsumerDispatcher*	dispatcher;
+
+	// Widget size for the dispatcher's thread
+	QAtomicInt			targetWidth;
+	QAtomicInt			targetHeight;
+
+	// Latest decoded frame, waiting to be shown by onDrawFrame()
+	QMutex				frameMutex;
+	QImage				frame;
+	QAtomicInt			framePending;
 };
 
 #endif /* VIDEOWIDGET_H_ */
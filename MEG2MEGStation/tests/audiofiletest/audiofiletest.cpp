@@ -0,0 +1,360 @@
+/*
+ * audiofiletest.cpp
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Round trip of the audio files: the periods go through a CycDataBuffer to
+// an AudioFileWriter, raw or losslessly compressed, and are read back with
+// AudioFileReader. Covers S16 and S24, one and two channels, periods of a
+// few frames and gaps left by dropped periods. Exits with 0 on success.
+
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <QApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QLineEdit>
+#include <QSettings>
+#include <QTemporaryDir>
+#include <QThread>
+
+#include "config.h"
+#include "cycdatabuffer.h"
+#include "audioformat.h"
+#include "audiofilewriter.h"
+#include "audiofilereader.h"
+
+using namespace std;
+
+#define N_PERIODS		600
+#define GAP_INTERVAL	50		// one period out of GAP_INTERVAL is dropped
+#define BUF_SIZE		100000000
+
+// Lengths of the periods in frames, repeated over the file
+static const int periodLens[] = {96, 1, 2, 3, 96, 5, 17, 96, 250, 4};
+
+
+//! Stops a FileWriter, which only checks for stop between its batches.
+class WriterStopper : public QThread
+{
+public:
+	WriterStopper(StoppableThread* _writer) { writer = _writer; }
+
+protected:
+	virtual void run() { writer->stop(); }
+
+private:
+	StoppableThread*	writer;
+};
+
+
+static int periodLen(uint64_t _id)
+{
+	return(periodLens[_id % (sizeof(periodLens) / sizeof(periodLens[0]))]);
+}
+
+
+static bool isDropped(uint64_t _id)
+{
+	return(_id % GAP_INTERVAL == GAP_INTERVAL / 2);
+}
+
+
+// Test signal: a sine with noise, some silent periods and some periods at
+// full scale, so that the coder uses all its predictors and stores some
+// channels verbatim
+static int32_t sample(SampleFormat _format, uint64_t _id, int _frame, int _chan)
+{
+	int32_t		maxVal = (_format == SAMPLE_S16) ? 32767 : 8388607;
+	uint64_t	t = _id * 96 + _frame;
+	double		val;
+
+	switch(_id % 13)
+	{
+	case 3:
+		return(0);
+
+	case 7:
+		return(((t * 2654435761u + _chan) & 1) ? maxVal : -maxVal - 1);
+
+	default:
+		val = 0.6 * maxVal * sin(t * 0.01 * (_chan + 1)) + int((t * 7919 + _chan * 31) % 513) - 256;
+		return(int32_t(val));
+	}
+}
+
+
+static void putSample(SampleFormat _format, unsigned char* _dst, int _idx, int32_t _val)
+{
+	if(_format == SAMPLE_S16)
+	{
+		((int16_t*)_dst)[_idx] = int16_t(_val);
+	}
+	else
+	{
+		((int32_t*)_dst)[_idx] = _val;
+	}
+}
+
+
+static int32_t getSample(SampleFormat _format, const void* _src, int _idx)
+{
+	if(_format == SAMPLE_S16)
+	{
+		return(((const int16_t*)_src)[_idx]);
+	}
+	else
+	{
+		return(((const int32_t*)_src)[_idx]);
+	}
+}
+
+
+static ChunkAttrib periodAttrib(uint64_t _id, int _frameSize, bool _isRec)
+{
+	ChunkAttrib	attrib;
+
+	memset(&attrib, 0, sizeof(attrib));
+	attrib.chunkSize = periodLen(_id) * _frameSize;
+	attrib.timestamp = 1000 + _id * 2;
+	attrib.rawTstamp = attrib.timestamp * 1000 + _id % 17;
+	attrib.fitTstamp = attrib.timestamp * 1000 + 3;
+	attrib.id = _id;
+	attrib.isRec = _isRec;
+
+	return(attrib);
+}
+
+
+// Write a file of N_PERIODS periods to _dir and return the number of errors
+// found when reading it back
+static int roundTrip(SampleFormat _format, int _nChans, bool _compress, const QString& _dir)
+{
+	AudioFormat			format(_format, _nChans);
+	int					frameSize = format.getFrameSize();
+	CycDataBuffer		cycBuf(BUF_SIZE, true);
+	QLineEdit			suffix("test");
+	AudioFileWriter*	writer;
+	WriterStopper*		stopper;
+	ChunkAttrib			attrib;
+	unsigned char*		data;
+	QStringList			files;
+	AudioFileReader		reader;
+	AudioRecord			rec;
+	FileRecordType		type;
+	uint64_t			id;
+	uint64_t			nextId;
+	int					maxChunkSize;
+	int					errors = 0;
+	int					i;
+	int					j;
+
+	QSettings(ORG_NAME, APP_NAME).setValue("audio/compress_files", _compress);
+
+	writer = new AudioFileWriter(&cycBuf, _dir.toLocal8Bit().data(), 1, true, format, &suffix);
+	writer->start();
+
+	for(id=0; id<N_PERIODS; id++)
+	{
+		attrib = periodAttrib(id, frameSize, true);
+
+		// A period larger than the buffer takes is dropped, the next one
+		// carries the gap
+		if(isDropped(id))
+		{
+			attrib.chunkSize = cycBuf.getMaxChunkSize() + 1;
+			cycBuf.insertChunk(NULL, attrib);
+			continue;
+		}
+
+		data = cycBuf.reserveChunk(attrib.chunkSize);
+		for(i=0; i<periodLen(id); i++)
+		{
+			for(j=0; j<_nChans; j++)
+			{
+				putSample(_format, data, i*_nChans + j, sample(_format, id, i, j));
+			}
+		}
+		cycBuf.commitChunk(attrib);
+	}
+
+	// The first period not recorded closes the file. The writer stops
+	// without draining the buffer, so wait until it has taken all the
+	// periods: the resized memory is only used once every consumer has
+	// caught up.
+	attrib = periodAttrib(id++, frameSize, false);
+	cycBuf.reserveChunk(attrib.chunkSize);
+	cycBuf.commitChunk(attrib);
+	maxChunkSize = cycBuf.getMaxChunkSize();
+	cycBuf.resize(BUF_SIZE / 2);
+	while(cycBuf.getReservableSize() == maxChunkSize)
+	{
+		QThread::msleep(1);
+	}
+
+	// Keep the writer busy until it notices that it should stop
+	stopper = new WriterStopper(writer);
+	stopper->start();
+	for(; !stopper->isFinished(); id++)
+	{
+		attrib = periodAttrib(id, frameSize, false);
+		cycBuf.reserveChunk(attrib.chunkSize);
+		cycBuf.commitChunk(attrib);
+		QThread::msleep(1);
+	}
+	stopper->wait();
+	delete stopper;
+	delete writer;
+
+	files = QDir(_dir).entryList(QStringList("*.aud"), QDir::Files);
+	if(files.size() != 1)
+	{
+		cerr << "Expected one file, got " << files.size() << endl;
+		return(1);
+	}
+
+	if(!reader.open((_dir + "/" + files[0]).toLocal8Bit().data()))
+	{
+		cerr << reader.getError() << endl;
+		return(1);
+	}
+
+	if(reader.getFormat() != _format || reader.getChans() != _nChans || reader.isCompressed() != _compress)
+	{
+		cerr << "Wrong header" << endl;
+		return(1);
+	}
+
+	nextId = 0;
+	while((type = reader.readRecord(&rec)) == FILE_RECORD_CHUNK || type == FILE_RECORD_GAP)
+	{
+		if(type == FILE_RECORD_GAP)
+		{
+			if(!isDropped(rec.id - 1) || rec.droppedChunks != 1 || rec.id != nextId + 1)
+			{
+				cerr << "Unexpected gap before period " << rec.id << endl;
+				errors++;
+			}
+			nextId = rec.id;
+			continue;
+		}
+
+		if(rec.id != nextId || isDropped(rec.id))
+		{
+			cerr << "Expected period " << nextId << ", got " << rec.id << endl;
+			errors++;
+		}
+		nextId = rec.id + 1;
+
+		attrib = periodAttrib(rec.id, frameSize, true);
+		if(rec.timestamp != attrib.timestamp || rec.rawTstamp != attrib.rawTstamp || rec.fitTstamp != attrib.fitTstamp
+		   || int(rec.nFrames) != periodLen(rec.id))
+		{
+			cerr << "Wrong attributes of period " << rec.id << endl;
+			errors++;
+			continue;
+		}
+
+		for(i=0; i<periodLen(rec.id); i++)
+		{
+			for(j=0; j<_nChans; j++)
+			{
+				if(getSample(_format, rec.data, i*_nChans + j) != sample(_format, rec.id, i, j))
+				{
+					cerr << "Wrong sample " << i << " of channel " << j << " in period " << rec.id << endl;
+					errors++;
+					i = periodLen(rec.id);
+					break;
+				}
+			}
+		}
+	}
+
+	if(type != FILE_RECORD_END)
+	{
+		cerr << reader.getError() << endl;
+		errors++;
+	}
+
+	if(nextId != N_PERIODS)
+	{
+		cerr << "The file ends at period " << nextId << endl;
+		errors++;
+	}
+
+	return(errors);
+}
+
+
+int main(int argc, char** argv)
+{
+	QTemporaryDir	home;
+	QFile			siteIdFile;
+	SampleFormat	formats[] = {SAMPLE_S16, SAMPLE_S24};
+	QString			dir;
+	int				errors = 0;
+	int				caseErrors;
+	int				compress;
+	int				f;
+	int				nChans;
+
+	// Keep the settings and the site ID of the user intact
+	if(!home.isValid())
+	{
+		cerr << "Cannot create a temporary directory" << endl;
+		return(1);
+	}
+	qputenv("HOME", home.path().toLocal8Bit());
+	qputenv("XDG_CONFIG_HOME", (home.path() + "/.config").toLocal8Bit());
+	qputenv("QT_QPA_PLATFORM", "offscreen");
+
+	QDir(home.path()).mkpath(QFileInfo(home.path() + SITE_ID_PATH).path());
+	siteIdFile.setFileName(home.path() + SITE_ID_PATH);
+	if(!siteIdFile.open(QIODevice::WriteOnly) || siteIdFile.write("1") != 1)
+	{
+		cerr << "Cannot write the site ID" << endl;
+		return(1);
+	}
+	siteIdFile.close();
+
+	QApplication	app(argc, argv);
+
+	QSettings(ORG_NAME, APP_NAME).setValue("buffers/pre_roll", 0.0);
+
+	for(compress=0; compress<2; compress++)
+	{
+		for(f=0; f<2; f++)
+		{
+			for(nChans=1; nChans<=2; nChans++)
+			{
+				dir = QString("%1/%2-%3-%4").arg(home.path()).arg(compress).arg(f).arg(nChans);
+				QDir().mkpath(dir);
+
+				caseErrors = roundTrip(formats[f], nChans, compress, dir);
+				cout << (formats[f] == SAMPLE_S16 ? "S16" : "S24") << ", " << nChans << " channel(s), "
+				     << (compress ? "compressed" : "raw") << ": " << (caseErrors ? "FAILED" : "OK") << endl;
+				errors += caseErrors;
+			}
+		}
+	}
+
+	return(errors ? 1 : 0);
+}
@@ -0,0 +1,52 @@
+# Author: Andrey Zhdanov
+# Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+# Aalto University School of Science
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, version 3.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Round trip of the audio files through AudioFileWriter and AudioFileReader.
+# Build with qmake && make, run ./audiofiletest; it exits with 0 on success.
+
+TEMPLATE = app
+TARGET = audiofiletest
+CONFIG += console
+QT += core \
+    gui \
+    widgets
+SRC = ../../src
+INCLUDEPATH += $$SRC
+HEADERS += $$SRC/settings.h \
+    $$SRC/filewriter.h \
+    $$SRC/filereader.h \
+    $$SRC/varint.h \
+    $$SRC/stoppablethread.h \
+    $$SRC/sampleformat.h \
+    $$SRC/audioformat.h \
+    $$SRC/audiocodec.h \
+    $$SRC/audiofilewriter.h \
+    $$SRC/audiofilereader.h \
+    $$SRC/cycdatabuffer.h \
+    $$SRC/fixedstimuli.h \
+    $$SRC/config.h
+SOURCES += audiofiletest.cpp \
+    $$SRC/settings.cpp \
+    $$SRC/filewriter.cpp \
+    $$SRC/filereader.cpp \
+    $$SRC/stoppablethread.cpp \
+    $$SRC/audioformat.cpp \
+    $$SRC/audiocodec.cpp \
+    $$SRC/audiofilewriter.cpp \
+    $$SRC/audiofilereader.cpp \
+    $$SRC/cycdatabuffer.cpp \
+    $$SRC/fixedstimuli.cpp
+DEFINES += __STDC_LIMIT_MACROS
@@ -0,0 +1,283 @@
+/*
+ * cycbuftest.cpp
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Overflow handling of CycDataBuffer. Under OVERFLOW_DROP_OLDEST a consumer
+// that stops fetching (holding some chunks or none at all) should lose its
+// oldest chunks, not the newest ones, while the chunks it holds stay intact
+// and a consumer that keeps up loses nothing. Chunks that do not fit the
+// buffer at all are dropped and reported as gaps. Exits with 0 on success.
+
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "cycdatabuffer.h"
+
+using namespace std;
+
+#define BUF_SIZE		1000000
+#define N_CHUNKS		20000
+#define MAX_BATCH		100
+
+
+static int chunkSize(uint64_t _id)
+{
+	return(1 + (_id * 7919) % 3000);
+}
+
+
+static unsigned char chunkByte(uint64_t _id, int _idx)
+{
+	return((unsigned char)(_id * 31 + _idx));
+}
+
+
+static bool checkData(const unsigned char* _data, const ChunkAttrib& _attrib)
+{
+	int		i;
+
+	if (_attrib.chunkSize != chunkSize(_attrib.id))
+	{
+		return(false);
+	}
+
+	for (i=0; i<_attrib.chunkSize; i++)
+	{
+		if (_data[i] != chunkByte(_attrib.id, i))
+		{
+			return(false);
+		}
+	}
+
+	return(true);
+}
+
+
+static void insert(CycDataBuffer* _buf, uint64_t _id)
+{
+	ChunkAttrib		attrib;
+	unsigned char*	data;
+	int				i;
+
+	memset(&attrib, 0, sizeof(attrib));
+	attrib.chunkSize = chunkSize(_id);
+	attrib.timestamp = _id;
+	attrib.id = _id;
+
+	data = _buf->reserveChunk(attrib.chunkSize);
+	for (i=0; i<attrib.chunkSize; i++)
+	{
+		data[i] = chunkByte(_id, i);
+	}
+	_buf->commitChunk(attrib);
+}
+
+
+// Fetch everything available to the consumer. _prevId is the last chunk the
+// consumer has seen, or -1. Return the number of errors.
+static int drain(CycDataBuffer* _buf, int _consumerId, int64_t* _prevId, uint64_t* _nChunks, uint64_t* _nBytes)
+{
+	ChunkRef	chunks[MAX_BATCH];
+	int			errors = 0;
+	int			n;
+	int			i;
+
+	while ((n = _buf->tryGetChunks(_consumerId, chunks, MAX_BATCH)))
+	{
+		for (i=0; i<n; i++)
+		{
+			if (!checkData(chunks[i].data, chunks[i].attrib))
+			{
+				cerr << "Chunk " << chunks[i].attrib.id << " is corrupt" << endl;
+				errors++;
+			}
+
+			if (*_prevId >= 0 && int64_t(chunks[i].attrib.id) != *_prevId + 1 + int64_t(chunks[i].gap.droppedChunks))
+			{
+				cerr << "Chunk " << chunks[i].attrib.id << " follows " << *_prevId << " with a gap of "
+				     << chunks[i].gap.droppedChunks << " chunks" << endl;
+				errors++;
+			}
+
+			*_prevId = chunks[i].attrib.id;
+			(*_nChunks)++;
+			*_nBytes += chunks[i].attrib.chunkSize;
+		}
+	}
+
+	return(errors);
+}
+
+
+// One consumer takes _nHeld chunks and stalls, another one never fetches
+// anything and the third one keeps up with the producer
+static int stalledConsumers(int _nHeld)
+{
+	CycDataBuffer	buf(BUF_SIZE, true);
+	ChunkRef		held[MAX_BATCH];
+	int				stalled;
+	int				idle;
+	int				live;
+	int64_t			prevId;
+	uint64_t		nChunks;
+	uint64_t		nBytes;
+	uint64_t		id;
+	int				errors = 0;
+	int				i;
+
+	buf.setOverflowPolicy(OVERFLOW_DROP_OLDEST);
+	stalled = buf.registerConsumer();
+	idle = buf.registerConsumer();
+	live = buf.registerConsumer();
+
+	for (id=0; id<uint64_t(_nHeld); id++)
+	{
+		insert(&buf, id);
+	}
+	if (buf.tryGetChunks(stalled, held, MAX_BATCH) != _nHeld)
+	{
+		cerr << "Cannot take the held chunks" << endl;
+		return(1);
+	}
+
+	prevId = -1;
+	nChunks = 0;
+	nBytes = 0;
+	for (; id<N_CHUNKS; id++)
+	{
+		insert(&buf, id);
+		errors += drain(&buf, live, &prevId, &nChunks, &nBytes);
+	}
+
+	if (nChunks != N_CHUNKS || buf.getDroppedChunks())
+	{
+		cerr << "The live consumer got " << nChunks << " chunks, " << buf.getDroppedChunks() << " dropped" << endl;
+		errors++;
+	}
+
+	for (i=0; i<_nHeld; i++)
+	{
+		if (!checkData(held[i].data, held[i].attrib))
+		{
+			cerr << "Held chunk " << held[i].attrib.id << " was overwritten" << endl;
+			errors++;
+		}
+	}
+
+	// The stalled consumers get the newest chunks, about a buffer worth
+	// of them
+	prevId = _nHeld - 1;
+	nChunks = 0;
+	nBytes = 0;
+	errors += drain(&buf, stalled, &prevId, &nChunks, &nBytes);
+	if (prevId != N_CHUNKS - 1 || nBytes < BUF_SIZE / 2)
+	{
+		cerr << "The stalled consumer ends at chunk " << prevId << " after " << nBytes << " bytes" << endl;
+		errors++;
+	}
+
+	prevId = -1;
+	nChunks = 0;
+	nBytes = 0;
+	errors += drain(&buf, idle, &prevId, &nChunks, &nBytes);
+	if (prevId != N_CHUNKS - 1 || nBytes < BUF_SIZE / 2)
+	{
+		cerr << "The idle consumer ends at chunk " << prevId << " after " << nBytes << " bytes" << endl;
+		errors++;
+	}
+
+	return(errors);
+}
+
+
+// Reserve or commit more than the buffer takes, between normal chunks
+static int oversizedChunks()
+{
+	CycDataBuffer	buf(BUF_SIZE, true);
+	ChunkAttrib		attrib;
+	ChunkGap		gap;
+	unsigned char*	data;
+	int				consumer;
+	int				errors = 0;
+
+	consumer = buf.registerConsumer();
+	insert(&buf, 0);
+
+	// Too large to reserve; the whole reserved space should be writable
+	memset(&attrib, 0, sizeof(attrib));
+	attrib.chunkSize = buf.getMaxChunkSize() + 1;
+	attrib.id = 1;
+	data = buf.reserveChunk(attrib.chunkSize);
+	memset(data, 0, attrib.chunkSize);
+	buf.commitChunk(attrib);
+
+	// Larger than reserved
+	attrib.chunkSize = chunkSize(2);
+	attrib.id = 2;
+	buf.reserveChunk(attrib.chunkSize - 1);
+	buf.commitChunk(attrib);
+
+	insert(&buf, 3);
+
+	if (buf.getDroppedChunks() != 2)
+	{
+		cerr << buf.getDroppedChunks() << " chunks dropped instead of 2" << endl;
+		errors++;
+	}
+
+	data = buf.getChunk(consumer, &attrib, &gap);
+	if (attrib.id != 0 || !checkData(data, attrib))
+	{
+		cerr << "Chunk 0 is lost" << endl;
+		errors++;
+	}
+
+	data = buf.getChunk(consumer, &attrib, &gap);
+	if (attrib.id != 3 || !checkData(data, attrib) || gap.droppedChunks != 2)
+	{
+		cerr << "Chunk " << attrib.id << " follows a gap of " << gap.droppedChunks << " chunks" << endl;
+		errors++;
+	}
+
+	return(errors);
+}
+
+
+int main()
+{
+	int		heldCounts[] = {1, 7};
+	int		errors = 0;
+	int		caseErrors;
+	int		i;
+
+	for (i=0; i<2; i++)
+	{
+		caseErrors = stalledConsumers(heldCounts[i]);
+		cout << "Drop oldest, " << heldCounts[i] << " chunk(s) held: " << (caseErrors ? "FAILED" : "OK") << endl;
+		errors += caseErrors;
+	}
+
+	caseErrors = oversizedChunks();
+	cout << "Oversized chunks: " << (caseErrors ? "FAILED" : "OK") << endl;
+	errors += caseErrors;
+
+	return(errors ? 1 : 0);
+}
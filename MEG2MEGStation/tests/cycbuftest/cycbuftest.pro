@@ -0,0 +1,33 @@
+# Author: Andrey Zhdanov
+# Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+# Aalto University School of Science
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, version 3.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Overflow handling of CycDataBuffer with stalled consumers. Build with
+# qmake && make, run ./cycbuftest; it exits with 0 on success.
+
+TEMPLATE = app
+TARGET = cycbuftest
+CONFIG += console
+QT += core
+QT -= gui
+SRC = ../../src
+INCLUDEPATH += $$SRC
+HEADERS += $$SRC/cycdatabuffer.h \
+    $$SRC/fixedstimuli.h \
+    $$SRC/config.h
+SOURCES += cycbuftest.cpp \
+    $$SRC/cycdatabuffer.cpp \
+    $$SRC/fixedstimuli.cpp
+DEFINES += __STDC_LIMIT_MACROS
@@ -0,0 +1,149 @@
+/*
+ * jitterbuffertest.cpp
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Playback of JitterBuffer: the received periods arrive reordered, late,
+// lost and in a burst, one playback period after another. Checks which
+// period is played each time and the counters of the statistics. Exits with
+// 0 on success.
+
+#include <iostream>
+#include <string.h>
+
+#include "config.h"
+#include "nonblockingbuffer.h"
+#include "jitterbuffer.h"
+
+using namespace std;
+
+#define FRAMES_PER_PERIOD	96
+#define SAMP_RATE			48000
+#define MIN_DEPTH			2
+#define NONE				-1			// no arrivals / no clean period played
+
+// Periods arriving before each playback period, ended by NONE
+static const int arrivals[][8] = {
+	{0, NONE},
+	{1, NONE},
+	{2, NONE},
+	{4, 3, NONE},						// 3 is reordered
+	{NONE},
+	{6, NONE},							// 5 is delayed...
+	{7, NONE},							// ...concealed once 7 is here
+	{5, 8, NONE},						// ...and late
+	{9, NONE},
+	{10, NONE},
+	{11, NONE},
+	{12, 13, 14, 15, 16, 17, NONE},		// too deep, played faster
+	{NONE},
+	{NONE},
+	{NONE},
+	{NONE},
+	{NONE}								// nothing left, concealed
+};
+
+// Period expected to be played after each of the arrivals above. The
+// periods faded in from silence or concealment and the ones played two at a
+// time are not clean copies of any period.
+static const int played[] = {NONE, NONE, 1, 2, 3, 4, NONE, NONE, 7, 8, 9, NONE, NONE, NONE, 16, 17, NONE};
+
+
+// Every sample of a period holds the same value, derived from the id
+static NET_AUDIO_TYPE periodValue(int _id)
+{
+	return(NET_AUDIO_TYPE(1000 + 10 * _id));
+}
+
+
+// Return the id of the period _data is a copy of, or NONE
+static int playedId(const NET_AUDIO_TYPE* _data)
+{
+	int		i;
+
+	for (i=1; i<FRAMES_PER_PERIOD * N_CHANS_NET; i++)
+	{
+		if (_data[i] != _data[0])
+		{
+			return(NONE);
+		}
+	}
+
+	if (_data[0] < 1000 || (_data[0] - 1000) % 10)
+	{
+		return(NONE);
+	}
+
+	return((_data[0] - 1000) / 10);
+}
+
+
+int main()
+{
+	NonBlockingBuffer	input(JITTER_BUF_SLOTS, FRAMES_PER_PERIOD);
+	JitterBuffer		jitterBuffer(&input, FRAMES_PER_PERIOD, SAMP_RATE, MIN_DEPTH);
+	NET_AUDIO_TYPE		period[FRAMES_PER_PERIOD * N_CHANS_NET];
+	ChunkAttrib			attrib;
+	PlaybackStats		stats;
+	int					nTicks = sizeof(played) / sizeof(played[0]);
+	int					errors = 0;
+	int					id;
+	int					t;
+	int					i;
+	int					j;
+
+	memset(&attrib, 0, sizeof(attrib));
+	attrib.chunkSize = sizeof(period);
+
+	for (t=0; t<nTicks; t++)
+	{
+		for (i=0; (id = arrivals[t][i]) != NONE; i++)
+		{
+			// Sent exactly one period apart, so that the jitter estimate
+			// stays at zero and the target depth at MIN_DEPTH
+			for (j=0; j<FRAMES_PER_PERIOD * N_CHANS_NET; j++)
+			{
+				period[j] = periodValue(id);
+			}
+			attrib.id = id;
+			attrib.timestamp = uint64_t(id) * FRAMES_PER_PERIOD * 1000 / SAMP_RATE;
+			input.insertChunk(period, attrib);
+		}
+
+		id = playedId(jitterBuffer.getPeriod());
+		if (id != played[t])
+		{
+			cerr << "Period " << t << ": played " << id << " instead of " << played[t] << endl;
+			errors++;
+		}
+	}
+
+	jitterBuffer.getStats(&stats);
+	if (stats.nPeriods != uint64_t(nTicks) || stats.reordered != 1 || stats.late != 1 || stats.concealed != 2
+		|| stats.compressed != 3 || stats.overflows != 0 || stats.targetDepth != MIN_DEPTH)
+	{
+		cerr << "Wrong statistics: " << stats.nPeriods << " played, " << stats.reordered << " reordered, " << stats.late << " late, "
+		     << stats.concealed << " concealed, " << stats.compressed << " compressed, " << stats.overflows << " overflows, target depth "
+		     << stats.targetDepth << endl;
+		errors++;
+	}
+
+	cout << "Jitter buffer: " << (errors ? "FAILED" : "OK") << endl;
+
+	return(errors ? 1 : 0);
+}
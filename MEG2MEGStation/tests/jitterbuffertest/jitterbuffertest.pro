@@ -0,0 +1,37 @@
+# Author: Andrey Zhdanov
+# Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+# Aalto University School of Science
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, version 3.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Playback order and statistics of JitterBuffer. Build with qmake && make,
+# run ./jitterbuffertest; it exits with 0 on success.
+
+TEMPLATE = app
+TARGET = jitterbuffertest
+CONFIG += console
+QT += core
+QT -= gui
+SRC = ../../src
+INCLUDEPATH += $$SRC
+HEADERS += $$SRC/jitterbuffer.h \
+    $$SRC/nonblockingbuffer.h \
+    $$SRC/audioring.h \
+    $$SRC/rateestimator.h \
+    $$SRC/cycdatabuffer.h \
+    $$SRC/config.h
+SOURCES += jitterbuffertest.cpp \
+    $$SRC/jitterbuffer.cpp \
+    $$SRC/nonblockingbuffer.cpp \
+    $$SRC/rateestimator.cpp
+DEFINES += __STDC_LIMIT_MACROS
@@ -0,0 +1,172 @@
+/*
+ * jpegbench.cpp
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Per-frame JPEG encoding time of JpegCompressor, which sets its encoder up
+// once, compared with setting up libjpeg for every frame as the compressor
+// thread originally did (create, jpeg_mem_dest(), set_defaults, one
+// jpeg_write_scanlines() call per row, destroy and free).
+//
+// Usage: jpegbench [width height quality frames]
+// Defaults to 640x480 frames at quality 80, 200 frames per run.
+
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include <algorithm>
+#include <jpeglib.h>
+
+#include "config.h"
+#include "pixelformat.h"
+#include "jpegcompressor.h"
+
+using namespace std;
+
+
+// The encoder set up for every frame, as before JpegCompressor
+static unsigned long compressPerFrame(const unsigned char* _raw, bool _color, int _width, int _height, int _quality)
+{
+	struct jpeg_compress_struct	cinfo;
+	struct jpeg_error_mgr		jerr;
+	JSAMPROW					rowPointer;
+	unsigned char*				jpgBuf = NULL;
+	unsigned long				jpgBufLen = 0;
+
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_compress(&cinfo);
+	jpeg_mem_dest(&cinfo, &jpgBuf, &jpgBufLen);
+
+	cinfo.image_width = _width;
+	cinfo.image_height = _height;
+	cinfo.input_components = (_color ? 3 : 1);
+	cinfo.in_color_space = (_color ? JCS_RGB : JCS_GRAYSCALE);
+	jpeg_set_defaults(&cinfo);
+	jpeg_set_quality(&cinfo, _quality, TRUE);
+
+	jpeg_start_compress(&cinfo, TRUE);
+	while(cinfo.next_scanline < cinfo.image_height)
+	{
+		rowPointer = (JSAMPROW)(_raw + cinfo.next_scanline * _width * (_color ? 3 : 1));
+		jpeg_write_scanlines(&cinfo, &rowPointer, 1);
+	}
+	jpeg_finish_compress(&cinfo);
+
+	free(jpgBuf);
+	jpeg_destroy_compress(&cinfo);
+
+	return(jpgBufLen);
+}
+
+
+static double elapsedUs(const struct timespec& _start)
+{
+	struct timespec	now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return((now.tv_sec - _start.tv_sec) * 1e6 + (now.tv_nsec - _start.tv_nsec) / 1e3);
+}
+
+
+static void printStats(const char* _name, vector<double>& _times, double _bytes)
+{
+	sort(_times.begin(), _times.end());
+	cout << "  " << _name << ": median " << int(_times[_times.size() / 2]) << " us, p99 "
+	     << int(_times[_times.size() * 99 / 100]) << " us, " << int(_bytes / _times.size()) << " bytes per frame" << endl;
+}
+
+
+int main(int argc, char** argv)
+{
+	int						width = 640;
+	int						height = 480;
+	int						quality = 80;
+	int						nFrames = 200;
+	PixelFormat				formats[] = {PIXEL_RGB8, PIXEL_MONO8};
+	vector<unsigned char>	raw;
+	vector<unsigned char>	dst;
+	vector<double>			times;
+	struct timespec			start;
+	double					bytes;
+	int						frameSize;
+	int						f;
+	int						i;
+
+	if(argc == 5)
+	{
+		width = atoi(argv[1]);
+		height = atoi(argv[2]);
+		quality = atoi(argv[3]);
+		nFrames = atoi(argv[4]);
+	}
+	else if(argc != 1)
+	{
+		cerr << "Usage: " << argv[0] << " [width height quality frames]" << endl;
+		return(1);
+	}
+
+	if(width < 16 || height < 16 || quality < 1 || quality > 100 || nFrames < 1)
+	{
+		cerr << "Invalid arguments" << endl;
+		return(1);
+	}
+
+	dst.resize(JPEG_BUF_SIZE(width, height));
+
+	for(f=0; f<2; f++)
+	{
+		JpegCompressor	compressor(formats[f], width, height, quality);
+
+		// A synthetic frame with some texture; one byte changes per frame so
+		// that nothing can be cached
+		frameSize = pixelFormatFrameSize(formats[f], width, height);
+		raw.resize(frameSize);
+		for(i=0; i<frameSize; i++)
+		{
+			raw[i] = (unsigned char)((i * 7 + (i / (width * 3)) * 3) ^ (i >> 5));
+		}
+
+		cout << width << "x" << height << " " << (formats[f] == PIXEL_RGB8 ? "color" : "grayscale") << ", quality " << quality << ", " << nFrames << " frames" << endl;
+
+		times.clear();
+		bytes = 0;
+		for(i=0; i<nFrames; i++)
+		{
+			raw[i % frameSize]++;
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			bytes += compressPerFrame(&raw[0], formats[f] == PIXEL_RGB8, width, height, quality);
+			times.push_back(elapsedUs(start));
+		}
+		printStats("set up per frame", times, bytes);
+
+		times.clear();
+		bytes = 0;
+		for(i=0; i<nFrames; i++)
+		{
+			raw[i % frameSize]++;
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			bytes += compressor.compress(&raw[0], &dst[0]);
+			times.push_back(elapsedUs(start));
+		}
+		printStats("JpegCompressor", times, bytes);
+	}
+
+	return(0);
+}
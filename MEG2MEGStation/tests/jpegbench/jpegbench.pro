@@ -0,0 +1,41 @@
+# Author: Andrey Zhdanov
+# Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+# Aalto University School of Science
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, version 3.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Per-frame JPEG encoding time, see jpegbench.cpp. Build with
+# qmake && make and run ./jpegbench [width height quality frames].
+
+TEMPLATE = app
+TARGET = jpegbench
+CONFIG += console
+CONFIG -= qt
+SRC = ../../src
+INCLUDEPATH += $$SRC
+HEADERS += $$SRC/jpegcompressor.h \
+    $$SRC/pixelformat.h \
+    $$SRC/demosaic.h \
+    $$SRC/config.h
+SOURCES += jpegbench.cpp \
+    $$SRC/jpegcompressor.cpp \
+    $$SRC/pixelformat.cpp \
+    $$SRC/demosaic.cpp
+LIBS += -ljpeg
+DEFINES += __STDC_LIMIT_MACROS
+
+# Same encoder as the application
+exists(/usr/include/turbojpeg.h)|exists(/usr/local/include/turbojpeg.h) {
+    DEFINES += HAVE_TURBOJPEG
+    LIBS += -lturbojpeg
+}
@@ -0,0 +1,168 @@
+/*
+ * read_aud.cpp
+ *
+ * MEX gateway of read_aud.m, see there for the usage.
+ *
+ * Author: Andrey Zhdanov
+ * Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+ * Aalto University School of Science
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <vector>
+
+#include "mex.h"
+#include "audiofilereader.h"
+
+#define CHUNK_COLS	6
+#define GAP_COLS	5
+
+// Matrix with _nCols columns from the rows stored one after another in _rows
+static mxArray* rowsToMatrix(const std::vector<double>& _rows, int _nCols)
+{
+	size_t		nRows = _rows.size() / _nCols;
+	mxArray*	m = mxCreateDoubleMatrix(nRows, _nCols, mxREAL);
+	double*		dst = mxGetPr(m);
+	size_t		i;
+	int			j;
+
+	for(i=0; i<nRows; i++)
+	{
+		for(j=0; j<_nCols; j++)
+		{
+			dst[j*nRows + i] = _rows[i*_nCols + j];
+		}
+	}
+
+	return(m);
+}
+
+
+void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[])
+{
+	static const char*	sampleFormatNames[] = {"S16", "S24", "S32", "FLOAT"};
+	static const char*	infoFields[] = {"version", "site_id", "is_sender", "sampling_rate", "n_channels", "sample_format", "compressed", "gaps"};
+
+	AudioFileReader				reader;
+	AudioRecord					rec;
+	FileRecordType				type;
+	std::vector<unsigned char>	samples;
+	std::vector<double>			chunks;
+	std::vector<double>			gaps;
+	char						error[500];
+	char*						fileName;
+	bool						ok;
+	int							nChans;
+	int							sampleSize;
+	size_t						nFrames = 0;
+	size_t						i;
+	int							ch;
+	unsigned char*				dst;
+	mxClassID					classId;
+	mxArray*					info;
+
+	if(nrhs != 1 || !mxIsChar(prhs[0]))
+	{
+		mexErrMsgIdAndTxt("read_aud:args", "read_aud: specify the file name");
+	}
+
+	fileName = mxArrayToString(prhs[0]);
+	ok = reader.open(fileName);
+	mxFree(fileName);
+	if(!ok)
+	{
+		mexErrMsgIdAndTxt("read_aud:open", "read_aud: %s", reader.getError());
+	}
+
+	nChans = reader.getChans();
+	sampleSize = sampleFormatSize(reader.getFormat());
+
+	while((type = reader.readRecord(&rec)) != FILE_RECORD_END)
+	{
+		switch(type)
+		{
+		case FILE_RECORD_CHUNK:
+			chunks.push_back(double(rec.timestamp));
+			chunks.push_back(double(rec.id));
+			chunks.push_back(double(nFrames + 1));
+			chunks.push_back(double(rec.nFrames));
+			chunks.push_back(double(rec.rawTstamp));
+			chunks.push_back(double(rec.fitTstamp));
+
+			samples.insert(samples.end(), (const unsigned char*)rec.data, (const unsigned char*)rec.data + rec.nFrames * nChans * sampleSize);
+			nFrames += rec.nFrames;
+			break;
+
+		case FILE_RECORD_GAP:
+			gaps.push_back(double(rec.timestamp));
+			gaps.push_back(double(rec.id));
+			gaps.push_back(double(rec.policy));
+			gaps.push_back(double(rec.droppedChunks));
+			gaps.push_back(double(rec.droppedBytes));
+			break;
+
+		default:
+			// The error does not return, so clean up first
+			strncpy(error, reader.getError(), sizeof(error) - 1);
+			error[sizeof(error) - 1] = 0;
+			reader.close();
+			mexErrMsgIdAndTxt("read_aud:read", "read_aud: %s", error);
+		}
+	}
+
+	// Samples, one column per channel
+	switch(reader.getFormat())
+	{
+	case SAMPLE_S16:
+		classId = mxINT16_CLASS;
+		break;
+
+	case SAMPLE_FLOAT:
+		classId = mxSINGLE_CLASS;
+		break;
+
+	default:
+		classId = mxINT32_CLASS;
+	}
+
+	plhs[0] = mxCreateNumericMatrix(nFrames, nChans, classId, mxREAL);
+	dst = (unsigned char*)mxGetData(plhs[0]);
+	for(i=0; i<nFrames; i++)
+	{
+		for(ch=0; ch<nChans; ch++)
+		{
+			memcpy(dst + (ch*nFrames + i) * sampleSize, &(samples[(i*nChans + ch) * sampleSize]), sampleSize);
+		}
+	}
+
+	if(nlhs > 1)
+	{
+		plhs[1] = rowsToMatrix(chunks, CHUNK_COLS);
+	}
+
+	if(nlhs > 2)
+	{
+		info = mxCreateStructMatrix(1, 1, sizeof(infoFields) / sizeof(infoFields[0]), infoFields);
+		mxSetField(info, 0, "version", mxCreateDoubleScalar(reader.getVersion()));
+		mxSetField(info, 0, "site_id", mxCreateDoubleScalar(reader.getSiteId()));
+		mxSetField(info, 0, "is_sender", mxCreateLogicalScalar(reader.getIsSender()));
+		mxSetField(info, 0, "sampling_rate", mxCreateDoubleScalar(reader.getSampRate()));
+		mxSetField(info, 0, "n_channels", mxCreateDoubleScalar(nChans));
+		mxSetField(info, 0, "sample_format", mxCreateString(sampleFormatNames[reader.getFormat()]));
+		mxSetField(info, 0, "compressed", mxCreateLogicalScalar(reader.isCompressed()));
+		mxSetField(info, 0, "gaps", rowsToMatrix(gaps, GAP_COLS));
+		plhs[2] = info;
+	}
+}
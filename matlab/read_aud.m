@@ -0,0 +1,38 @@
+%function [data,chunks,info]=read_aud(fn);
+%
+% Read an audio file (.aud) recorded by MEG2MEGStation, either compressed
+% or not. Implemented as a MEX file; build it in this directory with
+%
+%   mex -I../MEG2MEGStation/src read_aud.cpp ../MEG2MEGStation/src/filereader.cpp ../MEG2MEGStation/src/audiofilereader.cpp ../MEG2MEGStation/src/audiocodec.cpp
+%
+% data      samples, one column per channel: int16 for 16-bit files, int32
+%           for 24- and 32-bit ones and single for floating point ones
+% chunks    one row per audio period: timestamp (ms), id, index of its first
+%           sample in data, number of samples, capture time as observed
+%           (us) and as fitted to the sound card clock (us)
+% info      struct with the fields version, site_id, is_sender,
+%           sampling_rate, n_channels, sample_format, compressed and gaps
+%           (one row per gap in the recording: timestamp (ms), id of the
+%           next period, buffer overflow policy, number of lost periods and
+%           number of lost bytes)
+%
+
+%--------------------------------------------------------------------------
+%   Copyright (C) 2015 Department of Neuroscience and Biomedical Engineering,
+%   Aalto University School of Science
+%
+%   This program is free software: you can redistribute it and/or modify
+%   it under the terms of the GNU General Public License as published by
+%   the Free Software Foundation, version 3.
+%
+%   This program is distributed in the hope that it will be useful,
+%   but WITHOUT ANY WARRANTY; without even the implied warranty of
+%   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+%   GNU General Public License for more details.
+%
+%   You should have received a copy of the GNU General Public License
+%   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+%--------------------------------------------------------------------------
+
+function [data,chunks,info]=read_aud(fn);
+error('read_aud: the MEX file is not built, see help read_aud');